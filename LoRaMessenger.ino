@@ -6,8 +6,11 @@
 #include "storage.h"
 #include "buzz.h"
 #include "vib.h"
+#include "console.h"
+#include "loopprof.h"
 
 void setup() {
+  consoleInit();         // Serial: diagnostics commands
   appInitHardware();     // Vext + Display
   storageInit();         // Preferences (device name + contacts)
   protocolInit();        // LoRa pins + begin + receive
@@ -16,11 +19,15 @@ void setup() {
   uiEnterBootPage();     // decide PAGE_NAME or PAGE_CONTACTS
 }
 
+// Each stage is timed (loopprof.h); LOOP_PROF 0 leaves the bare calls
 void loop() {
-  protocolPoll();        // LoRa parse + dispatch
-  protocolSearchTick();
-  inputPoll();           // keypad/T9 + page routing
-  buzzTick();            // non-blocking beeps
-  vibTick();             // non-blocking vibration (optional)
-  uiTick();              // cursor blink / small animations
+  LOOP_BEGIN();
+  LOOP_STAGE(LS_PROTOCOL, protocolPoll());        // LoRa parse + dispatch
+  LOOP_STAGE(LS_SEARCH,   protocolSearchTick());
+  LOOP_STAGE(LS_INPUT,    inputPoll());           // keypad/T9 + page routing
+  LOOP_STAGE(LS_BUZZ,     buzzTick());            // non-blocking beeps
+  LOOP_STAGE(LS_VIB,      vibTick());             // non-blocking vibration (optional)
+  LOOP_STAGE(LS_UI,       uiTick());              // cursor blink / small animations
+  LOOP_STAGE(LS_CONSOLE,  consolePoll());         // serial commands (console.h)
+  LOOP_END();
 }
@@ -0,0 +1,87 @@
+#include "addr.h"
+#include "storage.h"
+#include "protocol.h"
+
+static uint32_t nodeId = 0;
+static uint8_t  primary = 0;
+
+static uint32_t fmix(uint32_t h){
+  h ^= h >> 16; h *= 0x85EBCA6B;
+  h ^= h >> 13; h *= 0xC2B2AE35;
+  return h ^ (h >> 16);
+}
+
+static inline bool validShort(uint8_t a){ return a != 0 && a != BROADCAST_ID; }
+
+uint32_t addrFoldMac(uint64_t mac){
+  uint32_t id = fmix((uint32_t)mac ^ fmix((uint32_t)(mac >> 32)));
+  return id ? id : 1;
+}
+
+void addrInit(){
+  nodeId = addrFoldMac(ESP.getEfuseMac());
+
+#ifdef DEVICE_ID
+  primary = DEVICE_ID;
+#else
+  primary = storageShortAddr();
+  if (!validShort(primary)){
+    uint8_t used[ADDR_SET_BYTES]; addrUsed(used);
+    primary = addrPick(nodeId, used, nullptr, 0);
+    storageSetShortAddr(primary);
+  }
+#endif
+
+  // contacts paired before pair addresses existed keep talking to our primary
+  for (int i=0;i<storageContactCount();i++)
+    if (!storageContactAt(i).self) storageSetContactSelf(i, primary);
+}
+
+uint32_t addrNodeId(){ return nodeId; }
+uint8_t  addrSelf(){ return primary; }
+
+uint8_t addrSelfFor(uint8_t peer){
+  int idx = storageFindContact(peer);
+  return idx >= 0 ? storageContactAt(idx).self : primary;
+}
+
+bool addrIsMine(uint8_t a){
+  if (a == primary) return true;
+  for (int i=0;i<storageContactCount();i++) if (storageContactAt(i).self == a) return true;
+  return false;
+}
+
+void addrUsed(uint8_t set[ADDR_SET_BYTES]){
+  memset(set, 0, ADDR_SET_BYTES);
+  if (primary) addrAddSet(set, primary);
+  for (int i=0;i<storageContactCount();i++){
+    const Contact& c = storageContactAt(i);
+    addrAddSet(set, c.id);
+    if (c.self) addrAddSet(set, c.self);
+  }
+}
+
+uint8_t addrPick(uint32_t node, const uint8_t* a, const uint8_t* b, uint8_t prefer){
+  auto freeIn = [&](uint8_t s){ return validShort(s) && !addrInSet(a, s) && !(b && addrInSet(b, s)); };
+  if (freeIn(prefer)) return prefer;
+  for (uint32_t salt=0; salt<64; salt++){
+    uint8_t s = (uint8_t)(1 + fmix(node + salt * 0x9E3779B9u) % 254);
+    if (freeIn(s)) return s;
+  }
+  for (int s=1; s<BROADCAST_ID; s++) if (freeIn((uint8_t)s)) return (uint8_t)s;
+  return (uint8_t)(1 + node % 254);                 // every short taken: nothing better to do
+}
+
+uint8_t addrOnClash(uint32_t other, const uint8_t* heard){
+#ifdef DEVICE_ID
+  (void)other; (void)heard;
+  return 0;
+#else
+  if (other == nodeId || other < nodeId) return 0;   // the lower ID moves
+  uint8_t used[ADDR_SET_BYTES]; addrUsed(used);
+  uint8_t old = primary;
+  primary = addrPick(nodeId, used, heard, 0);
+  storageSetShortAddr(primary);
+  return old;
+#endif
+}
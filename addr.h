@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Node addressing -----
+// A node's full ID is 32 bits folded from its eFuse MAC. It only goes on air in
+// discovery and invites. Frames carry 8-bit short addresses:
+//   primary short   - ours for broadcasts, discovery, and nodes we aren't paired with
+//   pair addresses  - fixed at pairing and kept in the Contact: `id` for the peer,
+//                     `self` for us toward it. Both are chosen so that every node
+//                     either side talks to has a distinct short.
+// If a stranger turns up with our primary short, the node with the lower full ID
+// moves to another one. Contacts keep using the pair address.
+// Build with -DDEVICE_ID=n to pin the primary (bench rigs).
+static const int ADDR_SET_BYTES = 32;               // bitmap over all 256 shorts
+
+void     addrInit();                 // after storageInit()
+uint32_t addrNodeId();
+uint32_t addrFoldMac(uint64_t mac);  // full ID of the node with this eFuse MAC (never 0)
+uint8_t  addrSelf();                 // primary short
+uint8_t  addrSelfFor(uint8_t peer);  // the short we use toward `peer`
+bool     addrIsMine(uint8_t a);      // primary or one of our pair addresses
+
+// Shorts we already have to tell apart: ours and our contacts'.
+void     addrUsed(uint8_t set[ADDR_SET_BYTES]);
+inline bool addrInSet(const uint8_t* set, uint8_t a){ return set[a >> 3] & (1 << (a & 7)); }
+inline void addrAddSet(uint8_t* set, uint8_t a){ set[a >> 3] |= (uint8_t)(1 << (a & 7)); }
+
+// `prefer` if it's a valid short outside both sets, otherwise the first free
+// one on `node`'s hashed probe sequence. `b` may be nullptr.
+uint8_t  addrPick(uint32_t node, const uint8_t* a, const uint8_t* b, uint8_t prefer);
+
+// A frame from another node (full ID `other`) carried our primary short.
+// Returns the primary we moved off, or 0 if we kept it. The new primary also
+// avoids `heard` (shorts of nodes around us; may be nullptr), so a move
+// doesn't land on a neighbour.
+uint8_t  addrOnClash(uint32_t other, const uint8_t* heard);
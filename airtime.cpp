@@ -0,0 +1,16 @@
+#include "airtime.h"
+
+uint32_t loraAirtimeUs(uint8_t payloadLen, uint8_t sf, uint32_t bw, uint8_t cr4,
+                       uint16_t preamble, bool implicitHeader, bool crcOn){
+  uint32_t tsymUs = (uint32_t)(((uint64_t)1 << sf) * 1000000ULL / bw);
+  bool lowDr = tsymUs > 16000;                       // low data rate optimize (SF11/12 @125k)
+
+  int32_t num = 8*(int32_t)payloadLen - 4*sf + 28 + (crcOn ? 16 : 0) - (implicitHeader ? 20 : 0);
+  int32_t den = 4*(sf - (lowDr ? 2 : 0));
+  int32_t blocks = num > 0 ? (num + den - 1) / den : 0;
+  uint32_t payloadSym = 8 + (uint32_t)blocks * cr4;
+
+  // preamble + 4.25 symbols of sync, kept in quarter symbols to stay integer
+  uint32_t quarterSyms = (preamble + payloadSym) * 4 + 17;
+  return (uint32_t)((uint64_t)quarterSyms * tsymUs / 4);
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <Arduino.h>
+
+// LoRa time-on-air (Semtech AN1200.13), in microseconds.
+// cr4 is the coding-rate denominator (5..8 for 4/5..4/8).
+uint32_t loraAirtimeUs(uint8_t payloadLen, uint8_t sf, uint32_t bw, uint8_t cr4,
+                       uint16_t preamble, bool implicitHeader, bool crcOn);
@@ -0,0 +1,117 @@
+#include "capture.h"
+
+#if CAPTURE
+#include <stddef.h>
+#include <Preferences.h>
+#include "metrics.h"
+#include "addr.h"
+
+static CaptureRec ring[CAPTURE_CAP];
+static uint32_t   total = 0;
+static uint32_t   lastRx = UINT32_MAX;            // record number of the newest RX frame
+bool captureOn = true;
+
+static const size_t REC_HEAD = offsetof(CaptureRec, data);   // flash blob: header, then len bytes
+
+static CaptureRec& append(const uint8_t* buf, uint8_t len, uint8_t flags, uint8_t chan){
+  CaptureRec& r = ring[total & (CAPTURE_CAP - 1)];
+  total++;
+  r.us = micros();
+  r.flags = flags;
+  r.chan = chan;
+  r.len = min(len, CAPTURE_MAX_LEN);
+  memcpy(r.data, buf, r.len);
+  return r;
+}
+
+void captureRx(const uint8_t* buf, uint8_t len, bool implicitHeader, uint8_t chan, const RadioRxInfo& rx){
+  if (!captureOn) return;
+  CaptureRec& r = append(buf, len, implicitHeader ? CAP_IMPLICIT : 0, chan);
+  r.rssi = rx.rssi;
+  r.snrQ4 = rx.snrQ4;
+  r.verdict = CAPTURE_PENDING;
+  lastRx = total - 1;
+}
+
+void captureTx(const uint8_t* buf, uint8_t len, bool implicitHeader, uint8_t chan, bool sent){
+  if (!captureOn) return;
+  CaptureRec& r = append(buf, len, CAP_TX | (implicitHeader ? CAP_IMPLICIT : 0), chan);
+  r.rssi = 0;
+  r.snrQ4 = 0;
+  r.verdict = sent ? MC_TX_FRAMES : MC_TX_FAIL;
+}
+
+// A handler's verdict (rx.bad_mac) replaces the dispatcher's rx.ok
+void captureVerdict(uint8_t verdict){
+  if (!captureOn || lastRx == UINT32_MAX || total - lastRx > CAPTURE_CAP) return;
+  ring[lastRx & (CAPTURE_CAP - 1)].verdict = verdict;
+}
+
+uint32_t captureTotal(){ return total; }
+
+const CaptureRec* captureAt(uint32_t n){
+  if (n >= total || total - n > CAPTURE_CAP) return nullptr;
+  return &ring[n & (CAPTURE_CAP - 1)];
+}
+
+void captureSetEnabled(bool on){ captureOn = on; }
+
+void captureClear(){ total = 0; lastRx = UINT32_MAX; }
+
+static void printRec(const CaptureRec& r){
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  char hex[2 * CAPTURE_MAX_LEN + 1];
+  for (uint8_t i=0;i<r.len;i++){ hex[2*i] = HEX_DIGITS[r.data[i] >> 4]; hex[2*i+1] = HEX_DIGITS[r.data[i] & 15]; }
+  hex[2 * r.len] = 0;
+  const char* verdict = r.verdict == CAPTURE_PENDING ? "pending" : metricCounterName(r.verdict);
+  Serial.printf("F %lu %s %c %u %d %d %s %u %s\n", (unsigned long)r.us, (r.flags & CAP_TX) ? "tx" : "rx",
+                (r.flags & CAP_IMPLICIT) ? 'I' : 'E', r.chan, r.rssi, r.snrQ4, verdict, r.len, hex);
+}
+
+// Paused while it prints, so the dump is one consistent snapshot
+void captureDump(){
+  bool was = captureOn;
+  captureOn = false;
+  uint32_t n = min(total, (uint32_t)CAPTURE_CAP);
+  Serial.printf("capture %lu frames, %lu overwritten, node %08lx addr %u, now %lu us\n", (unsigned long)n,
+                (unsigned long)(total - n), (unsigned long)addrNodeId(), addrSelf(), (unsigned long)micros());
+  for (uint32_t i=total-n;i<total;i++) printRec(ring[i & (CAPTURE_CAP - 1)]);
+  Serial.printf("capture end\n");
+  captureOn = was;
+}
+
+// ----- Flash copy: "n" records "f0".., and "at" (micros() when saved) -----
+bool captureSave(){
+  uint32_t n = min(total, (uint32_t)CAPTURE_SAVE);
+  Preferences p;
+  if (!p.begin("capture", false)) return false;
+  p.clear();
+  bool ok = true;
+  for (uint32_t i=0;i<n;i++){
+    const CaptureRec& r = ring[(total - n + i) & (CAPTURE_CAP - 1)];
+    char k[5]; snprintf(k, sizeof(k), "f%lu", (unsigned long)i);
+    ok = ok && p.putBytes(k, &r, REC_HEAD + r.len) == REC_HEAD + r.len;
+  }
+  p.putUInt("at", micros());
+  p.putUChar("n", ok ? (uint8_t)n : 0);
+  p.end();
+  return ok;
+}
+
+void captureDumpSaved(){
+  Preferences p;
+  p.begin("capture", true);
+  uint8_t n = p.getUChar("n", 0);
+  Serial.printf("capture %u frames, saved, node %08lx addr %u, now %lu us\n", n,
+                (unsigned long)addrNodeId(), addrSelf(), (unsigned long)p.getUInt("at", 0));
+  for (uint8_t i=0;i<n;i++){
+    CaptureRec r;
+    char k[5]; snprintf(k, sizeof(k), "f%u", i);
+    size_t got = p.getBytes(k, &r, sizeof(r));
+    if (got < REC_HEAD || got != REC_HEAD + r.len) continue;
+    printRec(r);
+  }
+  Serial.printf("capture end\n");
+  p.end();
+}
+#endif
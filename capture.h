@@ -0,0 +1,71 @@
+#pragma once
+#include <Arduino.h>
+#include "radio.h"
+
+// ----- Frame capture -----
+// Every frame received or sent, as it was on air, with its arrival time, RSSI,
+// SNR, the channel we were tuned to and what became of it: the metrics counter
+// it ended in (metrics.h), e.g. rx.malformed, rx.copy, rx.ok, tx.fail. One record per
+// frame in a RAM ring of the last CAPTURE_CAP, pcap style (a fixed record
+// header, then the bytes). The serial "capture" command dumps the ring:
+//   capture <n> frames, <m> overwritten, node <id> addr <short>, now <us> us
+//   F <us> <rx|tx> <I|E> <chan> <rssi> <snr_q4> <verdict> <len> <hex>
+//   capture end
+// I/E is the header mode, chan 255 the rendezvous channel. "capture save"
+// copies the newest CAPTURE_SAVE records to flash, where they survive the
+// reboot that usually follows a field problem; "capture flash" dumps them.
+// host/replay feeds a dump back through protocolPoll().
+// Opt-in: the ring is ~6 KB of RAM and every frame costs a copy, so normal
+// builds have CAPTURE 0 and empty hooks; build with -DCAPTURE=1 (the host
+// tools do) to get it.
+#ifndef CAPTURE
+#define CAPTURE 0
+#endif
+
+static const uint8_t CAPTURE_CAP  = 32;          // power of two; ~6 KB
+static const uint8_t CAPTURE_SAVE = 16;
+static const uint8_t CAPTURE_PENDING = 0xFF;     // verdict not known yet
+static const uint8_t CAPTURE_MAX_LEN = 170;      // sizeof(Packet)
+
+enum : uint8_t { CAP_TX = 0x01, CAP_IMPLICIT = 0x02 };
+
+struct CaptureRec {
+  uint32_t us;
+  int16_t  rssi;          // dBm, RX only
+  int8_t   snrQ4;
+  uint8_t  flags;         // CAP_*
+  uint8_t  chan;          // chan.h index, CHAN_RENDEZVOUS
+  uint8_t  verdict;       // MetricCounter, CAPTURE_PENDING
+  uint8_t  len;
+  uint8_t  data[CAPTURE_MAX_LEN];
+};
+
+#if CAPTURE
+extern bool captureOn;
+
+void captureRx(const uint8_t* buf, uint8_t len, bool implicitHeader, uint8_t chan, const RadioRxInfo& rx);
+void captureTx(const uint8_t* buf, uint8_t len, bool implicitHeader, uint8_t chan, bool sent);
+void captureVerdict(uint8_t verdict);            // for the newest RX record
+
+uint32_t          captureTotal();                // records ever made
+const CaptureRec* captureAt(uint32_t n);         // the n-th, nullptr once overwritten
+
+void captureSetEnabled(bool on);
+void captureClear();
+void captureDump();                              // oldest first, to Serial
+bool captureSave();                              // ring -> flash
+void captureDumpSaved();
+#else
+static const bool captureOn = false;
+
+static inline void captureRx(const uint8_t*, uint8_t, bool, uint8_t, const RadioRxInfo&){}
+static inline void captureTx(const uint8_t*, uint8_t, bool, uint8_t, bool){}
+static inline void captureVerdict(uint8_t){}
+static inline uint32_t captureTotal(){ return 0; }
+static inline const CaptureRec* captureAt(uint32_t){ return nullptr; }
+static inline void captureSetEnabled(bool){}
+static inline void captureClear(){}
+static inline void captureDump(){ Serial.printf("capture compiled out (CAPTURE 0)\n"); }
+static inline bool captureSave(){ return false; }
+static inline void captureDumpSaved(){ captureDump(); }
+#endif
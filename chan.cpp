@@ -0,0 +1,34 @@
+#include "chan.h"
+#include "radio.h"
+
+static uint8_t busyMask = 0;
+
+long chanFreqHz(uint8_t ch){ return CHAN_BASE_HZ + (long)(ch % CHAN_COUNT) * CHAN_STEP_HZ; }
+
+void chanScan(){
+  busyMask = 0;
+  for (uint8_t ch=0; ch<CHAN_COUNT; ch++){
+    radioSetFrequency(chanFreqHz(ch));          // RX restarts there
+    delay(2);                                   // let the RSSI register settle
+    int32_t sum = 0;
+    for (uint8_t i=0;i<CHAN_SCAN_SAMPLES;i++){ sum += radioRssi(); delay(5); }
+    if (sum / CHAN_SCAN_SAMPLES > CHAN_BUSY_DBM) busyMask |= (uint8_t)(1u << ch);
+  }
+}
+
+uint8_t chanBusyMask(){ return busyMask; }
+
+// FNV-1a over the key and the ordered ID pair, so both sides get the same start.
+uint8_t chanForPair(const uint8_t key[32], uint8_t a, uint8_t b){
+  uint32_t h = 2166136261u;
+  uint8_t lo = min(a, b), hi = max(a, b);
+  for (int i=0;i<32;i++){ h ^= key[i]; h *= 16777619u; }
+  h ^= lo; h *= 16777619u;
+  h ^= hi; h *= 16777619u;
+  uint8_t start = (uint8_t)(h % CHAN_COUNT);
+  for (uint8_t i=0;i<CHAN_COUNT;i++){
+    uint8_t ch = (uint8_t)((start + i) % CHAN_COUNT);
+    if (!(busyMask & (1u << ch))) return ch;
+  }
+  return start;                                  // everything busy: keep the pair's own
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Channel plan -----
+// Discovery, pairing, relays and idle listening stay on the rendezvous channel
+// (LORA_BAND in protocol.cpp). Each pair of contacts moves its traffic to one
+// of CHAN_COUNT data channels: a sequence derived from the pairing key and both
+// IDs, skipping channels the boot scan found busy. Frames carry the sender's
+// listen channel, so two sides whose scans disagree still find each other.
+static const uint8_t CHAN_COUNT      = 8;
+static const long    CHAN_BASE_HZ    = 903900000;   // US915 125 kHz grid, 903.9 .. 905.3 MHz
+static const long    CHAN_STEP_HZ    = 200000;
+static const uint8_t CHAN_RENDEZVOUS = 0xFF;
+static const int     CHAN_BUSY_DBM   = -100;        // mean RSSI above this = busy
+static const uint8_t CHAN_SCAN_SAMPLES = 16;
+
+long    chanFreqHz(uint8_t ch);
+void    chanScan();                  // boot-time RSSI survey; leaves the radio on the last channel
+uint8_t chanBusyMask();              // bit i = data channel i busy at boot
+uint8_t chanForPair(const uint8_t key[32], uint8_t a, uint8_t b);
@@ -0,0 +1,131 @@
+#include "compress.h"
+
+// Symbol order: ' ', a-z, 0-9, . , ? !, A-Z, ESC
+static const int NSYM    = 68;
+static const int SYM_ESC = NSYM - 1;
+static const int MAXBITS = 11;
+
+// Code lengths from a Huffman build over English letter frequencies,
+// ~18% spaces, sparse digits/punctuation and uppercase at 1/25 of lowercase.
+static const uint8_t SYM_LEN[NSYM] = {
+  3,                                                                       // ' '
+  4,6,6,5,3,6,6,5,4,10,7,5,6,4,4,6,10,5,4,4,6,7,6,10,6,11,                // a-z
+  8,8,8,8,8,8,8,8,8,8,                                                     // 0-9
+  7,8,8,8,                                                                 // . , ? !
+  9,11,10,10,8,10,11,9,9,11,11,10,10,9,9,11,11,9,9,9,10,11,11,11,11,11,   // A-Z
+  10                                                                       // ESC
+};
+
+static uint16_t symCode[NSYM];
+static int8_t   byteSym[256];            // byte -> symbol, -1 = escape
+static uint8_t  lenCount[MAXBITS + 1];
+static uint8_t  sorted[NSYM];            // symbols in canonical order
+static char     symByte[NSYM];
+static bool     ready = false;
+
+static void codecInit(){
+  if (ready) return;
+  int s = 0;
+  symByte[s++] = ' ';
+  for (char c='a'; c<='z'; c++) symByte[s++] = c;
+  for (char c='0'; c<='9'; c++) symByte[s++] = c;
+  symByte[s++]='.'; symByte[s++]=','; symByte[s++]='?'; symByte[s++]='!';
+  for (char c='A'; c<='Z'; c++) symByte[s++] = c;
+  symByte[SYM_ESC] = 0;
+
+  memset(byteSym, -1, sizeof(byteSym));
+  for (int i=0;i<SYM_ESC;i++) byteSym[(uint8_t)symByte[i]] = (int8_t)i;
+
+  // canonical code: shorter codes first, ties by symbol index
+  memset(lenCount, 0, sizeof(lenCount));
+  for (int i=0;i<NSYM;i++) lenCount[SYM_LEN[i]]++;
+  uint16_t next[MAXBITS + 2]; uint16_t code = 0;
+  int k = 0;
+  for (int len=1; len<=MAXBITS; len++){
+    code = (code + lenCount[len-1]) << 1;
+    next[len] = code;
+    for (int i=0;i<NSYM;i++) if (SYM_LEN[i]==len) sorted[k++] = (uint8_t)i;
+  }
+  for (int i=0;i<NSYM;i++) symCode[i] = next[SYM_LEN[i]]++;
+  ready = true;
+}
+
+static size_t storeRaw(const char* in, size_t n, uint8_t* out, size_t cap){
+  if (n == 0 || cap == 0) return 0;
+  size_t off = 0;
+  if ((uint8_t)in[0] >= 0x80) out[off++] = 0x00;   // keep byte0 from reading as the flag
+  size_t take = min(n, cap - off);
+  memcpy(out + off, in, take);
+  return off + take;
+}
+
+size_t compressText(const char* in, size_t n, uint8_t* out, size_t cap){
+  codecInit();
+  if (n == 0) return 0;
+  size_t rawLen = n + (((uint8_t)in[0] >= 0x80) ? 1 : 0);
+  size_t limit  = min(rawLen, cap);              // coded form must beat this to be used
+  if (limit < 2) return storeRaw(in, n, out, cap);
+
+  size_t pos = 1; uint32_t acc = 0; int bits = 0;
+  for (size_t i=0;i<n;i++){
+    int s = byteSym[(uint8_t)in[i]];
+    uint32_t v; int l;
+    if (s >= 0){ v = symCode[s]; l = SYM_LEN[s]; }
+    else       { v = ((uint32_t)symCode[SYM_ESC] << 8) | (uint8_t)in[i]; l = SYM_LEN[SYM_ESC] + 8; }
+    acc = (acc << l) | v; bits += l;
+    while (bits >= 8){
+      if (pos >= limit) return storeRaw(in, n, out, cap);
+      bits -= 8; out[pos++] = (uint8_t)(acc >> bits);
+    }
+  }
+  uint8_t pad = 0;
+  if (bits > 0){
+    if (pos >= limit) return storeRaw(in, n, out, cap);
+    pad = (uint8_t)(8 - bits);
+    out[pos++] = (uint8_t)(acc << pad);
+  }
+  out[0] = 0x80 | pad;
+  return pos;
+}
+
+size_t decompressText(const uint8_t* in, size_t n, char* out, size_t cap){
+  codecInit();
+  if (cap == 0) return 0;
+  size_t o = 0;
+  if (n == 0){ out[0] = 0; return 0; }
+
+  if (in[0] < 0x80){
+    size_t off = (in[0] == 0x00) ? 1 : 0;
+    o = min(n - off, cap - 1);
+    memcpy(out, in + off, o);
+    out[o] = 0;
+    return o;
+  }
+
+  if (n < 2){ out[0] = 0; return 0; }
+  size_t totalBits = (n - 1) * 8 - (in[0] & 0x07);
+  size_t bit = 0;
+  auto nextBit = [&]()->int { int b = (in[1 + (bit>>3)] >> (7 - (bit & 7))) & 1; bit++; return b; };
+
+  while (bit < totalBits && o < cap - 1){
+    // canonical decode: walk lengths until the code falls inside this length's range
+    int code = 0, first = 0, index = 0, sym = -1;
+    for (int len=1; len<=MAXBITS; len++){
+      if (bit >= totalBits) break;
+      code |= nextBit();
+      int count = lenCount[len];
+      if (code - first < count){ sym = sorted[index + code - first]; break; }
+      index += count; first += count;
+      first <<= 1; code <<= 1;
+    }
+    if (sym < 0) break;                          // truncated/corrupt stream
+    if (sym == SYM_ESC){
+      if (bit + 8 > totalBits) break;
+      uint8_t b = 0;
+      for (int i=0;i<8;i++) b = (uint8_t)((b << 1) | nextBit());
+      out[o++] = (char)b;
+    } else out[o++] = symByte[sym];
+  }
+  out[o] = 0;
+  return o;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <Arduino.h>
+
+// Chat text coder, applied before encryption / after decryption.
+// Static canonical Huffman code tuned to the T9 alphabet (space, a-z, 0-9,
+// ".,?!", A-Z); any other byte is escaped. Wire form of a packed message:
+//   byte0 >= 0x80 : Huffman bitstream follows, low 3 bits = padding bits in the last byte
+//   byte0 == 0x00 : raw text follows (only used when the text starts with a byte >= 0x80)
+//   otherwise     : the bytes are the raw text itself
+// Raw is chosen whenever coding doesn't make the message smaller.
+
+// Writes at most `cap` bytes, returns the packed length (raw text is truncated to fit).
+size_t compressText(const char* in, size_t n, uint8_t* out, size_t cap);
+
+// Writes a NUL-terminated string of at most cap-1 chars, returns its length.
+size_t decompressText(const uint8_t* in, size_t n, char* out, size_t cap);
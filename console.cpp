@@ -0,0 +1,83 @@
+#include "console.h"
+#include "metrics.h"
+#include "rtt.h"
+#include "loopprof.h"
+#include "trace.h"
+#include "capture.h"
+#include "protocol.h"
+
+static const uint8_t LINE_MAX = 64;
+static char    line[LINE_MAX + 1];
+static uint8_t lineLen = 0;
+static bool    lineOverflow = false;
+
+static void cmdMetrics(const char* arg){
+  if (!strcmp(arg, "reset")){ metricsReset(); Serial.printf("metrics reset\n"); }
+  else { metricsDump(); rttDump(); protocolRxStatsDump(); }
+}
+
+static void cmdLoop(const char* arg){
+  if (!strcmp(arg, "reset")){ loopProfReset(); Serial.printf("loop reset\n"); }
+  else if (!strncmp(arg, "alarm", 5)){
+    loopProfSetAlarmMs((uint16_t)atoi(arg + 5));
+    Serial.printf("loop alarm %d ms\n", atoi(arg + 5));
+  }
+  else loopProfDump();
+}
+
+static void cmdTrace(const char* arg){
+  if (!strcmp(arg, "on") || !strcmp(arg, "off")){
+    traceSetEnabled(arg[1] == 'n');
+    Serial.printf("trace %s\n", arg);
+  }
+  else if (!strcmp(arg, "clear")){ traceClear(); Serial.printf("trace cleared\n"); }
+  else traceDump();
+}
+
+static void cmdCapture(const char* arg){
+  if (!strcmp(arg, "on") || !strcmp(arg, "off")){
+    captureSetEnabled(arg[1] == 'n');
+    Serial.printf("capture %s\n", arg);
+  }
+  else if (!strcmp(arg, "clear")){ captureClear(); Serial.printf("capture cleared\n"); }
+  else if (!strcmp(arg, "save")) Serial.printf(captureSave() ? "capture saved\n" : "capture save failed\n");
+  else if (!strcmp(arg, "flash")) captureDumpSaved();
+  else captureDump();
+}
+
+struct ConsoleCmd { const char* verb; void (*fn)(const char* arg); };
+static const ConsoleCmd CMDS[] = {
+  { "metrics", cmdMetrics },
+  { "loop",    cmdLoop },
+  { "trace",   cmdTrace },
+  { "capture", cmdCapture },
+};
+
+void consoleInit(){ Serial.begin(115200); }
+
+void consoleExec(const char* text){
+  while (*text == ' ') text++;
+  size_t n = strcspn(text, " ");
+  const char* arg = text + n;
+  while (*arg == ' ') arg++;
+  if (n == 0) return;
+  for (const ConsoleCmd& c : CMDS)
+    if (strlen(c.verb) == n && !strncmp(c.verb, text, n)){ c.fn(arg); return; }
+  Serial.printf("? %.*s (commands:", (int)n, text);
+  for (const ConsoleCmd& c : CMDS) Serial.printf(" %s", c.verb);
+  Serial.printf(")\n");
+}
+
+void consolePoll(){
+  while (Serial.available() > 0){
+    int c = Serial.read();
+    if (c == '\r') continue;
+    if (c == '\n'){
+      line[lineLen] = 0;
+      if (lineOverflow) Serial.printf("? line too long\n");
+      else consoleExec(line);
+      lineLen = 0; lineOverflow = false;
+    } else if (lineLen < LINE_MAX) line[lineLen++] = (char)c;
+    else lineOverflow = true;
+  }
+}
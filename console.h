@@ -0,0 +1,19 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Serial console -----
+// Line commands on the USB serial port (115200 baud), answered on the same port:
+//   metrics          dump the metrics registry (metrics.h), per-peer RTT (rtt.h)
+//                    and per-type RX frames, drops and handler time (protocol.h)
+//   metrics reset    zero counters and histograms, restart gauge maxima
+//   loop             loop() stage timing (loopprof.h)
+//   loop reset       start it over
+//   loop alarm <ms>  report iterations longer than this (0 = off)
+//   trace            dump the event trace ring (trace.h)
+//   trace on|off|clear
+//   capture          dump the frame capture ring (capture.h; builds with CAPTURE 1)
+//   capture save     copy it to flash; "capture flash" dumps that copy
+//   capture on|off|clear
+void consoleInit();
+void consolePoll();                      // call from loop; never blocks
+void consoleExec(const char* line);      // one command line, without the newline
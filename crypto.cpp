@@ -1,5 +1,6 @@
 #include "crypto.h"
 #include "mbedtls/sha256.h"
+#include "trace.h"
 
 void sha256(const uint8_t* in, size_t inlen, uint8_t out[32]){
   mbedtls_sha256_context ctx;
@@ -11,6 +12,7 @@ void sha256(const uint8_t* in, size_t inlen, uint8_t out[32]){
 }
 
 void derivePairKey(const String& a, const String& b, uint32_t code6, const uint8_t nonce8[8], uint8_t outKey[32]){
+  TRACE_SPAN(TR_KDF, 0);
   String A=a, B=b;
   if (A > B) { String T=A; A=B; B=T; }
   uint8_t buf[16+16+4+8] = {0};
@@ -18,21 +20,25 @@ void derivePairKey(const String& a, const String& b, uint32_t code6, const uint8
   memcpy(buf+16, B.c_str(), min((size_t)16, B.length()));
   buf[32]=(code6>>24)&0xFF; buf[33]=(code6>>16)&0xFF; buf[34]=(code6>>8)&0xFF; buf[35]=code6&0xFF;
   memcpy(buf+36, nonce8, 8);
-  sha256(buf, sizeof(buf), outKey);
+  uint8_t sub[1+32], h[32];
+  sha256(buf, sizeof(buf), sub + 1);
+  sub[0] = 'M'; sha256(sub, sizeof(sub), h); memcpy(outKey + KEY_MAC_OFF, h, SUBKEY_LEN);
+  sub[0] = 'E'; sha256(sub, sizeof(sub), h); memcpy(outKey + KEY_STREAM_OFF, h, SUBKEY_LEN);
 }
 
 void keystreamXor(const uint8_t key[32], const uint8_t nonce4[4], uint8_t* buf, size_t len){
+  TRACE_SPAN(TR_XOR, len);
   uint32_t counter=0;
   size_t off=0;
   while (off < len){
     uint8_t block[32];
-    uint8_t material[32+4+4];
-    memcpy(material, key, 32);
-    memcpy(material+32, nonce4, 4);
-    material[36]=(counter>>24)&0xFF;
-    material[37]=(counter>>16)&0xFF;
-    material[38]=(counter>>8)&0xFF;
-    material[39]=(counter)&0xFF;
+    uint8_t material[SUBKEY_LEN+4+4];
+    memcpy(material, key + KEY_STREAM_OFF, SUBKEY_LEN);
+    memcpy(material+SUBKEY_LEN, nonce4, 4);
+    material[SUBKEY_LEN+4]=(counter>>24)&0xFF;
+    material[SUBKEY_LEN+5]=(counter>>16)&0xFF;
+    material[SUBKEY_LEN+6]=(counter>>8)&0xFF;
+    material[SUBKEY_LEN+7]=(counter)&0xFF;
     sha256(material, sizeof(material), block);
     size_t n = min((size_t)32, len-off);
     for (size_t i=0;i<n;i++) buf[off+i] ^= block[i];
@@ -40,3 +46,74 @@ void keystreamXor(const uint8_t key[32], const uint8_t nonce4[4], uint8_t* buf,
     counter++;
   }
 }
+
+// ----- SipHash-2-4 -----
+#define SIP_ROTL(x,b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+struct SipState { uint64_t v0, v1, v2, v3, tail; uint8_t ntail; size_t total; };
+
+static inline void sipRound(SipState& s){
+  s.v0 += s.v1; s.v1 = SIP_ROTL(s.v1,13); s.v1 ^= s.v0; s.v0 = SIP_ROTL(s.v0,32);
+  s.v2 += s.v3; s.v3 = SIP_ROTL(s.v3,16); s.v3 ^= s.v2;
+  s.v0 += s.v3; s.v3 = SIP_ROTL(s.v3,21); s.v3 ^= s.v0;
+  s.v2 += s.v1; s.v1 = SIP_ROTL(s.v1,17); s.v1 ^= s.v2; s.v2 = SIP_ROTL(s.v2,32);
+}
+
+static inline uint64_t getU64LE(const uint8_t* p){
+  uint64_t v = 0;
+  for (int i=7;i>=0;i--) v = (v << 8) | p[i];
+  return v;
+}
+
+static void sipBegin(SipState& s, const uint8_t key[16]){
+  uint64_t k0 = getU64LE(key), k1 = getU64LE(key+8);
+  s.v0 = 0x736f6d6570736575ULL ^ k0;
+  s.v1 = 0x646f72616e646f6dULL ^ k1;
+  s.v2 = 0x6c7967656e657261ULL ^ k0;
+  s.v3 = 0x7465646279746573ULL ^ k1;
+  s.tail = 0; s.ntail = 0; s.total = 0;
+}
+
+static inline void sipBlock(SipState& s, uint64_t m){
+  s.v3 ^= m; sipRound(s); sipRound(s); s.v0 ^= m;
+}
+
+static void sipUpdate(SipState& s, const uint8_t* in, size_t len){
+  s.total += len;
+  while (len && s.ntail){                             // finish a partial word
+    s.tail |= (uint64_t)*in++ << (8 * s.ntail); len--;
+    if (++s.ntail == 8){ sipBlock(s, s.tail); s.tail = 0; s.ntail = 0; }
+  }
+  for (; len >= 8; in += 8, len -= 8) sipBlock(s, getU64LE(in));
+  while (len--){ s.tail |= (uint64_t)*in++ << (8 * s.ntail); s.ntail++; }
+}
+
+static uint64_t sipEnd(SipState& s){
+  sipBlock(s, s.tail | ((uint64_t)(s.total & 0xFF) << 56));
+  s.v2 ^= 0xFF;
+  sipRound(s); sipRound(s); sipRound(s); sipRound(s);
+  return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+uint64_t sipHash24(const uint8_t key[16], const uint8_t* in, size_t len){
+  SipState s; sipBegin(s, key);
+  sipUpdate(s, in, len);
+  return sipEnd(s);
+}
+
+void macTag(const uint8_t key[32], const uint8_t* ad, size_t adLen, const uint8_t* data, size_t len, uint8_t out[MAC_LEN]){
+  TRACE_SPAN(TR_MAC, len);
+  SipState s; sipBegin(s, key + KEY_MAC_OFF);
+  sipUpdate(s, ad, adLen);
+  sipUpdate(s, data, len);
+  uint64_t h = sipEnd(s);
+  for (int i=0;i<MAC_LEN;i++) out[i] = (uint8_t)(h >> (8*i));
+}
+
+bool macCheck(const uint8_t key[32], const uint8_t* ad, size_t adLen, const uint8_t* data, size_t len, const uint8_t tag[MAC_LEN]){
+  uint8_t want[MAC_LEN];
+  macTag(key, ad, adLen, data, len, want);
+  uint8_t d = 0;
+  for (int i=0;i<MAC_LEN;i++) d |= want[i] ^ tag[i];   // no early exit
+  return d == 0;
+}
@@ -2,5 +2,19 @@
 #pragma once
 #include <Arduino.h>
 void sha256(const uint8_t* in, size_t inlen, uint8_t out[32]);
+
+// A contact key is two independent subkeys, each hashed from the pairing
+// secret with its own domain byte: [0..15] keys the link tag, [16..31] the
+// keystream; keystreamXor and macTag take the whole key and use their half.
+static const uint8_t KEY_MAC_OFF = 0, KEY_STREAM_OFF = 16, SUBKEY_LEN = 16;
 void derivePairKey(const String& a, const String& b, uint32_t code6, const uint8_t nonce8[8], uint8_t outKey[32]);
 void keystreamXor(const uint8_t key[32], const uint8_t nonce4[4], uint8_t* buf, size_t len);
+
+// SipHash-2-4 (Aumasson/Bernstein), 64-bit output.
+uint64_t sipHash24(const uint8_t key[16], const uint8_t* in, size_t len);
+
+// Link tag: SipHash-2-4 keyed with the contact key's MAC subkey over ad
+// (frame header fields) then data, truncated to MAC_LEN bytes.
+static const uint8_t MAC_LEN = 4;
+void macTag(const uint8_t key[32], const uint8_t* ad, size_t adLen, const uint8_t* data, size_t len, uint8_t out[MAC_LEN]);
+bool macCheck(const uint8_t key[32], const uint8_t* ad, size_t adLen, const uint8_t* data, size_t len, const uint8_t tag[MAC_LEN]);
@@ -0,0 +1,98 @@
+#include "fec.h"
+
+// ----- GF(256), polynomial x^8+x^4+x^3+x^2+1 (0x11D) -----
+static uint8_t gfExp[512];
+static uint8_t gfLog[256];
+static bool    gfReady = false;
+
+static void gfInit(){
+  if (gfReady) return;
+  uint16_t x = 1;
+  for (int i=0;i<255;i++){
+    gfExp[i] = (uint8_t)x;
+    gfLog[x] = (uint8_t)i;
+    x <<= 1;
+    if (x & 0x100) x ^= 0x11D;
+  }
+  for (int i=255;i<512;i++) gfExp[i] = gfExp[i-255];
+  gfReady = true;
+}
+
+static inline uint8_t gfMul(uint8_t a, uint8_t b){
+  if (!a || !b) return 0;
+  return gfExp[gfLog[a] + gfLog[b]];
+}
+static inline uint8_t gfInv(uint8_t a){ return gfExp[255 - gfLog[a]]; }
+
+// dst ^= c * src
+static void gfMulAdd(uint8_t* dst, const uint8_t* src, uint8_t c, size_t n){
+  if (!c) return;
+  if (c == 1){ for (size_t i=0;i<n;i++) dst[i] ^= src[i]; return; }
+  const uint8_t lc = gfLog[c];
+  for (size_t i=0;i<n;i++){
+    uint8_t s = src[i];
+    if (s) dst[i] ^= gfExp[gfLog[s] + lc];
+  }
+}
+
+// Cauchy coefficient for repair row r, data column j: 1 / (x_r ^ y_j),
+// x_r = 128 + r and y_j = j are disjoint, so every square submatrix is invertible.
+static inline uint8_t coef(uint8_t r, uint8_t j){ return gfInv((uint8_t)((128 + r) ^ j)); }
+
+void fecRepair(const uint8_t* data, uint8_t k, size_t sym, uint8_t r, uint8_t* out){
+  gfInit();
+  memset(out, 0, sym);
+  for (uint8_t j=0;j<k;j++) gfMulAdd(out, data + (size_t)j*sym, coef(r, j), sym);
+}
+
+bool fecRecover(uint8_t* data, uint8_t k, size_t sym, uint32_t have,
+                uint8_t* repair, uint16_t repairHave){
+  gfInit();
+  uint8_t miss[FEC_MAX_REPAIR], rows[FEC_MAX_REPAIR];
+  uint8_t e = 0, nr = 0;
+  for (uint8_t j=0;j<k;j++){
+    if (have & (1u<<j)) continue;
+    if (e == FEC_MAX_REPAIR) return false;
+    miss[e++] = j;
+  }
+  if (e == 0) return true;
+  for (uint8_t r=0;r<FEC_MAX_REPAIR && nr<e;r++) if (repairHave & (1u<<r)) rows[nr++] = r;
+  if (nr < e) return false;
+
+  // invert the e x e Cauchy submatrix (Gauss-Jordan)
+  uint8_t m[FEC_MAX_REPAIR][FEC_MAX_REPAIR], inv[FEC_MAX_REPAIR][FEC_MAX_REPAIR];
+  for (uint8_t a=0;a<e;a++) for (uint8_t b=0;b<e;b++){
+    m[a][b]   = coef(rows[a], miss[b]);
+    inv[a][b] = (a==b);
+  }
+  for (uint8_t c=0;c<e;c++){
+    uint8_t p = c;
+    while (p<e && !m[p][c]) p++;
+    if (p == e) return false;
+    if (p != c) for (uint8_t b=0;b<e;b++){
+      uint8_t t=m[p][b]; m[p][b]=m[c][b]; m[c][b]=t;
+      t=inv[p][b]; inv[p][b]=inv[c][b]; inv[c][b]=t;
+    }
+    uint8_t s = gfInv(m[c][c]);
+    for (uint8_t b=0;b<e;b++){ m[c][b]=gfMul(m[c][b],s); inv[c][b]=gfMul(inv[c][b],s); }
+    for (uint8_t a=0;a<e;a++){
+      if (a==c || !m[a][c]) continue;
+      uint8_t f = m[a][c];
+      for (uint8_t b=0;b<e;b++){ m[a][b]^=gfMul(f,m[c][b]); inv[a][b]^=gfMul(f,inv[c][b]); }
+    }
+  }
+
+  // the repair symbols are only touched from here on: strip the known data out
+  for (uint8_t a=0;a<e;a++){
+    uint8_t* rhs = repair + (size_t)rows[a]*sym;
+    for (uint8_t j=0;j<k;j++) if (have & (1u<<j)) gfMulAdd(rhs, data + (size_t)j*sym, coef(rows[a], j), sym);
+  }
+
+  // missing[b] = sum_a inv[b][a] * rhs[a]
+  for (uint8_t b=0;b<e;b++){
+    uint8_t* dst = data + (size_t)miss[b]*sym;
+    memset(dst, 0, sym);
+    for (uint8_t a=0;a<e;a++) gfMulAdd(dst, repair + (size_t)rows[a]*sym, inv[b][a], sym);
+  }
+  return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <Arduino.h>
+
+// Systematic Reed-Solomon erasure code over GF(256) (Cauchy generator).
+// k data symbols of `sym` bytes each are protected by up to FEC_MAX_REPAIR
+// repair symbols; any k of the k+FEC_MAX_REPAIR symbols rebuild the data.
+static const uint8_t FEC_MAX_DATA   = 32;
+static const uint8_t FEC_MAX_REPAIR = 12;
+
+// out = repair symbol r (0..FEC_MAX_REPAIR-1) of the k zero-padded data symbols.
+void fecRepair(const uint8_t* data, uint8_t k, size_t sym, uint8_t r, uint8_t* out);
+
+// Rebuild the data symbols missing from `have` (bit j = data symbol j present)
+// using the repair symbols flagged in `repairHave` (bit r = repair[r*sym..]).
+// Repair buffers are used as scratch when it succeeds; false (too few
+// symbols) leaves them as they were.
+bool fecRecover(uint8_t* data, uint8_t k, size_t sym, uint32_t have,
+                uint8_t* repair, uint16_t repairHave);
@@ -0,0 +1,306 @@
+#include "frag.h"
+#include "fec.h"
+#include "protocol.h"
+
+static inline void putU16BE(uint8_t* b, uint16_t v){ b[0]=uint8_t(v>>8); b[1]=uint8_t(v); }
+static inline uint16_t getU16BE(const uint8_t* b){ return (uint16_t)b[0]<<8 | b[1]; }
+static inline void putU32BE(uint8_t* b, uint32_t v){
+  b[0]=uint8_t(v>>24); b[1]=uint8_t(v>>16); b[2]=uint8_t(v>>8); b[3]=uint8_t(v);
+}
+static inline uint32_t getU32BE(const uint8_t* b){
+  return (uint32_t)b[0]<<24 | (uint32_t)b[1]<<16 | (uint32_t)b[2]<<8 | (uint32_t)b[3];
+}
+static inline uint32_t fullMask(uint8_t count){ return count>=32 ? 0xFFFFFFFFu : ((1u<<count)-1u); }
+
+// ----- FEC settings / loss estimate -----
+static bool    fecOn     = FRAG_FEC_DEFAULT;
+static uint8_t lossQ8    = 26;          // EWMA of frame loss, 1/256 units (~10% to start)
+
+void    fragSetFec(bool on){ fecOn = on; }
+bool    fragFecEnabled(){ return fecOn; }
+uint8_t fragLossPct(){ return (uint8_t)((lossQ8 * 100 + 128) >> 8); }
+
+// Repair fragments needed so that n frames survive a loss rate of lossQ8: n*p/(1-p), at least 1.
+static uint8_t repairFor(uint8_t n){
+  uint16_t keep = 256 - min((uint16_t)lossQ8, (uint16_t)230);
+  uint16_t r = (uint16_t)(((uint32_t)n * lossQ8 + keep - 1) / keep);
+  return (uint8_t)max((uint16_t)1, r);
+}
+
+// ----- Sender (one transfer at a time) -----
+static struct {
+  bool     active;
+  uint8_t  to;
+  uint16_t msgId;
+  FragKind kind;
+  uint16_t len;
+  uint8_t  count;
+  uint32_t acked;        // union of SACK bitmaps
+  uint32_t inFlight;     // sent in the current burst
+  uint32_t sentOnce;     // data fragments sent at least once
+  bool     awaitingSack;
+  uint32_t lastTxMs;
+  uint8_t  timeouts;
+  uint8_t  lastIdx;      // fragment that carried the ack request (wire index)
+  bool     fec;
+  uint8_t  repairNext;   // next unused repair number
+  uint8_t  roundRepair;  // repair fragments still to send in this burst
+  uint8_t  buf[FRAG_BUF_LEN];
+} tx;
+
+uint8_t* fragTxBegin(uint8_t to, uint16_t msgId, FragKind kind){
+  if (tx.active) return nullptr;
+  tx.to = to; tx.msgId = msgId; tx.kind = kind;
+  return tx.buf;
+}
+
+bool fragTxStart(uint16_t len){
+  if (tx.active || len==0 || len>FRAG_MSG_MAX) return false;
+  tx.len = len;
+  tx.count = (uint8_t)((len + FRAG_DATA_MAX - 1) / FRAG_DATA_MAX);
+  memset(tx.buf + len, 0, (size_t)tx.count*FRAG_DATA_MAX - len);   // repair symbols use zero padding
+  tx.acked = 0; tx.inFlight = 0; tx.sentOnce = 0;
+  tx.awaitingSack = false;
+  tx.lastTxMs = millis() - FRAG_GAP_MS;
+  tx.timeouts = 0;
+  tx.fec = fecOn && tx.count > 1;
+  tx.repairNext = 0;
+  tx.roundRepair = tx.fec ? min(repairFor(tx.count), FEC_MAX_REPAIR) : 0;
+  tx.active = true;
+  return true;
+}
+
+bool fragTxBusy(){ return tx.active; }
+uint8_t fragTxPeer(){ return tx.to; }
+
+static void txFinish(bool ok){
+  tx.active = false;
+  protocolOnFragSent(tx.to, tx.msgId, tx.kind, ok);
+}
+
+// Next fragment of the window [base, base+window) that is neither acked nor in flight.
+// FEC bursts cover the whole message.
+static int txNextInWindow(int after){
+  int base = 0;
+  while (base<tx.count && (tx.acked & (1u<<base))) base++;
+  int end = tx.fec ? tx.count : min(base + (int)FRAG_WINDOW, (int)tx.count);
+  for (int i=max(base, after+1); i<end; i++){
+    uint32_t bit = 1u<<i;
+    if (!(tx.acked & bit) && !(tx.inFlight & bit)) return i;
+  }
+  return -1;
+}
+
+static void txSendFragment(int idx, bool ackReq){
+  uint8_t body[FRAG_HDR_LEN + FRAG_DATA_MAX];
+  uint8_t n;
+  if (idx < tx.count){
+    uint16_t off = (uint16_t)idx * FRAG_DATA_MAX;
+    n = (uint8_t)min((int)FRAG_DATA_MAX, (int)(tx.len - off));
+    memcpy(body+FRAG_HDR_LEN, tx.buf+off, n);
+  } else {
+    n = FRAG_DATA_MAX;
+    fecRepair(tx.buf, tx.count, FRAG_DATA_MAX, (uint8_t)(idx - tx.count), body+FRAG_HDR_LEN);
+  }
+  body[0] = (uint8_t)idx;
+  body[1] = tx.count | (ackReq ? FRAG_FLAG_ACKREQ : 0) | (tx.kind == FRAG_KIND_SYNC ? FRAG_FLAG_SYNC : 0);
+  putU16BE(body+2, tx.len);
+  protocolSendFrame(tx.to, TYPE_FRAG, tx.msgId, body, FRAG_HDR_LEN + n);
+}
+
+static void txTick(uint32_t now){
+  if (!tx.active) return;
+
+  if (tx.awaitingSack){
+    if (now - tx.lastTxMs < FRAG_ACK_TIMEOUT_MS) return;
+    if (protocolTxDeferMs() > 0) return;
+    // SACK (or the ack-request fragment) lost: probe with that fragment only,
+    // the SACK it triggers tells us which others are really missing
+    protocolTxFeedback(false);
+    if (++tx.timeouts > FRAG_RETRIES){ txFinish(false); return; }
+    txSendFragment(tx.lastIdx, true);
+    tx.lastTxMs = now;
+    return;
+  }
+
+  if (now - tx.lastTxMs < FRAG_GAP_MS) return;   // one frame per gap, radio is half duplex
+  if (protocolTxDeferMs() > 0) return;           // node-wide pacing (protocol.cpp)
+  int idx = txNextInWindow(-1);
+  bool last;
+  if (idx >= 0){
+    last = (txNextInWindow(idx) < 0) && tx.roundRepair == 0;
+    tx.inFlight |= (1u<<idx);
+    tx.sentOnce |= (1u<<idx);
+  } else if (tx.roundRepair > 0){
+    idx = tx.count + tx.repairNext++;
+    last = (--tx.roundRepair == 0);
+  } else return;
+  txSendFragment(idx, last);
+  tx.lastTxMs = now;
+  if (last){ tx.awaitingSack = true; tx.lastIdx = (uint8_t)idx; }
+}
+
+void fragOnSack(uint8_t from, uint16_t msgId, const uint8_t* body, uint8_t len, uint32_t now){
+  if (!tx.active || from!=tx.to || msgId!=tx.msgId || len<4) return;
+  uint32_t bitmap = getU32BE(body) & fullMask(tx.count);
+  tx.timeouts = 0;                              // peer is alive, retry budget restarts
+  protocolTxFeedback(true);
+  tx.acked |= bitmap;
+
+  if (len >= 6){
+    // loss sample: distinct frames the peer holds vs distinct frames we sent up to
+    // the highest one it saw (anything later may still be in the air)
+    uint8_t  hi   = body[5];
+    uint32_t dataUpTo = (hi >= tx.count) ? tx.sentOnce : (tx.sentOnce & fullMask(hi + 1));
+    uint16_t sent = __builtin_popcount(dataUpTo) + (hi >= tx.count ? min((uint8_t)(hi - tx.count + 1), tx.repairNext) : 0);
+    uint16_t got  = min((uint16_t)body[4], sent);
+    if (sent > 0){
+      uint8_t sample = (uint8_t)min(255, (int)(((uint32_t)(sent - got) << 8) / sent));
+      lossQ8 = (uint8_t)(((uint16_t)lossQ8 * 3 + sample) >> 2);
+    }
+  }
+
+  if (tx.acked == fullMask(tx.count)){ txFinish(true); return; }
+  // peer is listening again: start the next burst right away
+  tx.awaitingSack = false;
+  tx.lastTxMs = now - FRAG_GAP_MS;
+  uint8_t missing = (uint8_t)__builtin_popcount(fullMask(tx.count) & ~tx.acked);
+  if (tx.fec && tx.repairNext < FEC_MAX_REPAIR){
+    // any fresh repair fragment fills any hole: send those instead of the data itself
+    tx.inFlight = fullMask(tx.count);
+    tx.roundRepair = min((uint8_t)(missing + repairFor(missing) - 1), (uint8_t)(FEC_MAX_REPAIR - tx.repairNext));
+  } else {
+    tx.fec = false;                             // repair numbers exhausted: selective repeat
+    tx.inFlight = 0;
+    tx.roundRepair = 0;
+  }
+}
+
+// ----- Receiver (bounded reassembly slots) -----
+struct RxSlot {
+  bool     used;
+  bool     done;
+  uint8_t  from;
+  uint16_t msgId;
+  FragKind kind;
+  uint8_t  count;
+  uint16_t len;
+  uint32_t got;
+  uint16_t repairGot;  // repair fragments held in rxRepair (owner only)
+  uint8_t  frames;     // distinct frames received
+  uint8_t  hiIdx;      // highest wire index received
+  uint32_t lastMs;
+  uint8_t  buf[FRAG_BUF_LEN + 1];   // +1 so the owner can NUL-terminate text
+};
+static RxSlot rx[FRAG_RX_SLOTS];
+
+// Repair fragments of one transfer at a time (1.8 KB); another one arriving
+// meanwhile keeps to its data fragments and selective repeat.
+static uint8_t rxRepair[FEC_MAX_REPAIR * FRAG_DATA_MAX];
+static RxSlot* rxRepairOwner = nullptr;
+
+static bool rxRepairTake(RxSlot* s){
+  RxSlot* o = rxRepairOwner;
+  if (o && o != s && o->used && !o->done) return false;
+  if (o && o != s) o->repairGot = 0;
+  rxRepairOwner = s;
+  return true;
+}
+
+static void sendSack(const RxSlot* s){
+  uint8_t body[6]; putU32BE(body, s->got); body[4] = s->frames; body[5] = s->hiIdx;
+  protocolSendFrame(s->from, TYPE_FRAG_ACK, s->msgId, body, sizeof(body));
+}
+
+static RxSlot* rxFind(uint8_t from, uint16_t msgId){
+  for (int i=0;i<FRAG_RX_SLOTS;i++) if (rx[i].used && rx[i].from==from && rx[i].msgId==msgId) return &rx[i];
+  return nullptr;
+}
+
+static RxSlot* rxAlloc(){
+  RxSlot* oldestDone = nullptr;
+  for (int i=0;i<FRAG_RX_SLOTS;i++){
+    if (!rx[i].used) return &rx[i];
+    if (rx[i].done && (!oldestDone || rx[i].lastMs < oldestDone->lastMs)) oldestDone = &rx[i];
+  }
+  return oldestDone;   // never evict a transfer still in progress; sender will retry
+}
+
+void fragOnFrame(uint8_t from, uint16_t msgId, const uint8_t* body, uint8_t len, uint32_t now){
+  if (len < FRAG_HDR_LEN) return;
+  uint8_t  idx   = body[0];
+  bool     ackReq= (body[1] & FRAG_FLAG_ACKREQ) != 0;
+  FragKind kind  = (body[1] & FRAG_FLAG_SYNC) ? FRAG_KIND_SYNC : FRAG_KIND_CHAT;
+  uint8_t  count = body[1] & (uint8_t)~(FRAG_FLAG_ACKREQ | FRAG_FLAG_SYNC);
+  uint16_t total = getU16BE(body+2);
+
+  // sanity: header must describe a consistent, bounded message
+  if (count==0 || count>FRAG_MAX_COUNT || idx>=count+FEC_MAX_REPAIR) return;
+  if (total==0 || total>FRAG_MSG_MAX) return;
+  if ((uint16_t)((total + FRAG_DATA_MAX - 1) / FRAG_DATA_MAX) != count) return;
+  bool     isRepair = idx >= count;
+  uint16_t off = (uint16_t)idx * FRAG_DATA_MAX;
+  uint8_t  n   = isRepair ? FRAG_DATA_MAX : (uint8_t)min((int)FRAG_DATA_MAX, (int)(total - off));
+  if (len - FRAG_HDR_LEN != n) return;
+
+  RxSlot* s = rxFind(from, msgId);
+  if (s && (s->count!=count || s->len!=total || s->kind!=kind)) return;
+  if (s && s->done){ if (ackReq) sendSack(s); return; }   // repeat of a finished message
+  if (!s){
+    s = rxAlloc();
+    if (!s) return;
+    s->used=true; s->done=false;
+    s->from=from; s->msgId=msgId; s->kind=kind; s->count=count; s->len=total;
+    s->got=0; s->repairGot=0; s->frames=0; s->hiIdx=0;
+  }
+  s->lastMs = now;
+  if (idx > s->hiIdx) s->hiIdx = idx;
+
+  if (isRepair){
+    uint16_t bit = (uint16_t)(1u << (idx - count));
+    if (!(s->repairGot & bit) && rxRepairTake(s)){
+      memcpy(rxRepair + (size_t)(idx - count)*FRAG_DATA_MAX, body+FRAG_HDR_LEN, n);
+      s->repairGot |= bit; s->frames++;
+    }
+  } else {
+    uint32_t bit = 1u<<idx;
+    if (!(s->got & bit)){
+      memcpy(s->buf+off, body+FRAG_HDR_LEN, n);
+      memset(s->buf+off+n, 0, FRAG_DATA_MAX - n);   // zero padding, as the encoder saw it
+      s->got |= bit; s->frames++;
+    }
+  }
+
+  // enough symbols in total: rebuild the holes from repair fragments. Only a
+  // recovery consumes them (as scratch); otherwise they wait for more.
+  if (s->got != fullMask(count) && s->repairGot &&
+      __builtin_popcount(s->got) + __builtin_popcount(s->repairGot) >= count &&
+      fecRecover(s->buf, count, FRAG_DATA_MAX, s->got, rxRepair, s->repairGot)){
+    s->got = fullMask(count);
+    s->repairGot = 0;
+  }
+
+  // complete: SACKed only once its tag has passed, so a forged or damaged
+  // message is never reported delivered; dropped, it can be sent again whole
+  if (s->got == fullMask(count)){
+    s->buf[s->len] = 0;
+    if (!protocolOnFragMessage(from, msgId, s->kind, s->buf, s->len)){ s->used = false; return; }
+    s->done = true;
+    sendSack(s);
+    return;
+  }
+  if (ackReq) sendSack(s);
+}
+
+static void rxExpire(uint32_t now){
+  for (int i=0;i<FRAG_RX_SLOTS;i++){
+    if (!rx[i].used) continue;
+    uint32_t age = now - rx[i].lastMs;
+    if (age > (rx[i].done ? FRAG_RX_KEEP_MS : FRAG_RX_STALL_MS)) rx[i].used = false;
+  }
+}
+
+void fragTick(uint32_t now){
+  txTick(now);
+  rxExpire(now);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Fragmented transfer (messages that don't fit one DATA frame) -----
+// Fragment body layout (TYPE_FRAG, Packet.seq = message id):
+//   [0] fragment index   [1] fragment count | FRAG_FLAG_ACKREQ | FRAG_FLAG_SYNC
+//   [2..3] total length (BE)
+//   [4..] fragment data
+// Index >= count marks a FEC repair fragment (repair number = index - count),
+// always FRAG_DATA_MAX bytes long (see fec.h).
+// Selective ACK (TYPE_FRAG_ACK, Packet.seq = message id):
+//   [0..3] bitmap of received fragments (BE, bit i = fragment i)
+//   [4]    distinct frames (data + repair) received so far   [5] highest index received
+//          (together they give the sender a loss sample, see fragOnSack)
+static const uint8_t  FRAG_HDR_LEN     = 4;
+static const uint8_t  FRAG_DATA_MAX    = 152;
+static const uint8_t  FRAG_MAX_COUNT   = 32;          // one bit per fragment in the SACK
+static const uint16_t FRAG_MSG_MAX     = 4096 + 4 + 4; // text + 4-byte nonce + link tag (crypto.h)
+static const uint16_t FRAG_BUF_LEN     = ((FRAG_MSG_MAX + FRAG_DATA_MAX - 1) / FRAG_DATA_MAX) * FRAG_DATA_MAX;
+static const uint8_t  FRAG_FLAG_ACKREQ = 0x80;
+static const uint8_t  FRAG_FLAG_SYNC   = 0x40;        // payload is a history batch, not chat text
+
+// What a transfer carries (FRAG_FLAG_SYNC on the wire)
+enum FragKind : uint8_t { FRAG_KIND_CHAT, FRAG_KIND_SYNC };
+
+static const uint8_t  FRAG_WINDOW         = 4;        // fragments in flight per burst
+static const uint16_t FRAG_GAP_MS         = 300;      // ~airtime of one frame at SF7/125k
+static const uint16_t FRAG_ACK_TIMEOUT_MS = 1500;
+static const uint8_t  FRAG_RETRIES        = 8;        // SACK timeouts in a row before giving up
+static const int      FRAG_RX_SLOTS       = 2;        // reassembly buffers, FRAG_BUF_LEN each (plus one
+                                                      // FEC_MAX_REPAIR x FRAG_DATA_MAX repair buffer)
+static const uint32_t FRAG_RX_STALL_MS    = 15000;    // drop half-received messages
+static const uint32_t FRAG_RX_KEEP_MS     = 20000;    // keep finished ones to re-SACK repeats
+
+// FEC mode: the whole message goes out in one burst followed by repair
+// fragments sized from the observed loss, so most holes are filled without a
+// round trip. Later rounds send fresh repair fragments; plain ARQ once they run out.
+#ifndef FRAG_FEC_DEFAULT
+#define FRAG_FEC_DEFAULT true
+#endif
+void fragSetFec(bool on);
+bool fragFecEnabled();
+uint8_t fragLossPct();            // smoothed frame loss seen by the sender
+
+// Sender: fill the returned buffer (nullptr while another transfer runs), then start it.
+uint8_t* fragTxBegin(uint8_t to, uint16_t msgId, FragKind kind = FRAG_KIND_CHAT);
+bool     fragTxStart(uint16_t len);
+bool     fragTxBusy();
+uint8_t  fragTxPeer();             // destination of the running transfer
+
+// Drive retransmissions / expiry; call from protocolPoll().
+void fragTick(uint32_t now);
+
+// Frame handlers (called by protocolPoll for frames addressed to us)
+void fragOnFrame(uint8_t from, uint16_t msgId, const uint8_t* body, uint8_t len, uint32_t now);
+void fragOnSack(uint8_t from, uint16_t msgId, const uint8_t* body, uint8_t len, uint32_t now);
@@ -0,0 +1,847 @@
+#include "sim.h"
+#include "../protocol.h"
+#include "../peer.h"
+#include "../chan.h"
+#include "../ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+// ----- Scenario benchmarks on the virtual medium -----
+// bench [-s seed] [-r runs] [-o out.jsonl] [-l node.so] [--quick] [-v] [scenario...]
+// Runs scripted scenarios against N unmodified firmware nodes (sim.h) and
+// prints one JSON object per line per (scenario, parameter point, seed), so
+// two builds can be compared run over run (same seed = same run). A short
+// human summary of each line goes to stderr. The few hard expectations
+// (expect()) print FAIL there and make up the exit status.
+//
+// Every message carries a "#<k> " tag; the chat log hook ties sender status
+// changes and receiver arrivals back to it, and the TX hook counts frames.
+// Common fields:
+//   msgs, pdr            messages sent, receptions / expected receptions
+//   lat_p50/p99_ms       send -> text in the receiver's chat log
+//   ack_p50/p99_ms       send -> DELIVERED at the sender (ACK round trip)
+//   retries_per_msg      DATA frames the senders originated per message and receiver, minus one
+//   air_ms, frames       everything on air, all nodes
+//   air_us_per_byte      air_ms per delivered text byte
+//   collisions, crc_errors, half_duplex   from the medium
+//   sim_s, wall_ms
+// Contacts are provisioned directly (node.cpp `contact`) rather than through
+// discovery and the invite code, which simrun already covers.
+
+// ----- Run state -----
+struct Msg {
+  int      from;
+  std::vector<int> to;
+  uint16_t bytes;
+  uint64_t sentUs, ackUs;
+  std::vector<uint64_t> rxUs;      // per receiver, 0 = not yet
+  uint8_t  status;
+  bool     settled;                // DELIVERED, FAILED or OUTBOX at the sender
+  bool     blob;                   // node.cpp `blob`: no sender log entry, settles on arrival
+};
+
+struct Tally {
+  std::vector<Msg>      msgs;
+  std::vector<uint8_t>  self;      // node -> primary short
+  std::vector<uint32_t> dataTx;    // DATA frames a node originated
+  std::vector<uint64_t> rxBytes;   // text bytes a node received
+  uint32_t frames, relayed;
+  uint32_t byType[32];
+  uint64_t airUs, bytes;
+  uint64_t airByType[32];
+  uint64_t t0;
+  SimMediumStats medium0;          // at markStart()
+};
+static Tally T;
+
+static SimConfig baseCfg;
+static FILE*     out = stdout;
+static bool      quick = false;
+static uint32_t  rng = 1;
+static int       failed = 0;         // expect() misses; the exit status
+
+static uint32_t benchRand(){ rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; return rng; }
+static float benchUniform(){ return (benchRand() + 0.5f) / 4294967296.0f; }
+
+static double wallMs(){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void onTx(void*, int node, const uint8_t* buf, uint8_t len, uint32_t airUs){
+  T.frames++;
+  T.airUs += airUs;
+  T.bytes += len;
+  uint8_t type = len > 2 ? buf[2] & 31 : 0;
+  T.byType[type]++;
+  T.airByType[type] += airUs;
+  if (node >= (int)T.self.size() || len < 3) return;
+  if (buf[0] != T.self[node] && T.self[node]) T.relayed++;
+  else if (type == TYPE_DATA) T.dataTx[node]++;
+}
+
+// A property the firmware must keep whatever the numbers: reported, and the
+// run exits non-zero.
+static void expect(bool ok, const char* scenario, const char* what){
+  if (ok) return;
+  fprintf(stderr, "FAIL %s: %s\n", scenario, what);
+  failed++;
+}
+
+static int msgTag(const char* text){
+  if (text[0] != '#') return -1;
+  char* end;
+  long k = strtol(text + 1, &end, 10);
+  return *end == ' ' && k >= 0 && k < (long)T.msgs.size() ? (int)k : -1;
+}
+
+static void onChat(void*, int node, const SimChatInfo* m, int oldStatus){
+  int k = msgTag(m->text);
+  if (k < 0) return;
+  Msg& g = T.msgs[k];
+  if (node == g.from){
+    g.status = m->status;
+    if (m->status == ST_DELIVERED && !g.ackUs) g.ackUs = simNowUs();
+    if (m->status == ST_DELIVERED || m->status == ST_FAILED || m->status == ST_OUTBOX) g.settled = true;
+    return;
+  }
+  if (oldStatus != -1) return;
+  for (size_t j=0;j<g.to.size();j++){
+    if (g.to[j] != node || g.rxUs[j]) continue;
+    g.rxUs[j] = simNowUs();
+    T.rxBytes[node] += g.bytes;
+    if (g.blob) g.settled = true;
+  }
+}
+
+// Fresh medium with the scenario's config; nodes added next.
+static bool start(uint32_t seed, const SimConfig& c){
+  SimConfig k = c;
+  k.seed = seed;
+  rng = seed * 2654435761u | 1;
+  T = Tally();
+  if (!simInit(k)) return false;
+  simSetHooks(onTx, onChat, nullptr);
+  return true;
+}
+
+static int addNode(float x, float y, bool pinAddr){
+  int i = simNodeCount();
+  char name[16];
+  snprintf(name, sizeof(name), "n%d", i);
+  int r = simAddNode(x, y, name, pinAddr ? (uint8_t)(i + 1) : 0);
+  if (r < 0){ fprintf(stderr, "can't load %s\n", baseCfg.nodeLib); exit(1); }
+  return r;
+}
+
+// n nodes scattered in a disc (all in range of each other at these radii)
+static void addCluster(int n, float radius, bool pinAddr){
+  for (int i=0;i<n;i++){
+    float r = radius * sqrtf(benchUniform()), a = 6.2831853f * benchUniform();
+    addNode(r * cosf(a), r * sinf(a), pinAddr);
+  }
+}
+
+// Boot (channel scan included), then learn each node's address.
+static void bootAll(){
+  simRunFor(1500);
+  int n = simNodeCount();
+  T.self.assign(n, 0);
+  T.dataTx.assign(n, 0);
+  T.rxBytes.assign(n, 0);
+  for (int i=0;i<n;i++) T.self[i] = simInfo(i).self;
+}
+
+// Both sides learn each other as pairing would, with a fresh random key.
+static void pairNodes(int a, int b){
+  char key[65];
+  for (int i=0;i<32;i++) snprintf(key + 2*i, 3, "%02x", benchRand() & 0xFF);
+  SimNodeInfo ia = simInfo(a), ib = simInfo(b);
+  simCommand(a, "contact %u %u %08lx %s n%d", ib.self, ia.self, (unsigned long)ib.nodeId, key, b);
+  simCommand(b, "contact %u %u %08lx %s n%d", ia.self, ib.self, (unsigned long)ia.nodeId, key, a);
+}
+
+// Resets the counters the report is taken over (after setup traffic).
+static void markStart(){
+  T.medium0 = simMediumStats();
+  T.frames = T.relayed = 0;
+  T.airUs = T.bytes = 0;
+  memset(T.byType, 0, sizeof(T.byType));
+  memset(T.airByType, 0, sizeof(T.airByType));
+  std::fill(T.dataTx.begin(), T.dataTx.end(), 0);
+  std::fill(T.rxBytes.begin(), T.rxBytes.end(), 0);
+  T.t0 = simNowUs();
+}
+
+static const char* WORDS[] = { "lora", "mesh", "hello", "radio", "packet", "field", "north", "camp",
+                               "battery", "signal", "river", "ok", "see", "you", "at", "dawn" };
+
+static std::string makeText(int k, int len){
+  char tag[16];
+  snprintf(tag, sizeof(tag), "#%d ", k);
+  std::string s = tag;
+  while ((int)s.size() < len){ s += WORDS[benchRand() % 16]; s += ' '; }
+  s.resize(len);
+  return s;
+}
+
+// Printable bytes the text coder can't shrink, so the packed size is `len`
+// and a 4 KB blob fills the fragment window (frag.h FRAG_MAX_COUNT).
+static std::string makeBlob(int k, int len){
+  char tag[16];
+  snprintf(tag, sizeof(tag), "#%d ", k);
+  std::string s = tag;
+  while ((int)s.size() < len) s += (char)('!' + benchRand() % 94);
+  s.resize(len);
+  return s;
+}
+
+// Past the compose limit a message goes out as a `blob` (node.cpp).
+static int sendMsg(int from, const std::vector<int>& to, int len){
+  int k = (int)T.msgs.size();
+  bool blob = len > CHAT_MSG_MAX_LEN;
+  std::string text = blob ? makeBlob(k, len) : makeText(k, len);
+  Msg m{};
+  m.from = from; m.to = to; m.bytes = (uint16_t)len;
+  m.sentUs = simNowUs();
+  m.rxUs.assign(to.size(), 0);
+  m.blob = blob;
+  T.msgs.push_back(m);
+  simCommand(from, "%s %u %s", blob ? "blob" : "chat", T.self[to[0]], text.c_str());
+  return k;
+}
+
+// One sender -> one receiver, `left` messages, each once the last settled and
+// gap..2*gap passed. Flows start up to a second apart: people don't type in
+// lockstep, and lockstep senders would only measure the scripting.
+struct Flow { int from, to, left, cur; uint64_t nextUs; };
+
+static uint64_t jitterUs(uint32_t ms){ return (uint64_t)(benchUniform() * ms * 1000); }
+
+static void addFlow(std::vector<Flow>& f, int from, int to, int count){
+  f.push_back(Flow{from, to, count, -1, simNowUs() + jitterUs(1000)});
+}
+
+// Runs until every flow is done or `forMs` passes (then no new messages, and
+// up to drainMs more for what's in flight).
+static void runFlows(std::vector<Flow>& flows, int len, uint32_t gapMs, uint32_t forMs, uint32_t drainMs){
+  uint64_t end = simNowUs() + (uint64_t)forMs * 1000;
+  for (;;){
+    bool busy = false;
+    for (Flow& f : flows){
+      if (f.cur >= 0 && T.msgs[f.cur].settled){ f.cur = -1; f.nextUs = simNowUs() + (uint64_t)gapMs * 1000 + jitterUs(gapMs); }
+      if (f.cur < 0 && f.left > 0 && simNowUs() >= f.nextUs && simNowUs() < end){
+        f.cur = sendMsg(f.from, std::vector<int>{f.to}, len);
+        f.left--;
+      }
+      busy |= f.cur >= 0 || (f.left > 0 && simNowUs() < end);
+    }
+    if (!busy || simNowUs() >= end) break;
+    simRunFor(10);
+  }
+  // drain: receipts and late statuses
+  uint64_t stop = simNowUs() + (uint64_t)drainMs * 1000;
+  while (simNowUs() < stop){
+    bool open = false;
+    for (Flow& f : flows) open |= f.cur >= 0 && !T.msgs[f.cur].settled;
+    if (!open) break;
+    simRunFor(50);
+  }
+  simRunFor(500);
+}
+
+// ----- Report -----
+static double pct(std::vector<double> v, double p){
+  if (v.empty()) return -1;
+  std::sort(v.begin(), v.end());
+  size_t i = (size_t)ceil(p / 100.0 * v.size());
+  return v[i ? i - 1 : 0];
+}
+
+// One JSON object, flat: string and number values only.
+struct Rec {
+  std::string s;
+  double t0;
+  Rec(const char* scenario, uint32_t seed){
+    t0 = wallMs();
+    s = "{";
+    str("scenario", scenario);
+    num("seed", seed);
+  }
+  void key(const char* k){ if (s.size() > 1) s += ","; s += "\""; s += k; s += "\":"; }
+  void str(const char* k, const char* v){ key(k); s += "\""; s += v; s += "\""; }
+  void num(const char* k, double v){
+    key(k);
+    char b[32];
+    if (!std::isfinite(v)) snprintf(b, sizeof(b), "null");
+    else if (v == (long long)v && fabs(v) < 1e15) snprintf(b, sizeof(b), "%lld", (long long)v);
+    else snprintf(b, sizeof(b), "%.4g", v);
+    s += b;
+  }
+  void emit(){
+    SimMediumStats m = simMediumStats();
+    num("collisions", m.collisions - T.medium0.collisions);
+    num("crc_errors", m.crcErrors - T.medium0.crcErrors);
+    num("half_duplex", m.halfDuplex - T.medium0.halfDuplex);
+    num("sim_s", simNowUs() / 1e6);
+    num("wall_ms", round(wallMs() - t0));
+    s += "}";
+    fprintf(out, "%s\n", s.c_str());
+    fflush(out);
+  }
+};
+
+// Delivery, latency, retry and airtime fields over every tracked message.
+static void msgFields(Rec& r){
+  std::vector<double> lat, ack;
+  int expected = 0, got = 0, delivered = 0;
+  uint64_t bytes = 0, dataTx = 0;
+  std::set<int> senders;
+  for (const Msg& m : T.msgs){
+    senders.insert(m.from);
+    if (m.ackUs){ delivered++; ack.push_back((m.ackUs - m.sentUs) / 1e3); }
+    for (size_t j=0;j<m.to.size();j++){
+      expected++;
+      if (!m.rxUs[j]) continue;
+      got++;
+      bytes += m.bytes;
+      lat.push_back((m.rxUs[j] - m.sentUs) / 1e3);
+    }
+  }
+  for (int s : senders) dataTx += T.dataTx[s];
+  r.num("msgs", T.msgs.size());
+  r.num("pdr", expected ? (double)got / expected : 0);
+  r.num("delivered", delivered);
+  r.num("lat_p50_ms", pct(lat, 50));
+  r.num("lat_p99_ms", pct(lat, 99));
+  r.num("ack_p50_ms", pct(ack, 50));
+  r.num("ack_p99_ms", pct(ack, 99));
+  r.num("retries_per_msg", expected ? std::max(0.0, (double)dataTx / expected - 1) : 0);   // a broadcast sends one per receiver
+  r.num("frames", T.frames);
+  r.num("air_ms", T.airUs / 1e3);
+  r.num("air_us_per_byte", bytes ? (double)T.airUs / bytes : -1);
+  double secs = (simNowUs() - T.t0) / 1e6;
+  r.num("goodput_bps", secs > 0 ? bytes * 8 / secs : 0);
+}
+
+static void summary(const char* name, const char* point){
+  std::vector<double> lat;
+  int expected = 0, got = 0;
+  for (const Msg& m : T.msgs)
+    for (size_t j=0;j<m.to.size();j++){ expected++; if (m.rxUs[j]){ got++; lat.push_back((m.rxUs[j] - m.sentUs) / 1e3); } }
+  fprintf(stderr, "%-11s %-22s pdr %5.3f  p50 %7.0f ms  p99 %7.0f ms  air %8.0f ms\n",
+          name, point, expected ? (double)got / expected : 0, pct(lat, 50), pct(lat, 99), T.airUs / 1e3);
+}
+
+// Sensitivity at SF7/125 kHz and the distance that leaves `marginDb` over it.
+static float marginDistance(const SimConfig& c, float marginDb){
+  float noise = -174 + 10 * log10f(125e3f) + c.noiseFigureDb;
+  float floorDbm = noise - 2.5f * (7 - 4);
+  float loss = 14 - (floorDbm + marginDb) - c.pathLoss0Db;
+  return powf(10, loss / (10 * c.pathExp));
+}
+
+// ----- Scenarios -----
+// discovery: everyone searches at once. How many neighbours each finds and
+// how fast; duplicate short addresses at boot and after the clash rule;
+// peer table use against its fixed size.
+static void scDiscovery(uint32_t seed){
+  std::vector<int> sizes = quick ? std::vector<int>{5, 20} : std::vector<int>{5, 20, 50};
+  for (int n : sizes){
+    if (!start(seed, baseCfg)) return;
+    Rec r("discovery", seed);
+    addCluster(n, 150, false);
+    bootAll();
+    std::set<uint8_t> ids(T.self.begin(), T.self.end());
+    int clashBoot = n - (int)ids.size();
+    markStart();
+    for (int i=0;i<n;i++) simCommand(i, "search");
+    int want = std::min(n - 1, MAX_DISC);
+    std::vector<std::set<uint8_t>> seen(n);
+    std::vector<double> first, full;
+    std::vector<bool> done(n, false);
+    int peersMax = 0;
+    for (int t=0;t<(quick ? 15000 : 30000);t+=100){
+      simRunFor(100);
+      for (int i=0;i<n;i++){
+        SimNodeInfo in = simInfo(i);
+        peersMax = std::max(peersMax, in.peers);
+        for (int k=0;k<in.nearby && k<MAX_DISC;k++)
+          if (seen[i].insert(in.nearbyIds[k]).second) first.push_back((simNowUs() - T.t0) / 1e3);
+        if (!done[i] && (int)seen[i].size() >= want){ done[i] = true; full.push_back((simNowUs() - T.t0) / 1e3); }
+      }
+    }
+    int found = 0;
+    for (int i=0;i<n;i++) found += std::min((int)seen[i].size(), want);
+    ids.clear();
+    for (int i=0;i<n;i++) ids.insert(simInfo(i).self);
+    r.num("nodes", n);
+    r.num("pdr", (double)found / (n * want));
+    r.num("lat_p50_ms", pct(first, 50));
+    r.num("lat_p99_ms", pct(first, 99));
+    r.num("nodes_full", full.size());
+    r.num("full_p50_ms", pct(full, 50));
+    r.num("frames", T.frames);
+    r.num("disc_req", T.byType[TYPE_DISC_REQ]);
+    r.num("disc_rsp", T.byType[TYPE_DISC_RSP]);
+    r.num("air_ms", T.airUs / 1e3);
+    r.num("clash_boot", clashBoot);
+    r.num("clash_end", n - (int)ids.size());
+    r.num("peers_max", peersMax);
+    r.num("peer_slots", PEER_SLOTS);
+    r.num("peer_table_bytes", sizeof(PeerState) * PEER_SLOTS);
+    r.emit();
+    fprintf(stderr, "%-11s n=%-20d found %5.3f  first p50 %5.0f ms  clashes %d -> %d  peers %d/%d\n",
+            "discovery", n, (double)found / (n * want), pct(first, 50), clashBoot, n - (int)ids.size(), peersMax, PEER_MAX);
+    expect(n == (int)ids.size(), "discovery", "short addresses still shared at the end");
+    simShutdown();
+  }
+}
+
+// chat: P independent pairs in one cell, each sending M short messages.
+// P=1 is the ACK round trip on a quiet channel.
+static void scChat(uint32_t seed){
+  std::vector<int> pairs = quick ? std::vector<int>{1, 5} : std::vector<int>{1, 5, 10, 25};
+  int count = quick ? 8 : 20;
+  for (int p : pairs){
+    if (!start(seed, baseCfg)) return;
+    Rec r("chat", seed);
+    addCluster(2 * p, 150, true);
+    bootAll();
+    for (int i=0;i<p;i++) pairNodes(2*i, 2*i + 1);
+    simRunFor(100);
+    markStart();
+    std::vector<Flow> flows;
+    for (int i=0;i<p;i++) addFlow(flows, 2*i, 2*i + 1, count);
+    runFlows(flows, 40, 1000, count * 20000, 20000);
+    r.num("pairs", p);
+    r.num("msg_bytes", 40);
+    msgFields(r);
+    r.emit();
+    char pt[32]; snprintf(pt, sizeof(pt), "pairs=%d", p);
+    summary("chat", pt);
+    simShutdown();
+  }
+}
+
+// fanout: a hub broadcasts to every contact (one unicast + ACK each).
+static void scFanout(uint32_t seed){
+  std::vector<int> sizes = quick ? std::vector<int>{5} : std::vector<int>{5, 11};
+  int count = quick ? 3 : 5;
+  for (int n : sizes){
+    if (!start(seed, baseCfg)) return;
+    Rec r("fanout", seed);
+    addCluster(n, 150, true);
+    bootAll();
+    std::vector<int> to;
+    for (int i=1;i<n;i++){ pairNodes(0, i); to.push_back(i); }
+    simRunFor(100);
+    markStart();
+    for (int k=0;k<count;k++){
+      int m = (int)T.msgs.size();
+      Msg g{};
+      g.from = 0; g.to = to; g.bytes = 40; g.sentUs = simNowUs(); g.rxUs.assign(to.size(), 0);
+      T.msgs.push_back(g);
+      simCommand(0, "bcast %s", makeText(m, 40).c_str());
+      uint64_t end = simNowUs() + 30000000ull;
+      while (simNowUs() < end && std::count(T.msgs[m].rxUs.begin(), T.msgs[m].rxUs.end(), 0ull)) simRunFor(50);
+      simRunFor(3000);           // the hub is still collecting ACKs for the last ones
+    }
+    r.num("nodes", n);
+    r.num("msg_bytes", 40);
+    msgFields(r);
+    r.emit();
+    char pt[32]; snprintf(pt, sizeof(pt), "receivers=%d", n - 1);
+    summary("fanout", pt);
+    simShutdown();
+  }
+}
+
+// lossy_link: one pair at a shrinking margin over sensitivity, with fading.
+static void scLossy(uint32_t seed){
+  std::vector<float> margins = quick ? std::vector<float>{10, 3} : std::vector<float>{12, 6, 3, 0};
+  int count = quick ? 8 : 20;
+  for (float mdb : margins){
+    SimConfig c = baseCfg;
+    c.fadingDb = 4;
+    if (!start(seed, c)) return;
+    Rec r("lossy_link", seed);
+    float d = marginDistance(c, mdb);
+    addNode(0, 0, true);
+    addNode(d, 0, true);
+    bootAll();
+    pairNodes(0, 1);
+    simRunFor(100);
+    markStart();
+    std::vector<Flow> flows;
+    addFlow(flows, 0, 1, count);
+    runFlows(flows, 40, 1000, count * 30000, 30000);
+    r.num("margin_db", mdb);
+    r.num("distance_m", round(d));
+    r.num("fading_db", c.fadingDb);
+    msgFields(r);
+    r.emit();
+    char pt[32]; snprintf(pt, sizeof(pt), "margin=%.0fdB d=%.0fm", mdb, d);
+    summary("lossy_link", pt);
+    simShutdown();
+  }
+}
+
+// rtt: what the ACK wait learns. One pair on a clean link, near the
+// sensitivity floor with fading, and sharing the cell with three busy pairs.
+// ack_wait_before_ms is the first-try wait with no RTT sample (airtime
+// based), ack_wait_after_ms the wait once the messages were ACKed, next to
+// the measured srtt and ack_p50/p99. fixed_wait_ms is the single timeout every
+// try used before the estimator. Each link runs twice, ack "ctrl" with the
+// 6-byte implicit-header ACKs and ack "full" with full-frame ones (node.cpp
+// `ctrlack 0`, every node), with ack_p10/p90 for the rest of the distribution.
+static void scRtt(uint32_t seed){
+  struct Case { const char* name; float marginDb, fadingDb; int busyPairs; };
+  const Case CASES[] = { { "clean", 20, 0, 0 }, { "weak", 3, 4, 0 }, { "busy", 20, 0, 3 } };
+  int count = quick ? 10 : 30;
+  for (const Case& k : CASES) for (int ctrl=1;ctrl>=0;ctrl--){
+    SimConfig c = baseCfg;
+    c.fadingDb = k.fadingDb;
+    if (!start(seed, c)) return;
+    Rec r("rtt", seed);
+    addNode(0, 0, true);
+    addNode(marginDistance(c, k.marginDb), 0, true);
+    for (int i=0;i<2*k.busyPairs;i++) addNode(50 + 20 * i, 50, true);
+    bootAll();
+    pairNodes(0, 1);
+    for (int i=0;i<k.busyPairs;i++) pairNodes(2 + 2*i, 3 + 2*i);
+    if (!ctrl) for (int i=0;i<simNodeCount();i++) simCommand(i, "ctrlack 0");
+    simRunFor(100);
+    SimNodeInfo before = simInfo(0);
+    markStart();
+    std::vector<Flow> flows;
+    addFlow(flows, 0, 1, count);
+    for (int i=0;i<k.busyPairs;i++) addFlow(flows, 2 + 2*i, 3 + 2*i, 1 << 30);
+    runFlows(flows, 40, 1000, count * 30000, 30000);
+    SimNodeInfo after = simInfo(0);
+    T.msgs.erase(std::remove_if(T.msgs.begin(), T.msgs.end(), [](const Msg& m){ return m.from != 0; }), T.msgs.end());
+    std::vector<double> ack;
+    for (const Msg& m : T.msgs) if (m.ackUs) ack.push_back((m.ackUs - m.sentUs) / 1e3);
+    r.str("link", k.name);
+    r.str("ack", ctrl ? "ctrl" : "full");
+    r.num("busy_pairs", k.busyPairs);
+    r.num("fixed_wait_ms", 1200);
+    r.num("ack_wait_before_ms", before.ackWaitMs[0]);
+    r.num("ack_wait_after_ms", after.ackWaitMs[0]);
+    r.num("srtt_ms", after.srttMs[0]);
+    r.num("ack_p10_ms", pct(ack, 10));
+    r.num("ack_p90_ms", pct(ack, 90));
+    msgFields(r);
+    r.emit();
+    char pt[48]; snprintf(pt, sizeof(pt), "%s %s wait %u->%u ms", k.name, ctrl ? "ctrl" : "full", before.ackWaitMs[0], after.ackWaitMs[0]);
+    summary("rtt", pt);
+    simShutdown();
+  }
+}
+
+// frag: long (fragmented) messages under random frame loss, with and without
+// FEC repair fragments. 480 B is the compose limit; 1, 2 and 4 KB blobs run
+// the window and SACK bitmap up to FRAG_MAX_COUNT fragments (4 KB + nonce and
+// tag is 27). Blobs have no sender log entry and settle on arrival.
+static void scFrag(uint32_t seed){
+  std::vector<float> losses = quick ? std::vector<float>{0, 20} : std::vector<float>{0, 10, 20, 30};
+  const int SIZES[] = { 480, 1024, 2048, 4096 };
+  int count = quick ? 3 : 6;
+  for (int bytes : SIZES){
+    for (float loss : losses){
+      for (int fec=0;fec<2;fec++){
+        SimConfig c = baseCfg;
+        c.lossPct = loss;
+        if (!start(seed, c)) return;
+        Rec r("frag", seed);
+        addNode(0, 0, true);
+        addNode(300, 0, true);
+        bootAll();
+        pairNodes(0, 1);
+        simCommand(0, "fec %d", fec);
+        simCommand(1, "fec %d", fec);
+        simRunFor(100);
+        markStart();
+        std::vector<Flow> flows;
+        addFlow(flows, 0, 1, count);
+        runFlows(flows, bytes, 2000, count * 120000, 120000);
+        r.num("loss_pct", loss);
+        r.num("fec", fec);
+        r.num("msg_bytes", bytes);
+        msgFields(r);
+        r.num("frag_frames", T.byType[TYPE_FRAG]);
+        r.num("frag_per_msg", T.msgs.empty() ? 0 : (double)T.byType[TYPE_FRAG] / T.msgs.size());
+        r.num("sack_frames", T.byType[TYPE_FRAG_ACK]);
+        r.emit();
+        char pt[48]; snprintf(pt, sizeof(pt), "%dB loss=%.0f%% fec=%d", bytes, loss, fec);
+        summary("frag", pt);
+        simShutdown();
+      }
+    }
+  }
+}
+
+// Jain's index over per-sender goodput: 1 = equal shares.
+static double jain(const std::vector<double>& x){
+  double s = 0, q = 0;
+  for (double v : x){ s += v; q += v * v; }
+  return q > 0 ? s * s / (x.size() * q) : 0;
+}
+
+// Senders 1..n all to node 0, back to back for `forMs`; tdma toggles slotting.
+static void manyToOne(const char* name, int n, uint32_t seed, int tdma, const SimConfig& c, uint32_t forMs){
+  if (!start(seed, c)) return;
+  Rec r(name, seed);
+  addCluster(n + 1, 150, true);
+  bootAll();
+  for (int i=1;i<=n;i++) pairNodes(i, 0);
+  if (tdma >= 0) for (int i=0;i<=n;i++) simCommand(i, "tdma %d", tdma);
+  simRunFor(tdma > 0 ? 15000 : 100);        // slotted mode needs the beacon first
+  markStart();
+  std::vector<Flow> flows;
+  for (int i=1;i<=n;i++) addFlow(flows, i, 0, 1 << 30);
+  runFlows(flows, 40, 0, forMs, 30000);
+  std::vector<double> share(n, 0);
+  for (const Msg& m : T.msgs) if (m.rxUs[0]) share[m.from - 1] += m.bytes;
+  r.num("senders", n);
+  if (tdma >= 0) r.num("tdma", tdma);
+  msgFields(r);
+  r.num("jain", jain(share));
+  r.emit();
+  char pt[32]; snprintf(pt, sizeof(pt), "senders=%d%s", n, tdma > 0 ? " tdma" : "");
+  summary(name, pt);
+  simShutdown();
+}
+
+// aimd: the congestion window against a growing number of senders.
+static void scAimd(uint32_t seed){
+  std::vector<int> sizes = quick ? std::vector<int>{2, 4} : std::vector<int>{2, 4, 8};
+  for (int n : sizes) manyToOne("aimd", n, seed, -1, baseCfg, quick ? 60000 : 120000);
+}
+
+// tdma: the same load slotted and unslotted.
+static void scTdma(uint32_t seed){
+  for (int on=0;on<2;on++) manyToOne("tdma", 8, seed, on, baseCfg, quick ? 60000 : 120000);
+}
+
+// channels: 8 busy pairs; all but k of the pair channels jammed before boot,
+// so the boot survey leaves k to hop over. Both sides stay in the chat.
+static void scChannels(uint32_t seed){
+  std::vector<int> ks = quick ? std::vector<int>{1, 8} : std::vector<int>{1, 2, 4, 8};
+  for (int k : ks){
+    if (!start(seed, baseCfg)) return;
+    Rec r("channels", seed);
+    for (int ch=k;ch<CHAN_COUNT;ch++) simSetJammer(CHAN_BASE_HZ + ch * CHAN_STEP_HZ, -60);
+    addCluster(16, 150, true);
+    bootAll();
+    for (int i=0;i<8;i++) pairNodes(2*i, 2*i + 1);
+    simRunFor(100);
+    for (int i=0;i<8;i++){ simCommand(2*i, "open %u", T.self[2*i + 1]); simCommand(2*i + 1, "open %u", T.self[2*i]); }
+    simRunFor(2000);
+    markStart();
+    std::vector<Flow> flows;
+    for (int i=0;i<8;i++) addFlow(flows, 2*i, 2*i + 1, 1 << 30);
+    runFlows(flows, 40, 0, quick ? 60000 : 120000, 30000);
+    r.num("channels", k);
+    r.num("pairs", 8);
+    msgFields(r);
+    r.emit();
+    char pt[32]; snprintf(pt, sizeof(pt), "channels=%d", k);
+    summary("channels", pt);
+    simShutdown();
+  }
+}
+
+// mesh: end-to-end chat over relays on a line or a grid spaced so only
+// neighbours hear each other, ends up to three hops apart (the hop limit).
+// Airtime amplification = air per delivered message / one DATA frame's air.
+static void scMesh(uint32_t seed){
+  struct Shape { const char* name; int w, h, far; };   // far: node paired with node 0
+  std::vector<Shape> shapes = quick ? std::vector<Shape>{{"line3", 3, 1, 2}, {"grid3x3", 3, 3, 5}}
+                                    : std::vector<Shape>{{"line3", 3, 1, 2}, {"line4", 4, 1, 3}, {"grid3x3", 3, 3, 5}};
+  int count = quick ? 5 : 10;
+  for (const Shape& s : shapes){
+    if (!start(seed, baseCfg)) return;
+    Rec r("mesh", seed);
+    float d = marginDistance(baseCfg, 4);
+    for (int y=0;y<s.h;y++) for (int x=0;x<s.w;x++) addNode(x * d, y * d, true);
+    int last = s.w * s.h - 1;
+    bootAll();
+    pairNodes(0, s.far);
+    for (int i=0;i<=last;i++) simCommand(i, "relay 1");
+    simRunFor(100);
+    markStart();
+    std::vector<Flow> flows;
+    addFlow(flows, 0, s.far, count);
+    runFlows(flows, 40, 2000, count * 30000, 30000);
+    r.str("shape", s.name);
+    r.num("nodes", last + 1);
+    r.num("hops", s.far % s.w + s.far / s.w);
+    r.num("spacing_m", round(d));
+    msgFields(r);
+    int got = 0, acked = 0;
+    for (const Msg& m : T.msgs){ got += m.rxUs[0] != 0; acked += m.ackUs != 0; }
+    double frameUs = T.byType[TYPE_DATA] ? (double)T.airByType[TYPE_DATA] / T.byType[TYPE_DATA] : 0;
+    r.num("relayed", T.relayed);
+    r.num("air_amp", got && frameUs ? T.airUs / (got * frameUs) : -1);
+    r.emit();
+    summary("mesh", s.name);
+    if (!strcmp(s.name, "line3")) expect(acked > 0, "mesh line3", "no relayed ACK reached the sender");
+    simShutdown();
+  }
+}
+
+// outbox: the peer walks out of range, messages wait in flash, the sender
+// reboots, the peer comes back and is heard: how much arrives, how fast.
+static void scOutbox(uint32_t seed){
+  int count = quick ? 3 : 5;
+  if (!start(seed, baseCfg)) return;
+  Rec r("outbox", seed);
+  addNode(0, 0, true);
+  addNode(300, 0, true);
+  bootAll();
+  pairNodes(0, 1);
+  simRunFor(100);
+  simSetPosition(1, 1e6f, 0);
+  SimFlashStats f0 = simNodeFlash(0);
+  markStart();
+  std::vector<Flow> flows;
+  addFlow(flows, 0, 1, count);
+  runFlows(flows, 40, 500, count * 60000, 60000);
+  SimFlashStats f1 = simNodeFlash(0);
+  int queued = 0;
+  for (const Msg& m : T.msgs) queued += m.status == ST_OUTBOX;
+  simReboot(0);
+  simRunFor(3000);
+  simSetPosition(1, 300, 0);
+  uint64_t back = simNowUs();
+  simCommand(1, "ping %u", T.self[0]);
+  uint64_t end = simNowUs() + 120000000ull;
+  int got = 0;
+  uint64_t lastRx = back;
+  while (simNowUs() < end){
+    simRunFor(100);
+    got = 0;
+    for (const Msg& m : T.msgs) if (m.rxUs[0]){ got++; lastRx = std::max(lastRx, m.rxUs[0]); }
+    if (got == count) break;
+  }
+  r.num("msgs", count);
+  r.num("outboxed", queued);
+  r.num("pdr", (double)got / count);
+  r.num("flush_s", got ? (lastRx - back) / 1e6 : -1);
+  r.num("flash_writes_per_msg", (double)(f1.writes - f0.writes) / count);
+  r.num("flash_bytes_per_msg", (double)(f1.bytes - f0.bytes) / count);
+  r.num("frames", T.frames);
+  r.num("air_ms", T.airUs / 1e3);
+  r.emit();
+  fprintf(stderr, "%-11s %-22s outboxed %d/%d  after reboot %d  flush %.1f s  flash %.1f writes/msg\n",
+          "outbox", "", queued, count, got, got ? (lastRx - back) / 1e6 : -1.0, (double)(f1.writes - f0.writes) / count);
+  simShutdown();
+}
+
+// sync: d messages exchanged, the initiating side (lower short) reboots with
+// an empty log, the peer writes once: bytes and time until its log is whole again.
+static bool logHas(void* c){ int* w = (int*)c; return simInfo(0).chats >= *w; }
+
+static void scSync(uint32_t seed){
+  std::vector<int> ds = quick ? std::vector<int>{4, 16} : std::vector<int>{0, 4, 16, 32};
+  for (int d : ds){
+    if (!start(seed, baseCfg)) return;
+    Rec r("sync", seed);
+    addNode(0, 0, true);
+    addNode(300, 0, true);
+    bootAll();
+    pairNodes(0, 1);
+    simRunFor(100);
+    std::vector<Flow> flows;
+    for (int i=0;i<d;i++){
+      flows.clear();
+      addFlow(flows, i & 1, (i & 1) ^ 1, 1);
+      runFlows(flows, 20, 0, 60000, 30000);
+    }
+    simReboot(0);
+    simRunFor(3000);
+    markStart();
+    // The peer writes: the first frame heard from it since boot starts the sync
+    flows.clear();
+    addFlow(flows, 1, 0, 1);
+    flows[0].nextUs = simNowUs();
+    runFlows(flows, 20, 0, 60000, 30000);
+    int want = d + 1;
+    bool whole = simRunUntil(logHas, &want, 60000, 50);
+    uint64_t took = simNowUs() - T.t0;
+    if (whole) T.t0 = simNowUs();
+    simRunFor(2000);
+    r.num("divergence", d);
+    r.num("recovered", simInfo(0).chats);
+    r.num("sync_s", whole ? took / 1e6 : -1);
+    r.num("sync_bytes", T.bytes);
+    r.num("sync_frames", T.frames);
+    r.num("air_ms", T.airUs / 1e3);
+    r.emit();
+    fprintf(stderr, "%-11s d=%-20d recovered %d  %.2f s  %llu B on air in %u frames\n",
+            "sync", d, simInfo(0).chats, whole ? took / 1e6 : -1.0, (unsigned long long)T.bytes, T.frames);
+    simShutdown();
+  }
+}
+
+struct Scenario { const char* name; void (*run)(uint32_t seed); };
+static const Scenario SCENARIOS[] = {
+  { "discovery",  scDiscovery },
+  { "chat",       scChat },
+  { "fanout",     scFanout },
+  { "lossy_link", scLossy },
+  { "rtt",        scRtt },
+  { "frag",       scFrag },
+  { "aimd",       scAimd },
+  { "tdma",       scTdma },
+  { "channels",   scChannels },
+  { "mesh",       scMesh },
+  { "outbox",     scOutbox },
+  { "sync",       scSync },
+};
+static const int SCENARIO_COUNT = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+static void usage(const char* self){
+  fprintf(stderr, "usage: %s [-s seed] [-r runs] [-o out.jsonl] [-l node.so] [--quick] [-v] [scenario...]\nscenarios:", self);
+  for (int i=0;i<SCENARIO_COUNT;i++) fprintf(stderr, " %s", SCENARIOS[i].name);
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv){
+  baseCfg = simDefaults();
+  uint32_t seed = 1;
+  int runs = 1;
+  std::vector<const Scenario*> pick;
+  for (int i=1;i<argc;i++){
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) runs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-l") && i + 1 < argc) baseCfg.nodeLib = argv[++i];
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc){
+      out = fopen(argv[++i], "w");
+      if (!out){ perror(argv[i]); return 1; }
+    }
+    else if (!strcmp(argv[i], "--quick")) quick = true;
+    else if (!strcmp(argv[i], "-v")) baseCfg.log = true;
+    else {
+      const Scenario* s = nullptr;
+      for (int k=0;k<SCENARIO_COUNT;k++) if (!strcmp(argv[i], SCENARIOS[k].name)) s = &SCENARIOS[k];
+      if (!s){ usage(argv[0]); return 2; }
+      pick.push_back(s);
+    }
+  }
+  if (pick.empty()) for (int k=0;k<SCENARIO_COUNT;k++) pick.push_back(&SCENARIOS[k]);
+
+  for (int run=0;run<runs;run++)
+    for (const Scenario* s : pick) s->run(seed + run);
+  if (out != stdout) fclose(out);
+  return failed;
+}
@@ -0,0 +1,464 @@
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include "hal/hal.h"
+#include "node_api.h"
+#include "sx127x_fake.h"
+#include "../fec.h"
+#include "../addr.h"
+#include "../frag.h"
+#include "../metrics.h"
+#include "../peer.h"
+#include "../protocol.h"
+#include "../radio.h"
+#include "../storage.h"
+
+void   setup();                                                              // LoRaMessenger.ino
+size_t mbDataFrame(uint8_t from, uint16_t seq, const char* text, uint8_t* out);   // microbench_fw.cpp
+void   mbReseal(uint8_t* frame);                                             //   (a fresh crc8)
+bool   mbTxFrame(const uint8_t* buf, uint8_t len, bool implicitHeader);
+void   mbTxWaitIdle();
+
+// ----- Host checks of firmware properties the simulator can't show -----
+// checks [-v] [filter...]
+// Each check runs against one firmware copy (linked like microbench) and
+// prints ok/FAIL with a one-line reason; the exit status is the number of
+// failed checks, so the program can gate a build.
+
+static bool verbose = false;
+
+// ----- Allocation counter -----
+static uint64_t allocs = 0;
+
+void* operator new(size_t n){
+  allocs++;
+  if (void* p = malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t n){ return operator new(n); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// ----- Firmware host: a clock that only moves when the firmware waits -----
+// A transmission ends as soon as the firmware waits for it, unless txHangs.
+static SxFakeChip chip;
+static uint64_t clockUs = 0;
+static bool     txHangs = false;
+static void hostSleep(uint64_t us){
+  clockUs += us;
+  if (chip.txOnAir && !txHangs) sxFakeFinishTx(chip);
+}
+static void hostIdle(){}
+static void hostLog(uint32_t, const char*){}
+static int  hostNvsGet(uint32_t, const char*, const char*, void*, uint32_t){ return -1; }
+static void hostNvsPut(uint32_t, const char*, const char*, const void*, uint32_t){}
+static void hostNvsErase(uint32_t, const char*, const char*){}
+static void hostChat(uint32_t, const SimChatInfo*, int){}
+static const SimHostApi hostApi = { &clockUs, hostSleep, hostIdle, hostLog, hostNvsGet, hostNvsPut, hostNvsErase, hostChat };
+
+static char why[160];
+
+static bool fail(const char* fmt, ...){
+  va_list ap; va_start(ap, fmt);
+  vsnprintf(why, sizeof(why), fmt, ap);
+  va_end(ap);
+  return false;
+}
+
+// ----- FEC round trip -----
+// Every erasure count up to FEC_MAX_REPAIR (one fragment at least kept), at
+// message sizes from 2 fragments to the largest, with the holes and the repair
+// symbols used in varying places. fecRecover() leaves garbage in the repair buffers it used (scratch),
+// so a caller must drop them, as fragOnFrame() does: a second decode from the
+// same buffers has to come out wrong.
+static const uint8_t FEC_K_MAX = (FRAG_MSG_MAX + FRAG_DATA_MAX - 1) / FRAG_DATA_MAX;
+
+static bool checkFecRoundTrip(){
+  static uint8_t data[FEC_K_MAX * FRAG_DATA_MAX], orig[sizeof(data)];
+  static uint8_t repair[FEC_MAX_REPAIR * FRAG_DATA_MAX];
+  uint32_t rng = 12345;
+  int runs = 0;
+  for (uint8_t k=2;k<=FEC_K_MAX;k++){
+    size_t n = (size_t)k * FRAG_DATA_MAX;
+    for (uint8_t lost=1;lost<=FEC_MAX_REPAIR && lost<k;lost++){
+      for (size_t b=0;b<n;b++){ rng = rng * 1103515245 + 12345; orig[b] = (uint8_t)(rng >> 16); }
+      memcpy(data, orig, n);
+      // `lost` repair symbols out of FEC_MAX_REPAIR, starting at a varying one
+      uint16_t repHave = 0;
+      for (uint8_t i=0;i<lost;i++){
+        uint8_t r = (uint8_t)((k + i) % FEC_MAX_REPAIR);
+        repHave |= (uint16_t)(1u << r);
+        fecRepair(data, k, FRAG_DATA_MAX, r, repair + (size_t)r*FRAG_DATA_MAX);
+      }
+      uint32_t have = k >= 32 ? 0xFFFFFFFFu : (1u << k) - 1;
+      for (uint8_t i=0;i<lost;i++){
+        uint8_t j = (uint8_t)((i * k / lost + runs) % k);
+        while (!(have & (1u << j))) j = (uint8_t)((j + 1) % k);
+        have &= ~(1u << j);
+        memset(data + (size_t)j*FRAG_DATA_MAX, 0xEE, FRAG_DATA_MAX);
+      }
+      if (!fecRecover(data, k, FRAG_DATA_MAX, have, repair, repHave))
+        return fail("k=%u lost=%u: not recovered", k, lost);
+      if (memcmp(data, orig, n)) return fail("k=%u lost=%u: wrong data", k, lost);
+
+      // the same repair buffers again, same holes: must not rebuild the data
+      for (uint8_t j=0;j<k;j++) if (!(have & (1u << j))) memset(data + (size_t)j*FRAG_DATA_MAX, 0xEE, FRAG_DATA_MAX);
+      fecRecover(data, k, FRAG_DATA_MAX, have, repair, repHave);
+      if (!memcmp(data, orig, n)) return fail("k=%u lost=%u: repair buffers still valid after decode", k, lost);
+      runs++;
+    }
+  }
+  if (verbose) printf("  %d decodes\n", runs);
+  return true;
+}
+
+// ----- Peer table -----
+// RAM against the 256-entry side arrays protocol.cpp kept per sender ID before
+// peer.h (replay window, two invite codes, hops, channel, last heard), then
+// random churn through far more IDs than PEER_MAX: the count stays capped, a
+// touched ID is always findable, and contacts (heard longest ago of all) keep
+// their replay windows however many strangers pass.
+struct OldReplayWindow { bool init; uint16_t top; uint64_t bits; };
+static const size_t PEER_ARRAYS_BYTES = 256 * (sizeof(OldReplayWindow) + 2 * sizeof(uint32_t) + 2 * sizeof(uint8_t) + sizeof(uint32_t));
+
+static bool checkPeerTable(){
+  size_t tableBytes = PEER_SLOTS * sizeof(PeerState);
+  if (verbose) printf("  table %zu B (record %zu B), old arrays %zu B, saved %zu B\n",
+                      tableBytes, sizeof(PeerState), PEER_ARRAYS_BYTES, PEER_ARRAYS_BYTES - tableBytes);
+  if (tableBytes >= PEER_ARRAYS_BYTES) return fail("table %zu B, no smaller than the arrays (%zu B)", tableBytes, PEER_ARRAYS_BYTES);
+
+  storageClearContacts();
+  const uint8_t CONTACTS = 10;
+  for (uint8_t c=0;c<CONTACTS;c++){
+    Contact k{};
+    k.id = (uint8_t)(200 + c);
+    if (!storageAddContact(k)) return fail("contact %u not added", k.id);
+    PeerState* p = peerTouch(k.id);
+    p->replayInit = true; p->replayTop = (uint16_t)(1000 + c); p->replayBits = 1;
+    p->lastHeardMs = 1;                              // the oldest in the table
+  }
+  uint32_t rng = 777, now = 2;
+  for (int n=0;n<20000;n++){
+    rng = rng * 1103515245 + 12345;
+    uint8_t id = (uint8_t)(1 + (rng >> 16) % 199);
+    PeerState* p = peerTouch(id);
+    if (!p || p->id != id) return fail("touch %u lost it", id);
+    p->lastHeardMs = now++;
+    if (peerCount() > PEER_MAX) return fail("count %d over PEER_MAX", peerCount());
+    if (!peerFind(id)) return fail("%u not findable after touch", id);
+  }
+  for (uint8_t c=0;c<CONTACTS;c++){
+    const PeerState* p = peerFind((uint8_t)(200 + c));
+    if (!p) return fail("contact %u evicted", 200 + c);
+    if (!p->replayInit || p->replayTop != 1000 + c) return fail("contact %u lost its replay window", 200 + c);
+  }
+  storageClearContacts();
+  return true;
+}
+
+// ----- Short address collisions -----
+// Full IDs folded from eFuse MACs as a factory burns them (one OUI, serials
+// counting up, here in runs of 1000 from random batches): no two alike among
+// thousands. Then neighbourhoods of such nodes boot on their derived
+// primaries and apply the clash rule (addr.h) until no two share a short: the
+// lower full ID moves, avoiding its own shorts and every short it hears.
+static const uint64_t MAC_OUI = 0xC40A24ull;   // 24:0A:C4, low bytes first as getEfuseMac() has it
+
+static uint64_t batchMac(uint32_t& rng, int i){
+  if (i % 1000 == 0) rng = rng * 1103515245 + 12345;
+  uint32_t serial = ((rng >> 8) & 0xFFFC00u) + (uint32_t)(i % 1000);
+  return MAC_OUI | (uint64_t)(serial & 0xFFFFFFu) << 24;
+}
+
+static bool checkAddrCollisions(){
+  const int IDS = 20000;
+  static uint32_t ids[IDS];
+  uint32_t rng = 4242;
+  for (int i=0;i<IDS;i++) ids[i] = addrFoldMac(batchMac(rng, i));
+  static uint32_t sorted[IDS];
+  memcpy(sorted, ids, sizeof(ids));
+  qsort(sorted, IDS, sizeof(uint32_t), [](const void* a, const void* b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b; return x < y ? -1 : x > y; });
+  for (int i=1;i<IDS;i++) if (sorted[i] == sorted[i-1]) return fail("full ID %08x twice among %d MACs", sorted[i], IDS);
+
+  static const int SIZES[] = { 10, 50, 120 };
+  const int TRIALS = 2000;
+  for (int n : SIZES){
+    long bootClashes = 0, moves = 0;
+    int worstRounds = 0;
+    for (int t=0;t<TRIALS;t++){
+      uint32_t node[120]; uint8_t primary[120];
+      for (int i=0;i<n;i++){
+        rng = rng * 1103515245 + 12345;
+        node[i] = ids[(rng >> 8) % IDS];
+        uint8_t none[ADDR_SET_BYTES] = {0};
+        primary[i] = addrPick(node[i], none, nullptr, 0);
+      }
+      for (int i=0;i<n;i++) for (int j=i+1;j<n;j++) bootClashes += primary[i] == primary[j] && node[i] != node[j];
+      int round = 0;
+      for (bool clash=true; clash; round++){
+        if (round > 8) return fail("n=%d trial %d: clashes left after %d rounds", n, t, round);
+        clash = false;
+        for (int i=0;i<n;i++){
+          bool lower = false;
+          for (int j=0;j<n;j++) lower |= j != i && primary[j] == primary[i] && node[j] > node[i];
+          if (!lower) continue;
+          uint8_t own[ADDR_SET_BYTES] = {0}, heard[ADDR_SET_BYTES] = {0};
+          addrAddSet(own, primary[i]);
+          for (int j=0;j<n;j++) if (j != i) addrAddSet(heard, primary[j]);
+          primary[i] = addrPick(node[i], own, heard, 0);
+          moves++;
+          clash = true;
+        }
+      }
+      worstRounds = max(worstRounds, round - 1);
+    }
+    if (verbose) printf("  n=%-3d %.3f clashing pairs at boot, %.3f moves, <= %d rounds\n",
+                        n, (double)bootClashes / TRIALS, (double)moves / TRIALS, worstRounds);
+  }
+  if (verbose) printf("  %d full IDs distinct\n", IDS);
+  return true;
+}
+
+// ----- RX path without the heap -----
+// The firmware booted on a fake radio, one contact, and a stream of DATA
+// frames from it: after a warm-up (chat ring, peer entry, first String
+// temporaries) reading, checking, decrypting, storing and ACKing a message
+// must not call operator new, in any form.
+static bool checkRxNoHeap(){
+  sxFakeReset(chip);
+  sxFakeSelect(&chip);
+  setup();
+  storageClearContacts();
+  Contact k{};
+  k.id = 0x31; k.self = addrSelf();
+  strcpy(k.name, "rx");
+  for (int i=0;i<32;i++) k.key[i] = (uint8_t)(i * 7 + 1);
+  if (!storageAddContact(k)) return fail("contact not added");
+
+  static const char* TEXTS[] = { "ok", "see you at the hut at six", "battery 40%, heading down now" };
+  const int WARM = 40, FRAMES = 200;
+  uint8_t frame[256];
+  uint16_t seq = 1;
+  uint64_t before = 0;
+  for (int n=0;n<WARM+FRAMES;n++,seq++){
+    if (n == WARM) before = allocs;
+    size_t len = mbDataFrame(k.id, seq, TEXTS[n % 3], frame);
+    protocolPoll();                                  // back in RX after the last ACK
+    clockUs += 50000;
+    if (!sxFakeDeliver(chip, frame, (uint8_t)len, false, -60, 40, 0)) return fail("frame %d not taken by the radio", n);
+    protocolPoll();
+    ChatMsg m;
+    protocolGetChat(protocolChatCount() - 1, m);
+    if (protocolChatCount() == 0 || m.seq != seq || strcmp(m.text, TEXTS[n % 3]))
+      return fail("frame %d (seq %u) not in the chat", n, seq);
+  }
+  uint64_t used = allocs - before;
+  if (verbose) printf("  %d frames, %llu allocations\n", FRAMES, (unsigned long long)used);
+  storageClearContacts();
+  if (used) return fail("%llu allocations over %d received messages", (unsigned long long)used, FRAMES);
+  return true;
+}
+
+// Each way a frame can fail its checks ends in its own counter: the PHY CRC in
+// rx.phy_crc (the radio never hands it over), a short frame or a crc8 mismatch
+// in rx.malformed, a sealed body with a bad tag in rx.bad_mac.
+static bool checkRxVerdicts(){
+  sxFakeReset(chip);
+  sxFakeSelect(&chip);
+  setup();
+  storageClearContacts();
+  Contact k{};
+  k.id = 0x31; k.self = addrSelf();
+  strcpy(k.name, "rx");
+  for (int i=0;i<32;i++) k.key[i] = (uint8_t)(i * 7 + 1);
+  if (!storageAddContact(k)) return fail("contact not added");
+  metricsReset();
+
+  uint8_t frame[256];
+  size_t len = mbDataFrame(k.id, 1, "ok", frame);
+  struct Case { const char* what; int at; bool phyOk; uint8_t len; MetricCounter want; };
+  const Case CASES[] = {
+    { "PHY CRC error",   -1, false, (uint8_t)len,       MC_RX_PHY_CRC },
+    { "short frame",     -1, true,  (uint8_t)(len - 1), MC_RX_MALFORMED },
+    { "crc8 mismatch",   (int)len - 1, true, (uint8_t)len, MC_RX_MALFORMED },
+    { "bad tag",         12, true,  (uint8_t)len,       MC_RX_BAD_MAC },
+  };
+  uint16_t seq = 1;
+  for (const Case& c : CASES){
+    len = mbDataFrame(k.id, seq++, "ok", frame);
+    if (c.at >= 0) frame[c.at] ^= 0x40;
+    if (c.want == MC_RX_BAD_MAC) mbReseal(frame);      // a well-formed frame, a forged body
+    uint32_t before = metricCounters[c.want];
+    protocolPoll();
+    clockUs += 50000;
+    if (!sxFakeDeliver(chip, frame, c.len, false, -60, 40, 0, c.phyOk)) return fail("%s: not taken by the radio", c.what);
+    protocolPoll();
+    if (metricCounters[c.want] != before + 1)
+      return fail("%s: %s %lu -> %lu", c.what, metricCounterName(c.want), (unsigned long)before, (unsigned long)metricCounters[c.want]);
+  }
+  storageClearContacts();
+  return true;
+}
+
+// ----- SX127x driver (radio.cpp) against the register-level fake -----
+static const long RADIO_F1 = 868100000, RADIO_F2 = 868500000;
+
+static void radioFresh(){
+  sxFakeReset(chip);
+  sxFakeSelect(&chip);
+  RadioPins pins = { -1, -1, -1, -1, -1, -1 };
+  RadioConfig cfg = { RADIO_F1, 7, 125000, 5, 8, 0x12, 14, true };
+  radioBegin(pins, cfg);
+}
+
+static bool inRx(bool implicitHeader, long hz){
+  return sxFakeMode(chip) == SX_MODE_RX_CONT && sxFakeImplicit(chip) == implicitHeader &&
+         labs(sxFakeFreqHz(chip) - hz) < 100;
+}
+
+// One frame out, TX_DONE, and straight back to RX where a frame is taken
+static bool checkRadioTxRx(){
+  radioFresh();
+  if (!inRx(false, RADIO_F1)) return fail("not in RX after radioBegin");
+  RadioStats s0 = radioStats();
+  const uint8_t out[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  if (!radioSend(out, sizeof(out), false)) return fail("radioSend refused");
+  if (!chip.txOnAir || sxFakeMode(chip) != SX_MODE_TX) return fail("not transmitting");
+  if (chip.txLen != sizeof(out) || memcmp(chip.tx, out, sizeof(out))) return fail("FIFO doesn't hold the frame");
+  if (!radioTxBusy()) return fail("idle while on air");
+  if (radioSend(out, sizeof(out), false)) return fail("second radioSend taken while on air");
+  sxFakeFinishTx(chip);
+  if (radioTxBusy()) return fail("busy after TX_DONE");
+  if (!inRx(false, RADIO_F1)) return fail("not back in RX after TX_DONE");
+  if (radioStats().txDone != s0.txDone + 1) return fail("txDone not counted");
+  if (!sxFakeDeliver(chip, out, sizeof(out), false, -70, 20, 0)) return fail("frame not taken after TX");
+  uint8_t in[8] = {0};
+  if (radioAvailable() != sizeof(out)) return fail("radioAvailable %u, want %u", radioAvailable(), (unsigned)sizeof(out));
+  radioRead(in, sizeof(in));
+  if (memcmp(in, out, sizeof(out)) || radioAvailable()) return fail("frame read back wrong");
+  return true;
+}
+
+// A retune and a header-mode switch asked for on air wait for TX_DONE
+static bool checkRadioDeferred(){
+  radioFresh();
+  const uint8_t out[] = { 9, 8, 7, 6, 5, 4 };
+  if (!radioSend(out, sizeof(out), false)) return fail("radioSend refused");
+  radioSetFrequency(RADIO_F2);
+  radioListen(sizeof(out));
+  if (!chip.txOnAir || labs(sxFakeFreqHz(chip) - RADIO_F1) >= 100 || sxFakeImplicit(chip))
+    return fail("frequency or header mode changed under the frame");
+  if (labs(chip.txFreqHz - RADIO_F1) >= 100) return fail("frame went out on %ld Hz", chip.txFreqHz);
+  sxFakeFinishTx(chip);
+  radioService();
+  if (!inRx(true, RADIO_F2)) return fail("retune and implicit header not applied at TX_DONE");
+  if (chip.regs[SX_REG_PAYLOAD_LENGTH] != sizeof(out)) return fail("implicit length %u", chip.regs[SX_REG_PAYLOAD_LENGTH]);
+  if (!sxFakeDeliver(chip, out, sizeof(out), true, -70, 20, 0) || radioAvailable() != sizeof(out))
+    return fail("implicit-header frame not received");
+  radioDiscard();
+  radioListen(0);
+  if (!inRx(false, RADIO_F2)) return fail("explicit header not restored");
+  return true;
+}
+
+// DIO0 missed: a raised TX_DONE is still seen (TX polls), and one that never
+// comes is given up by the protocol's wait, back to RX
+static bool checkRadioTxTimeout(){
+  radioFresh();
+  const uint8_t out[] = { 1, 1, 2, 3, 5, 8 };
+  if (!radioSend(out, sizeof(out), false)) return fail("radioSend refused");
+  void (*isr)() = chip.dio0Isr;
+  chip.dio0Isr = nullptr;                          // the edge is lost
+  sxFakeFinishTx(chip);
+  chip.dio0Isr = isr;
+  if (radioTxBusy() || !inRx(false, RADIO_F1)) return fail("TX_DONE without DIO0 not picked up");
+
+  RadioStats s0 = radioStats();
+  txHangs = true;
+  uint64_t t0 = clockUs;
+  bool sent = mbTxFrame(out, sizeof(out), false);
+  mbTxWaitIdle();
+  txHangs = false;
+  if (!sent) return fail("txFrame refused");
+  if (chip.txOnAir) sxFakeFinishTx(chip);          // the fake's TX state; the driver already left
+  if (radioStats().txAborted != s0.txAborted + 1) return fail("TX not aborted");
+  if (radioTxBusy() || !inRx(false, RADIO_F1)) return fail("not back in RX after the abort");
+  if (verbose) printf("  gave up after %llu ms\n", (unsigned long long)((clockUs - t0) / 1000));
+  if (!sxFakeDeliver(chip, out, sizeof(out), false, -70, 20, 0) || radioAvailable() != sizeof(out))
+    return fail("no frame received after the abort");
+  radioDiscard();
+  return true;
+}
+
+// Packet SNR (signed, 0.25 dB), RSSI and the 20-bit signed FEI as radio.cpp decodes them
+static bool checkRadioRxInfo(){
+  radioFresh();
+  struct Case { int rssi; int8_t snrQ4; int32_t fei; int32_t wantHz; };
+  // freqErr = fei * 2^24 / 32 MHz * 125 kHz / 500 kHz = fei * 0.131072 Hz
+  const Case CASES[] = {
+    { -60,   40,      0,       0 },
+    { -118, -30,     100,     13 },
+    { -95,  -80,    -100,    -13 },
+    { -40,  127,  100000,  13107 },
+    { -120, -128, -0x80000, -68719 },
+  };
+  const uint8_t f[] = { 0xAA, 0x55 };
+  for (const Case& c : CASES){
+    if (!sxFakeDeliver(chip, f, sizeof(f), false, c.rssi, c.snrQ4, c.fei)) return fail("frame not taken");
+    radioAvailable();
+    RadioRxInfo in = radioLastRx();
+    radioDiscard();
+    if (in.rssi != c.rssi || in.snrQ4 != c.snrQ4 || in.freqErrHz != c.wantHz)
+      return fail("rssi %d snr %d fei %ld: read %d, %d, %ld Hz (want %ld)", c.rssi, c.snrQ4, (long)c.fei,
+                  in.rssi, in.snrQ4, (long)in.freqErrHz, (long)c.wantHz);
+  }
+  return true;
+}
+
+// ----- Table -----
+struct Check {
+  const char* name;
+  bool (*run)();
+};
+
+static const Check CHECKS[] = {
+  { "fec/round_trip", checkFecRoundTrip },
+  { "peer/table",     checkPeerTable },
+  { "addr/collisions", checkAddrCollisions },
+  { "rx/no_heap",     checkRxNoHeap },
+  { "rx/verdicts",    checkRxVerdicts },
+  { "radio/tx_rx",    checkRadioTxRx },
+  { "radio/deferred", checkRadioDeferred },
+  { "radio/tx_timeout", checkRadioTxTimeout },
+  { "radio/rx_info",  checkRadioRxInfo },
+};
+
+static bool selected(const Check& c, int argc, char** argv, int first){
+  if (first >= argc) return true;
+  for (int i=first;i<argc;i++) if (strstr(c.name, argv[i])) return true;
+  return false;
+}
+
+int main(int argc, char** argv){
+  int i = 1;
+  for (;i<argc && argv[i][0] == '-';i++){
+    if (!strcmp(argv[i], "-v")) verbose = true;
+    else { fprintf(stderr, "usage: %s [-v] [filter...]\n", argv[0]); return 2; }
+  }
+  halAttach(&hostApi, 0, 0x0000A1B2C3D4E5F6ull, 1);
+  int failed = 0;
+  for (const Check& c : CHECKS){
+    if (!selected(c, argc, argv, i)) continue;
+    why[0] = 0;
+    bool ok = c.run();
+    printf("%-24s %s%s%s\n", c.name, ok ? "ok" : "FAIL", why[0] ? "  " : "", why);
+    failed += !ok;
+  }
+  return failed;
+}
@@ -0,0 +1,127 @@
+#pragma once
+// ----- Host stand-in for the Arduino/ESP32 core (see host/node.cpp) -----
+// Just the surface the sketch uses. Time and randomness come from the simulator
+// through hal.cpp; pins, interrupts and PWM are no-ops.
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <functional>
+
+// Mixed argument types, like the core's: size_t is 32-bit on the board, 64 here.
+template<class A, class B> auto min(A a, B b) -> decltype(a + b) { return b < a ? b : a; }
+template<class A, class B> auto max(A a, B b) -> decltype(a + b) { return a < b ? b : a; }
+template<class T, class L, class H> auto constrain(T x, L lo, H hi) -> decltype(x + lo + hi) {
+  return x < lo ? lo : (x > hi ? hi : x);
+}
+typedef uint8_t byte;
+
+#define PROGMEM
+#define IRAM_ATTR
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+#define RISING  1
+#define Vext      21
+#define SDA_OLED   4
+#define SCL_OLED  15
+#define RST_OLED  16
+
+uint32_t millis();
+uint32_t micros();
+void     delay(uint32_t ms);            // yields to the simulator
+void     delayMicroseconds(uint32_t us);
+void     yield();
+uint32_t esp_random();
+long     random(long hi);
+long     random(long lo, long hi);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int v);
+int  digitalRead(int pin);
+int  digitalPinToInterrupt(int pin);
+void attachInterrupt(int irq, void (*isr)(), int mode);
+inline void noInterrupts(){}
+inline void interrupts(){}
+
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+size_t strlcpy(char* dst, const char* src, size_t n);
+#endif
+
+class String {
+ public:
+  String(){}
+  String(const char* c) : s(c ? c : "") {}
+  String(const std::string& x) : s(x) {}
+  explicit String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+
+  unsigned length() const { return (unsigned)s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  char  operator[](unsigned i) const { return i < s.size() ? s[i] : 0; }
+  char& operator[](unsigned i) { return s[i]; }
+  String substring(unsigned a) const { return a < s.size() ? String(s.substr(a)) : String(); }
+  String substring(unsigned a, unsigned b) const {
+    if (a > b) std::swap(a, b);
+    return a < s.size() ? String(s.substr(a, b - a)) : String();
+  }
+  int  indexOf(char c, unsigned from = 0) const { size_t p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+  void remove(unsigned i) { if (i < s.size()) s.erase(i); }
+  void remove(unsigned i, unsigned n) { if (i < s.size()) s.erase(i, n); }
+  void trim(){
+    size_t a = s.find_first_not_of(" \t\r\n");
+    if (a == std::string::npos) { s.clear(); return; }
+    s = s.substr(a, s.find_last_not_of(" \t\r\n") - a + 1);
+  }
+  long toInt() const { return atol(s.c_str()); }
+  void toCharArray(char* buf, unsigned n) const { if (n) strlcpy(buf, s.c_str(), n); }
+  bool reserve(unsigned n) { s.reserve(n); return true; }
+  String& operator+=(const String& o) { s += o.s; return *this; }
+  String& operator+=(const char* o) { s += o; return *this; }
+  String& operator+=(char c) { s += c; return *this; }
+  bool operator==(const String& o) const { return s == o.s; }
+  bool operator!=(const String& o) const { return s != o.s; }
+  bool operator<(const String& o) const { return s < o.s; }
+  bool operator>(const String& o) const { return s > o.s; }
+
+  std::string s;
+};
+inline String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+inline String operator+(const String& a, const char* b) { return String(a.s + b); }
+inline String operator+(const char* a, const String& b) { return String(std::string(a) + b.s); }
+inline String operator+(const String& a, char b) { return String(a.s + b); }
+
+// Lines go to the simulator's log, tagged with the node.
+class HardwareSerial {
+ public:
+  void   begin(long) {}
+  int    available() { return 0; }
+  int    read() { return -1; }
+  size_t write(const uint8_t* b, size_t n);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t print(const char* t) { return write((const uint8_t*)t, strlen(t)); }
+  size_t print(const String& t) { return print(t.c_str()); }
+  size_t println(const char* t = "") { return print(t) + print("\n"); }
+  size_t println(const String& t) { return println(t.c_str()); }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+ public:
+  uint64_t getEfuseMac();
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getCycleCount();
+};
+extern EspClass ESP;
+
+#include "esp32-hal-ledc.h"   // the ESP32 core pulls this in too
@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Host stand-in for the Heltec SSD1306 driver: draws nothing -----
+// Text is still measured like the real fonts so wrapping and tail fitting do
+// the same work as on the board: Arial advance widths (1/1000 em) scaled to
+// the font's pixel size, and a heap copy of the text per call as the driver's
+// UTF-8 pass makes.
+enum OLEDDISPLAY_GEOMETRY { GEOMETRY_128_64, GEOMETRY_128_32, GEOMETRY_64_32 };
+enum OLEDDISPLAY_TEXT_ALIGNMENT { TEXT_ALIGN_LEFT, TEXT_ALIGN_RIGHT, TEXT_ALIGN_CENTER, TEXT_ALIGN_CENTER_BOTH };
+enum OLEDDISPLAY_COLOR { BLACK, WHITE, INVERSE };
+extern const uint8_t ArialMT_Plain_10[];
+extern const uint8_t ArialMT_Plain_16[];
+extern const uint8_t ArialMT_Plain_24[];
+
+static const uint16_t OLED_ARIAL_ADVANCE[95] = {   // ' ' .. '~'
+  278, 278, 355, 556, 556, 889, 667, 191, 333, 333, 389, 584, 278, 333, 278, 278,
+  556, 556, 556, 556, 556, 556, 556, 556, 556, 556, 278, 278, 584, 584, 584, 556,
+  1015, 667, 667, 722, 722, 667, 611, 778, 722, 278, 500, 667, 556, 833, 722, 778,
+  667, 778, 722, 667, 611, 722, 667, 944, 667, 667, 611, 278, 278, 278, 469, 556,
+  333, 556, 556, 500, 556, 556, 278, 556, 556, 222, 222, 500, 222, 833, 556, 556,
+  556, 556, 333, 500, 278, 556, 500, 722, 500, 500, 500, 334, 260, 334, 584
+};
+
+class TwoWire {
+ public:
+  bool begin(int, int, uint32_t) { return true; }
+};
+extern TwoWire Wire;
+
+class SSD1306Wire {
+ public:
+  SSD1306Wire(uint8_t, uint32_t, int, int, OLEDDISPLAY_GEOMETRY, int) {}
+  bool init() { return true; }
+  void displayOn() {}
+  void displayOff() {}
+  void setContrast(uint8_t) {}
+  void clear() {}
+  void display() {}
+  void setColor(OLEDDISPLAY_COLOR) {}
+  void setFont(const uint8_t* f) { em = f == ArialMT_Plain_24 ? 25 : f == ArialMT_Plain_16 ? 17 : 11; }
+  void setTextAlignment(OLEDDISPLAY_TEXT_ALIGNMENT) {}
+  void drawString(int16_t, int16_t, const String&) {}
+  void drawStringMaxWidth(int16_t, int16_t, uint16_t, const String&) {}
+  void drawRect(int16_t, int16_t, int16_t, int16_t) {}
+  void fillRect(int16_t, int16_t, int16_t, int16_t) {}
+  void drawLine(int16_t, int16_t, int16_t, int16_t) {}
+  void drawHorizontalLine(int16_t, int16_t, int16_t) {}
+  void setPixel(int16_t, int16_t) {}
+  void drawXbm(int16_t, int16_t, int16_t, int16_t, const uint8_t*) {}
+  uint16_t getStringWidth(const String& s) {
+    size_t n = s.length();
+    char* t = new char[n + 1];
+    memcpy(t, s.c_str(), n + 1);
+    uint32_t w = 0;
+    for (size_t i=0;i<n;i++){
+      uint8_t c = (uint8_t)t[i];
+      w += (c >= 32 && c < 127 ? OLED_ARIAL_ADVANCE[c - 32] : 556) * em;
+    }
+    delete[] t;
+    return (uint16_t)((w + 500) / 1000);
+  }
+
+ private:
+  uint16_t em = 11;                    // pixels per em, ArialMT_Plain_10
+};
@@ -0,0 +1,15 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Host stand-in for the Keypad library -----
+// Keys come from the simulator (hostKeyPush in hal.cpp), one per getKey().
+#define makeKeymap(x) ((char*)x)
+#define NO_KEY '\0'
+
+char hostKeyPop();
+
+class Keypad {
+ public:
+  Keypad(char*, byte*, byte*, byte, byte) {}
+  char getKey() { return hostKeyPop(); }
+};
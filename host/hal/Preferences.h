@@ -0,0 +1,38 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Host stand-in for the ESP32 NVS Preferences -----
+// Keys live in the simulator (SimHostApi::nvs*), per node, so they survive a
+// simulated reboot; it also counts the flash writes.
+class Preferences {
+ public:
+  bool   begin(const char* ns, bool readOnly = false);
+  void   end();
+  bool   clear();
+  bool   remove(const char* key);
+  bool   isKey(const char* key);
+
+  size_t putBytes(const char* key, const void* v, size_t n);
+  size_t getBytes(const char* key, void* buf, size_t cap);
+  size_t getBytesLength(const char* key);
+
+  size_t   putString(const char* key, const String& v);
+  String   getString(const char* key, const String& def = String());
+  size_t   putBool(const char* key, bool v)          { return putBytes(key, &v, 1); }
+  bool     getBool(const char* key, bool def = false){ return getNum(key, def); }
+  size_t   putUChar(const char* key, uint8_t v)      { return putBytes(key, &v, 1); }
+  uint8_t  getUChar(const char* key, uint8_t def = 0){ return getNum(key, def); }
+  size_t   putUShort(const char* key, uint16_t v)    { return putBytes(key, &v, 2); }
+  uint16_t getUShort(const char* key, uint16_t def = 0){ return getNum(key, def); }
+  size_t   putUInt(const char* key, uint32_t v)      { return putBytes(key, &v, 4); }
+  uint32_t getUInt(const char* key, uint32_t def = 0){ return getNum(key, def); }
+
+ private:
+  template<class T> T getNum(const char* key, T def){
+    T v;
+    return getBytesLength(key) == sizeof(T) && getBytes(key, &v, sizeof(T)) == sizeof(T) ? v : def;
+  }
+  char ns[16] = {0};
+  bool open = false;
+  bool readOnly = false;
+};
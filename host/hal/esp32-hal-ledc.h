@@ -0,0 +1,9 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Host stand-in: PWM (buzzer, vibration motor) does nothing -----
+inline double   ledcSetup(uint8_t, double freq, uint8_t) { return freq; }
+inline void     ledcAttachPin(uint8_t, uint8_t) {}
+inline void     ledcDetachPin(uint8_t) {}
+inline void     ledcWrite(uint8_t, uint32_t) {}
+inline double   ledcWriteTone(uint8_t, double freq) { return freq; }
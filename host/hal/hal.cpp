@@ -0,0 +1,166 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <Keypad.h>
+#include <HT_SSD1306Wire.h>
+#include <stdarg.h>
+#include <deque>
+#include <vector>
+#include "hal.h"
+
+// ----- Per-node runtime (one copy per dlopen()ed node) -----
+static const SimHostApi* host = nullptr;
+static uint32_t nodeIndex = 0;
+static uint64_t efuseMac  = 0;
+static uint64_t rng       = 1;
+
+void halAttach(const SimHostApi* h, uint32_t index, uint64_t mac, uint32_t seed){
+  host = h;
+  nodeIndex = index;
+  efuseMac = mac;
+  rng = ((uint64_t)seed << 32 | index) * 0x9E3779B97F4A7C15ull | 1;
+}
+
+// ----- Time: the simulator's clock; waiting hands the CPU to other nodes -----
+// Virtual time stands still while a node runs, so a loop that polls the clock
+// without ever sleeping would spin forever: every CLOCK_SPIN reads in a row
+// cost CLOCK_SPIN_US.
+static const uint8_t  CLOCK_SPIN    = 16;
+static const uint32_t CLOCK_SPIN_US = 20;
+static uint8_t clockReads = 0;
+
+static void sleepFor(uint64_t us){ clockReads = 0; host->sleepUs(us); }
+static uint64_t clockNow(){
+  if (++clockReads >= CLOCK_SPIN) sleepFor(CLOCK_SPIN_US);
+  return *host->clockUs;
+}
+
+uint32_t millis(){ return (uint32_t)(clockNow() / 1000); }
+uint32_t micros(){ return (uint32_t)clockNow(); }
+void delay(uint32_t ms){ sleepFor((uint64_t)ms * 1000); }
+void delayMicroseconds(uint32_t us){ sleepFor(us); }
+void yield(){ sleepFor(0); }
+void halIdle(){ clockReads = 0; host->idle(); }
+
+// ----- Randomness: xorshift64*, seeded per node so runs repeat -----
+uint32_t esp_random(){
+  rng ^= rng >> 12; rng ^= rng << 25; rng ^= rng >> 27;
+  return (uint32_t)((rng * 0x2545F4914F6CDD1Dull) >> 32);
+}
+long random(long hi){ return hi > 0 ? (long)(esp_random() % (uint32_t)hi) : 0; }
+long random(long lo, long hi){ return hi > lo ? lo + random(hi - lo) : lo; }
+
+// ----- Pins, interrupts: nothing wired (the radio's DIO0 goes through the fake bus) -----
+void pinMode(int, int){}
+void digitalWrite(int, int){}
+int  digitalRead(int){ return HIGH; }
+int  digitalPinToInterrupt(int pin){ return pin; }
+void attachInterrupt(int, void (*)(), int){}
+
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+size_t strlcpy(char* dst, const char* src, size_t n){
+  size_t len = strlen(src);
+  if (n){ size_t k = len < n - 1 ? len : n - 1; memcpy(dst, src, k); dst[k] = 0; }
+  return len;
+}
+#endif
+
+// ----- Serial: whole lines to the simulator log -----
+HardwareSerial Serial;
+static std::string serialLine;
+
+size_t HardwareSerial::write(const uint8_t* b, size_t n){
+  for (size_t i=0;i<n;i++){
+    if (b[i] != '\n'){ serialLine += (char)b[i]; continue; }
+    host->log(nodeIndex, serialLine.c_str());
+    serialLine.clear();
+  }
+  return n;
+}
+
+// Longer lines than the stack buffer are formatted again on the heap, as the ESP32 core does
+size_t HardwareSerial::printf(const char* fmt, ...){
+  char buf[256];
+  va_list ap; va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n <= 0) return 0;
+  if ((size_t)n < sizeof(buf)) return write((const uint8_t*)buf, (size_t)n);
+  std::vector<char> big((size_t)n + 1);
+  va_start(ap, fmt);
+  vsnprintf(big.data(), big.size(), fmt, ap);
+  va_end(ap);
+  return write((const uint8_t*)big.data(), (size_t)n);
+}
+
+EspClass ESP;
+uint64_t EspClass::getEfuseMac(){ return efuseMac; }
+uint32_t EspClass::getCycleCount(){ return (uint32_t)(*host->clockUs * 240); }   // 240 MHz core
+
+// ----- Display -----
+TwoWire Wire;
+const uint8_t ArialMT_Plain_10[1] = {0};
+const uint8_t ArialMT_Plain_16[1] = {0};
+const uint8_t ArialMT_Plain_24[1] = {0};
+
+// ----- Keypad: keys queued by the simulator, one per getKey() -----
+static std::deque<char> keys;
+void hostKeyPush(char k){ keys.push_back(k); }
+char hostKeyPop(){
+  if (keys.empty()) return NO_KEY;
+  char k = keys.front();
+  keys.pop_front();
+  return k;
+}
+
+// ----- Preferences: on the simulator's side of the boundary -----
+bool Preferences::begin(const char* name, bool ro){
+  strlcpy(ns, name, sizeof(ns));
+  open = true;
+  readOnly = ro;
+  return true;
+}
+void Preferences::end(){ open = false; }
+
+bool Preferences::clear(){
+  if (!open || readOnly) return false;
+  host->nvsErase(nodeIndex, ns, nullptr);
+  return true;
+}
+
+bool Preferences::remove(const char* key){
+  if (!open || readOnly || !isKey(key)) return false;
+  host->nvsErase(nodeIndex, ns, key);
+  return true;
+}
+
+bool Preferences::isKey(const char* key){ return open && host->nvsGet(nodeIndex, ns, key, nullptr, 0) >= 0; }
+
+size_t Preferences::putBytes(const char* key, const void* v, size_t n){
+  if (!open || readOnly) return 0;
+  host->nvsPut(nodeIndex, ns, key, v, (uint32_t)n);
+  return n;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t cap){
+  if (!open) return 0;
+  int n = host->nvsGet(nodeIndex, ns, key, nullptr, 0);
+  if (n < 0 || (size_t)n > cap) return 0;
+  return (size_t)host->nvsGet(nodeIndex, ns, key, buf, (uint32_t)cap);
+}
+
+size_t Preferences::getBytesLength(const char* key){
+  if (!open) return 0;
+  int n = host->nvsGet(nodeIndex, ns, key, nullptr, 0);
+  return n < 0 ? 0 : (size_t)n;
+}
+
+size_t Preferences::putString(const char* key, const String& v){ return putBytes(key, v.c_str(), v.length() + 1); }
+
+String Preferences::getString(const char* key, const String& def){
+  size_t n = getBytesLength(key);
+  if (!n) return def;
+  std::vector<char> buf(n);
+  getBytes(key, buf.data(), n);
+  buf[n - 1] = 0;
+  return String(buf.data());
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <Arduino.h>
+#include "../node_api.h"
+
+// ----- Node-side glue for hal.cpp (used by node.cpp only) -----
+void halAttach(const SimHostApi* host, uint32_t index, uint64_t efuseMac, uint32_t seed);
+void halIdle();                 // one loop() pass done
+void hostKeyPush(char k);       // queued for Keypad::getKey()
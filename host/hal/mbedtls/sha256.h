@@ -0,0 +1,16 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ----- Host stand-in: the mbedtls 2.x SHA-256 calls crypto.cpp makes -----
+struct mbedtls_sha256_context {
+  uint32_t state[8];
+  uint64_t total;
+  uint8_t  buf[64];
+  int      is224;
+};
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224);
+void mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* in, size_t len);
+void mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char out[32]);
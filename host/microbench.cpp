@@ -0,0 +1,323 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+#include "hal/hal.h"
+#include "node_api.h"
+#include "sx127x_fake.h"
+#include "../crypto.h"
+#include "../compress.h"
+#include "../fec.h"
+#include "../frag.h"
+#include "../protocol.h"
+#include "../metrics.h"
+#include "../storage.h"
+#include "../addr.h"
+
+// ----- Micro-benchmarks of the CPU-bound kernels, one firmware copy on the host -----
+// microbench [-k cycles_per_ns | -c crc8_cycles] [-j] [filter...]
+// Each kernel runs over the input sizes it sees on the board. The iteration
+// count is grown until a batch takes BATCH_MS, the best of REPEATS batches is
+// reported (least disturbed by the host), with the heap allocations per call.
+//
+// ESP32 estimate: host ns/op times a factor in ESP32 cycles per host ns. The
+// default is a rough ratio of a ~3 GHz out-of-order host core to the 240 MHz
+// in-order LX6; to calibrate, time crc8 over a 169 B frame on the board
+// (ESP.getCycleCount() around 1000 calls) and pass the cycles per call with -c,
+// which sets the factor from this host's crc8/169 result.
+//
+// After the kernels, the compression ratio (packed / raw bytes) over a corpus
+// of message kinds, including ones the coder can't shrink (raw fallback).
+//
+// Allocations count operator new only (String, std::vector, the display
+// stand-in's UTF-8 copy). The host String keeps up to 15 chars inline and the
+// ESP32 one 11, so short strings can allocate on the board where they don't here.
+
+extern uint8_t mbCrc8(const uint8_t* data, size_t len);
+extern void    mbPushChat(uint8_t from, const char* text, uint16_t seq);
+extern size_t  mbWrapLines(const String& text, int maxWidth);
+extern int     mbFitTail(const String& s, int maxPixels);
+extern int     mbRxPrep(uint8_t from);
+extern void    mbRxDispatch(int i);
+extern void    setup();
+
+static const uint32_t BATCH_MS = 20;
+static const int      REPEATS  = 5;
+static const double   DEFAULT_CYCLES_PER_NS = 4.0;
+static const double   ESP32_MHZ = 240.0;
+
+// ----- Allocation counter -----
+static uint64_t allocs = 0;
+
+void* operator new(size_t n){
+  allocs++;
+  if (void* p = malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t n){ return operator new(n); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// ----- Firmware host: a clock that only moves when the firmware waits -----
+// A transmission (the replies rxDispatch sends) ends as soon as the firmware waits for it.
+static SxFakeChip chip;
+static uint64_t clockUs = 0;
+static void hostSleep(uint64_t us){
+  clockUs += us;
+  if (chip.txOnAir) sxFakeFinishTx(chip);
+}
+static void hostIdle(){}
+static void hostLog(uint32_t, const char*){}
+static int  hostNvsGet(uint32_t, const char*, const char*, void*, uint32_t){ return -1; }
+static void hostNvsPut(uint32_t, const char*, const char*, const void*, uint32_t){}
+static void hostNvsErase(uint32_t, const char*, const char*){}
+static void hostChat(uint32_t, const SimChatInfo*, int){}
+static const SimHostApi hostApi = { &clockUs, hostSleep, hostIdle, hostLog, hostNvsGet, hostNvsPut, hostNvsErase, hostChat };
+
+// ----- Inputs -----
+static const char TEXT[] =
+  "meet at the north gate at half past six, bring the spare radio and a charged "
+  "battery. if the road by the river is closed we take the path over the hill "
+  "instead, it adds twenty minutes but the signal up there is much better. call "
+  "me on this when you leave and again when you pass the old mill so I know you "
+  "are on the way. the others will wait at the car park until seven and then go "
+  "ahead without us, so don't be late. I'll keep the channel open all evening, "
+  "and if you don't hear back try again in ten minutes from higher ground.";
+static_assert(sizeof(TEXT) > 480, "TEXT must cover CHAT_MSG_MAX_LEN");
+
+static uint8_t  key[32], nonce[8], frame[480], fecOut[FEC_MAX_REPAIR * 150];
+static char     textIn[481], textOut[481];
+static uint8_t  packed[600];
+static size_t   packedLen = 0;
+static String   strIn;
+static size_t   len = 0;
+static uint16_t seq = 0;
+static volatile uint32_t sink = 0;
+
+// FEC decode of the largest message: FEC_K fragments, `lost` of them rebuilt
+// from the first `lost` repair symbols
+static const uint8_t FEC_K = (FRAG_MSG_MAX + FRAG_DATA_MAX - 1) / FRAG_DATA_MAX;
+static uint8_t  fecData[FEC_K * FRAG_DATA_MAX], fecRep[FEC_MAX_REPAIR * FRAG_DATA_MAX], fecRepSaved[sizeof(fecRep)];
+static uint32_t fecHave;
+static uint16_t fecRepHave;
+
+static void useErasures(uint8_t lost){
+  for (size_t b=0;b<sizeof(fecData);b++) fecData[b] = (uint8_t)(b * 7 + (b >> 8));
+  for (uint8_t r=0;r<lost;r++) fecRepair(fecData, FEC_K, FRAG_DATA_MAX, r, fecRepSaved + (size_t)r*FRAG_DATA_MAX);
+  fecHave = (1u << FEC_K) - 1;
+  for (uint8_t j=0;j<lost;j++) fecHave &= ~(1u << (j * FEC_K / lost));   // spread over the message
+  fecRepHave = (uint16_t)((1u << lost) - 1);
+}
+
+static void useText(size_t n){
+  len = n;
+  memcpy(textIn, TEXT, n); textIn[n] = 0;
+  strIn = String(textIn);
+  packedLen = compressText(textIn, n, packed, sizeof(packed));
+}
+
+static void kCrc8()      { sink += mbCrc8(frame, len); }
+static void kXor()       { keystreamXor(key, nonce, frame, len); }
+static void kMac()       { uint8_t t[MAC_LEN]; macTag(key, nonce, 4, frame, len, t); sink += t[0]; }
+static void kDerive()    { uint8_t k[32]; derivePairKey(String("Base camp"), String("Ridge"), 482915, nonce, k); sink += k[0]; }
+static void kCompress()  { sink += compressText(textIn, len, packed, sizeof(packed)); }
+static void kDecompress(){ sink += decompressText(packed, packedLen, textOut, sizeof(textOut)); }
+static void kFec()       { fecRepair(frame, 3, 150, 2, fecOut); sink += fecOut[0]; }
+static void kRecover(){                  // repair symbols restored each call: fecRecover uses them as scratch
+  memcpy(fecRep, fecRepSaved, sizeof(fecRep));
+  sink += fecRecover(fecData, FEC_K, FRAG_DATA_MAX, fecHave, fecRep, fecRepHave);
+}
+static void kPushChat()  { mbPushChat(7, textIn, ++seq); }
+static void kWrap()      { sink += mbWrapLines(strIn, 128); }
+static void kFitTail()   { sink += mbFitTail(strIn, 104); }   // compose line: 128 px less the send icon
+static void kDiscUpdate(){ discUpsert((uint8_t)(1 + seq++ % MAX_DISC), 0, "Ridge", -80); }
+static void kMetricInc() { metricInc(MC_RX_OK); }
+static void kMetricObs() { metricObserve(MH_TX_AIR_MS, 31 + (seq++ & 0xFF)); }
+static int  rxFrames = 0, rxNext = 0;
+static void kRxDispatch(){ mbRxDispatch(rxNext); rxNext = rxNext + 1 == rxFrames ? 0 : rxNext + 1; }
+static void kDiscInsert(){ discUpsert((uint8_t)(100 + seq++ % 100), 0, "Ridge", -80); }   // table full: evicts
+
+static void prepBytes(size_t n){ len = n; }
+static void prepText(size_t n){ useText(n); }
+static void prepNone(size_t){}
+static void prepLost1(size_t){ useErasures(1); }
+static void prepLost2(size_t){ useErasures(2); }
+static void prepLostMax(size_t){ useErasures(FEC_MAX_REPAIR); }
+// The firmware booted on the fake radio, with one contact the frames come from
+static void prepRx(size_t){
+  static bool booted = false;
+  if (!booted){ sxFakeReset(chip); sxFakeSelect(&chip); setup(); booted = true; }
+  storageClearContacts();
+  Contact k{};
+  k.id = 0x31; k.self = addrSelf();
+  strcpy(k.name, "rx");
+  for (int i=0;i<32;i++) k.key[i] = (uint8_t)(i * 7 + 1);
+  storageAddContact(k);
+  rxFrames = mbRxPrep(k.id);
+  rxNext = 0;
+}
+static void prepDisc(size_t){
+  protocolNearbyClear();
+  for (uint8_t i=1;i<=MAX_DISC;i++) discUpsert(i, 0, "Ridge", -80);
+}
+
+struct Kernel {
+  const char* name;
+  size_t      size;                 // input bytes (chars for text kernels)
+  void (*prep)(size_t size);
+  void (*run)();
+};
+
+static const Kernel KERNELS[] = {
+  { "crc8",          5, prepBytes, kCrc8 },        // ctrl frame
+  { "crc8",        169, prepBytes, kCrc8 },        // full packet
+  { "keystreamXor",  16, prepBytes, kXor },
+  { "keystreamXor", 155, prepBytes, kXor },
+  { "keystreamXor", 480, prepBytes, kXor },
+  { "macTag",       155, prepBytes, kMac },
+  { "derivePairKey",  0, prepNone,  kDerive },
+  { "compressText",  40, prepText,  kCompress },
+  { "compressText", 480, prepText,  kCompress },
+  { "decompressText", 40, prepText, kDecompress },
+  { "decompressText", 480, prepText, kDecompress },
+  { "fecRepair",    450, prepNone,  kFec },        // 3 x 150 B data, 2 repair
+  { "fecRecover/1",  FEC_K * FRAG_DATA_MAX, prepLost1,   kRecover },   // 4 KB message, erasures
+  { "fecRecover/2",  FEC_K * FRAG_DATA_MAX, prepLost2,   kRecover },
+  { "fecRecover/max", FEC_K * FRAG_DATA_MAX, prepLostMax, kRecover },
+  { "pushChat",      40, prepText,  kPushChat },
+  { "pushChat",     480, prepText,  kPushChat },
+  { "wrapLines",     40, prepText,  kWrap },
+  { "wrapLines",    480, prepText,  kWrap },
+  { "fitTail",       40, prepText,  kFitTail },
+  { "fitTail",      480, prepText,  kFitTail },
+  { "discUpsert/update", 0, prepDisc, kDiscUpdate },
+  { "discUpsert/insert", 0, prepDisc, kDiscInsert },
+  { "rxDispatch",     0, prepRx,    kRxDispatch },   // one frame of each routed type, and one unrouted
+  { "metricInc",      0, prepNone,  kMetricInc },
+  { "metricObserve",  0, prepNone,  kMetricObs },
+};
+
+// ----- Compression corpus -----
+struct CorpusSet {
+  const char* name;
+  const char* lines[8];
+};
+
+static const CorpusSet CORPUS[] = {
+  { "short",     { "ok", "on my way", "where are you?", "see you at camp in 10", "yes",
+                   "battery low, back soon", "got it, thanks!", "wait for me at the bridge" } },
+  { "sentences", { "the road by the river is closed, we take the path over the hill instead.",
+                   "call me when you leave and again when you pass the old mill so I know you are on the way.",
+                   "I'll keep the channel open all evening, try again in ten minutes from higher ground.",
+                   TEXT } },
+  { "uppercase", { "OK", "ON MY WAY", "WHERE ARE YOU?", "MEET AT THE NORTH GATE AT 6",
+                   "SOS NEED WATER AT CAMP 2", "ALL CLEAR, HEADING BACK NOW" } },
+  { "mixed",     { "Meet Alex @ 18:30, Gate B (north) - bring GPS + 2x AA!",
+                   "Coords: 47.3769N 8.5417E, alt 412m; ETA ~25min",
+                   "PIN 4471 / code #A9-Z2 / ref: XK-77" } },
+  { "binary",    { "\xc3\xa9t\xc3\xa9 \xc3\xa0 l'h\xc3\xb4" "tel, \xc3\xa7" "a va?",
+                   "\xf0\x9f\x93\xa1\xf0\x9f\x94\x8b\xf0\x9f\x9a\xb6",
+                   "~`^|{}<>[]\\$%&*_=+;:\"'" } },
+};
+
+// Packed over raw bytes per set; raw counts how many messages took the raw fallback.
+static void corpusRatios(bool json){
+  if (!json) printf("\n%-20s %6s %6s %8s %6s  %s\n", "corpus", "msgs", "raw B", "packed B", "ratio", "fallback");
+  for (const CorpusSet& c : CORPUS){
+    size_t raw = 0, out = 0;
+    int msgs = 0, fallback = 0;
+    for (const char* line : c.lines){
+      if (!line) break;
+      size_t n = strlen(line);
+      size_t p = compressText(line, n, packed, sizeof(packed));
+      raw += n; out += p; msgs++;
+      fallback += packed[0] < 0x80;
+    }
+    double ratio = raw ? (double)out / raw : 0;
+    if (json)
+      printf("{\"corpus\":\"%s\",\"msgs\":%d,\"raw_bytes\":%zu,\"packed_bytes\":%zu,\"ratio\":%.3f,\"raw_fallback\":%d}\n",
+             c.name, msgs, raw, out, ratio, fallback);
+    else
+      printf("%-20s %6d %6zu %8zu %6.3f  %d raw\n", c.name, msgs, raw, out, ratio, fallback);
+  }
+}
+
+// ----- Harness -----
+static double nowNs(){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct Result { double nsOp; double allocsOp; };
+
+static Result measure(const Kernel& k){
+  k.prep(k.size);
+  uint64_t iters = 1;
+  for (;;){                                    // grow to one batch's worth
+    double t = nowNs();
+    for (uint64_t i=0;i<iters;i++) k.run();
+    if (nowNs() - t >= BATCH_MS * 1e6 / 4 || iters >= (1ull << 30)) break;
+    iters *= 4;
+  }
+  iters *= 4;
+  Result best = { 1e30, 0 };
+  for (int r=0;r<REPEATS;r++){
+    k.prep(k.size);
+    uint64_t a = allocs;
+    double t = nowNs();
+    for (uint64_t i=0;i<iters;i++) k.run();
+    double ns = (nowNs() - t) / iters;
+    if (ns < best.nsOp) best = { ns, (double)(allocs - a) / iters };
+  }
+  return best;
+}
+
+static bool selected(const char* name, int argc, char** argv, int first){
+  if (first >= argc) return true;
+  for (int i=first;i<argc;i++) if (strstr(name, argv[i])) return true;
+  return false;
+}
+
+int main(int argc, char** argv){
+  double perNs = DEFAULT_CYCLES_PER_NS, crcCycles = 0;
+  bool json = false;
+  int i = 1;
+  for (;i<argc && argv[i][0] == '-';i++){
+    if (!strcmp(argv[i], "-k") && i + 1 < argc) perNs = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc) crcCycles = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-j")) json = true;
+    else { fprintf(stderr, "usage: %s [-k cycles_per_ns | -c crc8_cycles] [-j] [filter...]\n", argv[0]); return 2; }
+  }
+
+  halAttach(&hostApi, 0, 0x0000A1B2C3D4E5F6ull, 1);
+  for (size_t b=0;b<sizeof(key);b++) key[b] = (uint8_t)(b * 37 + 11);
+  for (size_t b=0;b<sizeof(nonce);b++) nonce[b] = (uint8_t)(b * 13 + 5);
+  for (size_t b=0;b<sizeof(frame);b++) frame[b] = (uint8_t)TEXT[b];
+
+  if (crcCycles > 0){
+    Kernel ref = { "crc8", 169, prepBytes, kCrc8 };
+    perNs = crcCycles / measure(ref).nsOp;
+  }
+
+  if (!json){
+    printf("%-20s %6s %11s %10s %14s %10s\n", "kernel", "size", "ns/op", "allocs/op", "esp32 cycles", "esp32 us");
+    printf("ESP32 estimate: %.2f cycles per host ns%s\n", perNs, crcCycles > 0 ? " (calibrated on crc8/169)" : " (uncalibrated)");
+  }
+  for (const Kernel& k : KERNELS){
+    if (!selected(k.name, argc, argv, i)) continue;
+    Result r = measure(k);
+    double cycles = r.nsOp * perNs;
+    if (json)
+      printf("{\"kernel\":\"%s\",\"size\":%zu,\"ns_op\":%.2f,\"allocs_op\":%.2f,\"esp32_cycles\":%.0f,\"esp32_us\":%.2f}\n",
+             k.name, k.size, r.nsOp, r.allocsOp, cycles, cycles / ESP32_MHZ);
+    else
+      printf("%-20s %6zu %11.1f %10.2f %14.0f %10.2f\n", k.name, k.size, r.nsOp, r.allocsOp, cycles, cycles / ESP32_MHZ);
+  }
+  if (selected("compressText", argc, argv, i)) corpusRatios(json);
+  return (int)(sink & 0);
+}
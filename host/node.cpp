@@ -0,0 +1,256 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <deque>
+#include "hal/hal.h"
+#include "node_api.h"
+#include "../ui.h"
+#include "../input.h"
+#include "../protocol.h"
+#include "../storage.h"
+#include "../addr.h"
+#include "../peer.h"
+#include "../frag.h"
+#include "../console.h"
+#include "../compress.h"
+#include "../crypto.h"
+#include "../rtt.h"
+
+// ----- One simulated board: the sketch's setup()/loop() plus a command hook -----
+// Commands are what a user would do at the keypad, with shortcuts where the UI
+// only allows the first step (searching again once contacts exist):
+//   key <chars>       keypad presses, one per loop (U D E X 0-9 * #)
+//   search            open the search page and send a discovery request
+//   invite <id>       on the search page: invite that nearby node
+//   accept <code>     on the invite prompt: type the code, confirm
+//   chat <id> <text>  open the chat with a contact and send
+//   open <id>         open the chat with a contact (listen on the pair channel)
+//   blob <id> <text>  one long message past the compose limit, up to
+//                     FRAG_MSG_MAX, sealed as a chat transfer; the receiver's
+//                     log keeps its first CHAT_MSG_MAX_LEN chars
+//   bcast <text>      broadcast
+//   ping <id>         link ping
+//   relay 0|1, tdma 0|1, fec 0|1, ctrlack 0|1 (direct replies as control frames)
+//   home              back to the contacts page
+//   serial <line>     a line typed on the serial console (console.h)
+//   contact <id> <self> <node> <key> <name>
+//                     add a contact as pairing would (node: 8 hex digits,
+//                     key: 64); benchmarks use it to set up many pairs quickly
+void setup();
+void loop();
+
+static const SimHostApi* host = nullptr;
+static uint32_t nodeIndex = 0;
+static std::deque<std::string> cmds;
+static const char* bootName = "";
+static uint8_t bootAddr = 0;
+
+static bool hexBytes(const char* s, uint8_t* out, int n){
+  if (strlen(s) != (size_t)n * 2) return false;
+  for (int i=0;i<n;i++){
+    unsigned v;
+    if (sscanf(s + 2*i, "%2x", &v) != 1) return false;
+    out[i] = (uint8_t)v;
+  }
+  return true;
+}
+
+// Seals like protocol.cpp sendFragmented(): nonce4 | ciphertext | tag over
+// (self, peer, TYPE_FRAG, msgId). The id comes from the node's seq counter so
+// the receiver's replay window accepts it. Waits (blobTick) while another
+// transfer is still running, as a long chat message would have to.
+static std::string blobText;
+static uint8_t     blobTo = 0;
+
+static void blobTick(){
+  if (!blobTo || fragTxBusy()) return;
+  uint8_t to = blobTo;
+  blobTo = 0;
+  int idx = storageFindContact(to);
+  if (idx < 0) return;
+  uint16_t msgId = storageReserveSeq(1);
+  uint8_t* buf = fragTxBegin(to, msgId);
+  if (!buf) return;
+  const uint8_t* key = storageContactAt(idx).key;
+  size_t len = compressText(blobText.c_str(), blobText.size(), buf + 4, FRAG_MSG_MAX - 4 - MAC_LEN);
+  for (int i=0;i<4;i++) buf[i] = (uint8_t)esp_random();
+  keystreamXor(key, buf, buf + 4, len);
+  uint8_t ad[5] = { addrSelfFor(to), to, TYPE_FRAG, (uint8_t)(msgId >> 8), (uint8_t)msgId };
+  macTag(key, ad, sizeof(ad), buf, 4 + len, buf + 4 + len);
+  fragTxStart(4 + len + MAC_LEN);
+}
+
+static void runCommand(const std::string& line){
+  size_t sp = line.find(' ');
+  std::string verb = line.substr(0, sp);
+  std::string arg = sp == std::string::npos ? std::string() : line.substr(sp + 1);
+  int n = atoi(arg.c_str());
+
+  if (verb == "key"){
+    for (size_t i=0;i<arg.size();i++) if (arg[i] != ' ') hostKeyPush(arg[i]);
+  } else if (verb == "search"){
+    protocolNearbyClear();
+    page = PAGE_SEARCH; uiDrawSearch(); protocolSendDiscReq();
+  } else if (verb == "invite"){
+    if (page != PAGE_SEARCH) return;
+    for (int i=0;i<g_discCount;i++){
+      if (g_disc[i].id != n) continue;
+      searchSelSet(i);
+      hostKeyPush('E');
+      return;
+    }
+  } else if (verb == "accept"){
+    for (size_t i=0;i<arg.size();i++) hostKeyPush(arg[i]);
+    hostKeyPush('E');
+  } else if (verb == "chat"){
+    size_t t = arg.find(' ');
+    if (t == std::string::npos) return;
+    protocolEnterChat((uint8_t)n);
+    page = PAGE_CHAT;
+    protocolSendChat(String(arg.substr(t + 1)));
+  } else if (verb == "blob"){
+    size_t t = arg.find(' ');
+    if (t == std::string::npos) return;
+    blobText = arg.substr(t + 1);
+    blobTo = (uint8_t)n;
+  } else if (verb == "open"){
+    protocolEnterChat((uint8_t)n);
+    page = PAGE_CHAT;
+  } else if (verb == "bcast"){
+    protocolBroadcast(String(arg));
+  } else if (verb == "ping"){
+    protocolSendPing((uint8_t)n);
+  } else if (verb == "relay"){
+    storageSetRelayEnabled(n != 0);
+  } else if (verb == "tdma"){
+    storageSetTdmaEnabled(n != 0);
+  } else if (verb == "fec"){
+    fragSetFec(n != 0);
+  } else if (verb == "ctrlack"){
+    protocolSetCtrlReplies(n != 0);
+  } else if (verb == "contact"){
+    Contact c{};
+    unsigned id = 0, self = 0;
+    char nodeHex[9] = {0}, keyHex[65] = {0}, name[16] = {0};
+    if (sscanf(arg.c_str(), "%u %u %8s %64s %15s", &id, &self, nodeHex, keyHex, name) != 5) return;
+    if (!hexBytes(keyHex, c.key, 32)) return;
+    c.id = (uint8_t)id; c.self = (uint8_t)self;
+    c.node = (uint32_t)strtoul(nodeHex, nullptr, 16);
+    strlcpy(c.name, name, sizeof(c.name));
+    storageAddContact(c);
+  } else if (verb == "serial"){
+    consoleExec(arg.c_str());
+  } else if (verb == "home"){
+    page = PAGE_CONTACTS; uiDrawContacts();
+  } else {
+    Serial.printf("sim: unknown command '%s'\n", line.c_str());
+  }
+}
+
+// ----- Chat log watch: tells the simulator what appeared or changed -----
+// The log is only rescanned when a cheap fingerprint (count, newest id,
+// statuses) moves, which is rare next to the number of loop() passes.
+struct SeenMsg { uint8_t from, peer, status; uint16_t seq; };
+static SeenMsg  seen[64];
+static int      seenCount = 0;
+static uint32_t seenPrint = 0;
+
+static void chatWatch(){
+  int count = min(protocolChatCount(), 64);
+  ChatMsg m;
+  uint32_t print = (uint32_t)count;
+  for (int i=0;i<count;i++){
+    protocolGetChat(i, m);
+    print = print * 31 + (uint32_t)(m.status + 1) * (uint32_t)(i + 1) + (i == count - 1 ? (uint32_t)m.seq << 8 | m.from : 0);
+  }
+  if (print == seenPrint) return;
+  seenPrint = print;
+  SeenMsg now[64];
+  SimChatInfo out;
+  for (int i=0;i<count;i++){
+    protocolGetChat(i, m);
+    int old = -1;
+    for (int k=0;k<seenCount;k++)
+      if (seen[k].seq == m.seq && seen[k].from == m.from && seen[k].peer == m.peer){ old = seen[k].status; break; }
+    if (old != m.status){
+      out.from = m.from; out.peer = m.peer; out.status = m.status; out.seq = m.seq;
+      strlcpy(out.text, m.text ? m.text : "", sizeof(out.text));
+      host->chat(nodeIndex, &out, old);
+    }
+    now[i] = SeenMsg{m.from, m.peer, m.status, m.seq};
+  }
+  memcpy(seen, now, sizeof(SeenMsg) * count);
+  seenCount = count;
+}
+
+// ----- SimNodeApi -----
+static void nodeRun(){
+  Preferences p;
+  p.begin("loraim", false);
+  if (bootName[0] && !p.isKey("name")) p.putString("name", bootName);
+  if (bootAddr && !p.isKey("addr")) p.putUChar("addr", bootAddr);
+  p.end();
+  setup();
+  for (;;){
+    while (!cmds.empty()){
+      std::string c = cmds.front();
+      cmds.pop_front();
+      runCommand(c);
+    }
+    loop();
+    blobTick();
+    chatWatch();
+    halIdle();
+  }
+}
+
+static SxFakeChip* nodeChip(){ return sxFakeCurrent(); }
+static void nodeCommand(const char* line){ cmds.push_back(line); }
+
+static void nodeInfo(SimNodeInfo* o){
+  memset(o, 0, sizeof(*o));
+  o->page   = page;
+  o->self   = addrSelf();
+  o->nodeId = addrNodeId();
+  o->contacts = storageContactCount();
+  for (int i=0;i<o->contacts && i<10;i++){
+    uint8_t id = storageContactAt(i).id;
+    o->contactIds[i] = id;
+    o->ackWaitMs[i] = (uint16_t)protocolAckWaitMs(id);
+    RttStats st;
+    for (int k=0;k<rttPeerCount();k++) if (rttStatsAt(k, st) && st.peer == id) o->srttMs[i] = st.srttMs;
+  }
+  o->chats  = protocolChatCount();
+  o->nearby = g_discCount;
+  for (int i=0;i<g_discCount && i<10;i++) o->nearbyIds[i] = g_disc[i].id;
+  o->inviteCode = page == PAGE_INVITE_CODE ? inviteCode : 0;
+  o->inviterId  = page == PAGE_INVITE_PROMPT ? inviterId : 0;
+  o->peers  = peerCount();
+  for (uint8_t t=0;t<32;t++){
+    RxTypeStats s = protocolRxStats(t);
+    o->rxFrames += s.frames;
+    o->rxDropped += s.dropped;
+  }
+  o->macRejects = protocolMacRejects();
+}
+
+static bool nodeChat(int i, SimChatInfo* o){
+  if (i < 0 || i >= protocolChatCount()) return false;
+  ChatMsg m;
+  protocolGetChat(i, m);
+  o->from = m.from; o->peer = m.peer; o->status = m.status; o->seq = m.seq;
+  strlcpy(o->text, m.text ? m.text : "", sizeof(o->text));
+  return true;
+}
+
+static const SimNodeApi api = { nodeRun, nodeChip, nodeCommand, nodeInfo, nodeChat };
+
+extern "C" __attribute__((visibility("default")))
+const SimNodeApi* simNodeEntry(const SimHostApi* h, uint32_t index, uint64_t efuseMac,
+                               uint32_t seed, const char* name, uint8_t shortAddr){
+  host = h;
+  nodeIndex = index;
+  halAttach(h, index, efuseMac, seed);
+  bootName = name ? strdup(name) : "";
+  bootAddr = shortAddr;
+  return &api;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include "sx127x_fake.h"
+
+// ----- Simulator <-> node boundary -----
+// Each node is its own dlopen()ed copy of node.so (the sketch + host/hal), so
+// every node gets private copies of the firmware's statics. The simulator
+// talks to a node only through these two tables.
+extern "C" {
+
+struct SimChatInfo;
+
+struct SimHostApi {
+  const uint64_t* clockUs;                     // virtual time
+  void (*sleepUs)(uint64_t us);                // park the running node; returns when it's due
+  void (*idle)();                              // end of a loop() pass: next one when the simulator says
+  void (*log)(uint32_t node, const char* line);
+  // Flash lives on the simulator side so it survives a reboot (a fresh copy of node.so)
+  int  (*nvsGet)(uint32_t node, const char* ns, const char* key, void* buf, uint32_t cap);   // length, -1 if missing
+  void (*nvsPut)(uint32_t node, const char* ns, const char* key, const void* v, uint32_t n);
+  void (*nvsErase)(uint32_t node, const char* ns, const char* key);   // key nullptr: the whole namespace
+  // A message entered the chat log (oldStatus -1) or changed status
+  void (*chat)(uint32_t node, const SimChatInfo* m, int oldStatus);
+};
+
+// What the simulator reads back from a node (see node.cpp for the sources).
+struct SimNodeInfo {
+  uint8_t  page;                               // ui.h Page
+  uint8_t  self;                               // primary short address
+  uint32_t nodeId;
+  int      contacts;
+  uint8_t  contactIds[10];
+  uint16_t srttMs[10];                         // per contact: smoothed ACK RTT (0 = no sample)
+  uint16_t ackWaitMs[10];                      //   and the first-try ACK wait
+  int      chats;                              // messages in the chat log
+  int      nearby;                             // discovery results
+  uint8_t  nearbyIds[10];
+  uint32_t inviteCode;                         // shown by a requester (0 = none)
+  uint8_t  inviterId;                          // invitee: who asked (0 = none)
+  int      peers;                              // live PeerState records
+  uint32_t rxFrames, rxDropped, macRejects;
+};
+
+struct SimChatInfo {
+  uint8_t  from, peer, status;
+  uint16_t seq;
+  char     text[481];
+};
+
+struct SimNodeApi {
+  void        (*run)();                        // coroutine body: setup(), then loop() forever
+  SxFakeChip* (*chip)();
+  void        (*command)(const char* line);    // queued; runs on the node between loop()s (see node.cpp)
+  void        (*info)(SimNodeInfo* out);
+  bool        (*chat)(int i, SimChatInfo* out);
+};
+
+// node.so's only export. `name` and `shortAddr` (0 = the firmware picks) seed
+// a node that boots with empty flash.
+typedef const SimNodeApi* (*SimNodeEntry)(const SimHostApi* host, uint32_t index, uint64_t efuseMac,
+                                          uint32_t seed, const char* name, uint8_t shortAddr);
+#define SIM_NODE_ENTRY "simNodeEntry"
+}
@@ -0,0 +1,418 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "hal/hal.h"
+#include "node_api.h"
+#include "../airtime.h"
+#include "../capture.h"
+#include "../metrics.h"
+#include "../protocol.h"
+#include "../addr.h"
+
+void setup();                                    // LoRaMessenger.ino
+
+// ----- Capture replay: one firmware copy fed a recorded frame stream -----
+// replay [-n node] [-s step_ms] [-c] [-v] [-w out.pcap] capture.log
+// Reads what the serial "capture" command prints (capture.h), from a board's
+// serial log or a simulator log (lines prefixed "<time> [node] "); -n picks the
+// node when the log holds several. The firmware boots with the captured node's
+// ID and short address, then every received frame goes back into its radio at
+// the time it was read, under a virtual clock, and protocolPoll() runs between
+// frames every step_ms (default 2). The replayed node keeps its own capture
+// ring, so each frame's fate can be compared with what the board recorded.
+// Transmitted frames aren't fed back; the replayed node sends its own.
+//
+// Reported: per-frame verdicts that differ, frames the radio wouldn't take
+// (header mode or TX at that moment differ from the board's), and the host
+// time protocolPoll() spent on passes that handled a frame vs idle passes.
+// -c exits 1 on any difference, for regression runs over saved captures.
+// -w writes the input as a pcap file (LINKTYPE_USER0): each packet is an
+// 8-byte pseudo-header (flags as in capture.h, chan, verdict counter id or
+// 255, snr_q4, rssi int16 LE, 2 zero bytes), then the frame.
+//
+// Contact keys are not in a capture: sealed frames from contacts end in
+// rx.ok without a key to open them, where the board may have said rx.bad_mac.
+
+static const uint32_t LOST_AFTER_US = 300000;    // delivered but never read
+static const uint32_t LISTEN_WAIT_US = 50000;    // radio not in RX when a frame is due
+static const uint32_t TAIL_US = 2000000;         // keep polling after the last frame
+static const uint32_t LEAD_US = 100000;          // start polling this long before the first
+
+struct Rec {
+  uint64_t    us;                                // unwrapped
+  bool        tx, implicit;
+  uint8_t     chan;
+  int         rssi, snrQ4;
+  std::string verdict;
+  std::vector<uint8_t> data;
+};
+
+struct Source {
+  uint32_t nodeId = 0;
+  int      addr = 0;
+  uint64_t wraps = 0, lastUs = 0;
+  std::vector<Rec> recs;
+};
+
+static std::map<int, Source> sources;
+
+// ----- Dump parsing -----
+static int hexNibble(char c){
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void readDump(FILE* f){
+  char line[1024];
+  while (fgets(line, sizeof(line), f)){
+    int src = -1;
+    const char* p = line;
+    const char* br = strchr(line, '[');
+    if (br){                                        // simulator log: "  8850.178 [1] ..."
+      int n; char close;
+      if (sscanf(br, "[%d%c", &n, &close) == 2 && close == ']'){ src = n; p = br + strcspn(br, "]") + 1; }
+    }
+    while (*p == ' ') p++;
+
+    unsigned frames;
+    if (sscanf(p, "capture %u frames", &frames) == 1){
+      Source s;
+      if (const char* nd = strstr(p, " node ")){
+        unsigned long id; int a;
+        if (sscanf(nd, " node %lx addr %d", &id, &a) == 2){ s.nodeId = (uint32_t)id; s.addr = a; }
+      }
+      sources[src] = s;                             // a later dump replaces the earlier one
+      continue;
+    }
+
+    unsigned long us; char dir[4], mode; unsigned chan, len; int rssi, snr, at = 0; char verdict[32];
+    if (sscanf(p, "F %lu %3s %c %u %d %d %31s %u %n", &us, dir, &mode, &chan, &rssi, &snr, verdict, &len, &at) != 8 || !at)
+      continue;
+    Rec r;
+    const char* hex = p + at;
+    for (unsigned i=0;i<len;i++){
+      int hi = hexNibble(hex[2*i]), lo = hi < 0 ? -1 : hexNibble(hex[2*i+1]);
+      if (lo < 0) break;
+      r.data.push_back((uint8_t)(hi << 4 | lo));
+    }
+    if (r.data.size() != len) continue;             // cut off in the log
+    Source& s = sources[src];
+    uint64_t t = s.wraps + us;
+    if (!s.recs.empty() && t + (1ull << 31) < s.lastUs){ s.wraps += 1ull << 32; t += 1ull << 32; }
+    s.lastUs = t;
+    r.us = t;
+    r.tx = !strcmp(dir, "tx");
+    r.implicit = mode == 'I';
+    r.chan = (uint8_t)chan;
+    r.rssi = rssi;
+    r.snrQ4 = snr;
+    r.verdict = verdict;
+    s.recs.push_back(std::move(r));
+  }
+}
+
+static uint8_t verdictId(const std::string& v){
+  for (int i=0;i<MC_COUNT;i++) if (v == metricCounterName((uint8_t)i)) return (uint8_t)i;
+  return CAPTURE_PENDING;
+}
+
+// ----- pcap (LINKTYPE_USER0) -----
+static void put32(FILE* o, uint32_t v){ fwrite(&v, 4, 1, o); }
+static void put16(FILE* o, uint16_t v){ fwrite(&v, 2, 1, o); }
+
+static bool writePcap(const char* path, const std::vector<Rec>& recs){
+  FILE* o = fopen(path, "wb");
+  if (!o){ perror(path); return false; }
+  put32(o, 0xA1B2C3D4); put16(o, 2); put16(o, 4);
+  put32(o, 0); put32(o, 0); put32(o, 65535); put32(o, 147);
+  for (const Rec& r : recs){
+    uint32_t n = 8 + (uint32_t)r.data.size();
+    put32(o, (uint32_t)(r.us / 1000000)); put32(o, (uint32_t)(r.us % 1000000));
+    put32(o, n); put32(o, n);
+    uint8_t ph[8] = { (uint8_t)((r.tx ? CAP_TX : 0) | (r.implicit ? CAP_IMPLICIT : 0)), r.chan,
+                      verdictId(r.verdict), (uint8_t)(int8_t)r.snrQ4,
+                      (uint8_t)(r.rssi & 0xFF), (uint8_t)((r.rssi >> 8) & 0xFF), 0, 0 };
+    fwrite(ph, 1, sizeof(ph), o);
+    fwrite(r.data.data(), 1, r.data.size(), o);
+  }
+  fclose(o);
+  return true;
+}
+
+// ----- Firmware host -----
+static SxFakeChip chip;
+static uint64_t   clockUs = 0;
+static bool       verbose = false;
+static std::map<std::string, std::vector<uint8_t>> nvs;
+
+static std::string nvsKey(const char* ns, const char* key){ return std::string(ns) + '/' + key; }
+
+static void hostIdle(){}
+static void hostLog(uint32_t, const char* line){ if (verbose) printf("  | %s\n", line); }
+static int hostNvsGet(uint32_t, const char* ns, const char* key, void* buf, uint32_t cap){
+  auto it = nvs.find(nvsKey(ns, key));
+  if (it == nvs.end()) return -1;
+  if (buf) memcpy(buf, it->second.data(), std::min((size_t)cap, it->second.size()));
+  return (int)it->second.size();
+}
+static void hostNvsPut(uint32_t, const char* ns, const char* key, const void* v, uint32_t n){
+  nvs[nvsKey(ns, key)].assign((const uint8_t*)v, (const uint8_t*)v + n);
+}
+static void hostNvsErase(uint32_t, const char* ns, const char* key){
+  if (key){ nvs.erase(nvsKey(ns, key)); return; }
+  std::string prefix = std::string(ns) + '/';
+  for (auto it = nvs.begin(); it != nvs.end();) it = it->first.compare(0, prefix.size(), prefix) ? std::next(it) : nvs.erase(it);
+}
+static void hostChat(uint32_t, const SimChatInfo*, int){}
+static void hostSleep(uint64_t us);
+static const SimHostApi hostApi = { &clockUs, hostSleep, hostIdle, hostLog, hostNvsGet, hostNvsPut, hostNvsErase, hostChat };
+
+// addrInit() takes the node ID from the efuse MAC through fmix32; undo it so
+// the replayed node has the captured one (high half 0: fmix32(0) == 0).
+static uint32_t mulInverse(uint32_t a){
+  uint32_t x = a;
+  for (int i=0;i<5;i++) x *= 2 - a * x;
+  return x;
+}
+static uint32_t unfmix(uint32_t h){
+  h ^= h >> 16;
+  h *= mulInverse(0xC2B2AE35);
+  h ^= (h >> 13) ^ (h >> 26);
+  h *= mulInverse(0x85EBCA6B);
+  return h ^ (h >> 16);
+}
+
+// ----- Radio side: TX ends after its airtime, received frames go in on time -----
+static uint8_t  chipSf(const SxFakeChip& c){ return c.regs[SX_REG_MODEM_CONFIG_2] >> 4; }
+static uint8_t  chipCr4(const SxFakeChip& c){ return (uint8_t)(4 + ((c.regs[SX_REG_MODEM_CONFIG_1] >> 1) & 7)); }
+static bool     chipCrc(const SxFakeChip& c){ return c.regs[SX_REG_MODEM_CONFIG_2] & 0x04; }
+static uint16_t chipPreamble(const SxFakeChip& c){ return (uint16_t)(c.regs[SX_REG_PREAMBLE_MSB] << 8 | c.regs[SX_REG_PREAMBLE_MSB + 1]); }
+static uint32_t chipBw(const SxFakeChip& c){
+  static const uint32_t steps[] = { 7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000 };
+  uint8_t i = c.regs[SX_REG_MODEM_CONFIG_1] >> 4;
+  return steps[i < 10 ? i : 9];
+}
+static bool chipListening(const SxFakeChip& c){
+  return sxFakeMode(c) == SX_MODE_RX_CONT && (c.regs[SX_REG_OP_MODE] & SX_MODE_LORA);
+}
+
+static const std::vector<Rec>* feed = nullptr;   // received frames, in order
+static uint64_t offsetUs = 0;                    // capture time + offset = replay clock
+static size_t   next = 0;                        // next frame to deliver
+static int      inFlight = -1;                   // delivered, not read yet
+static uint64_t inFlightUs = 0, waitUs = 0, txEndUs = 0;
+static uint32_t seen = 0;                        // replay capture records looked at
+static std::vector<uint32_t> replayRec;          // per frame: its replay capture record, UINT32_MAX if none
+static std::vector<size_t>   unresolved;
+static uint32_t notTaken = 0, lost = 0, txSent = 0;
+
+static uint64_t dueUs(size_t i){ return (*feed)[i].us + offsetUs; }
+
+// New records in the replay's capture ring: the frame in flight was read
+static bool collect(){
+  bool rx = false;
+  for (; seen < captureTotal(); seen++){
+    const CaptureRec* r = captureAt(seen);
+    if (!r) continue;
+    if (r->flags & CAP_TX){ txSent++; continue; }
+    rx = true;
+    if (inFlight >= 0){ replayRec[inFlight] = seen; unresolved.push_back((size_t)inFlight); inFlight = -1; }
+  }
+  return rx;
+}
+
+static void radioStep(){
+  if (chip.txOnAir){
+    if (!txEndUs) txEndUs = clockUs + loraAirtimeUs(chip.txLen, chipSf(chip), chipBw(chip), chipCr4(chip),
+                                                    chipPreamble(chip), chip.txImplicit, chipCrc(chip));
+    if (clockUs >= txEndUs){ sxFakeFinishTx(chip); txEndUs = 0; }
+  }
+  collect();
+  if (inFlight >= 0){
+    if (clockUs - inFlightUs < LOST_AFTER_US) return;
+    lost++; inFlight = -1;
+  }
+  if (next >= feed->size() || dueUs(next) > clockUs || chip.txOnAir) return;
+  const Rec& r = (*feed)[next];
+  if (!chipListening(chip)){
+    if (!waitUs) waitUs = clockUs;
+    if (clockUs - waitUs < LISTEN_WAIT_US) return;
+    notTaken++; next++; waitUs = 0;
+    return;
+  }
+  waitUs = 0;
+  if (sxFakeDeliver(chip, r.data.data(), (uint8_t)r.data.size(), r.implicit, r.rssi, (int8_t)r.snrQ4, 0)){
+    inFlight = (int)next; inFlightUs = clockUs;
+  } else notTaken++;
+  next++;
+}
+
+// Moves the clock to `until`, stopping at every TX end and frame due on the way;
+// the main loop also returns as soon as a frame is in, so it's read when it was
+static void advance(uint64_t until, bool toRead = false){
+  for (;;){
+    radioStep();
+    if (clockUs >= until || (toRead && inFlight >= 0)) return;
+    uint64_t t = until;
+    if (txEndUs && txEndUs > clockUs) t = std::min(t, txEndUs);
+    if (next < feed->size() && dueUs(next) > clockUs) t = std::min(t, dueUs(next));
+    clockUs = t;
+  }
+}
+
+static void hostSleep(uint64_t us){ advance(clockUs + us); }
+
+// ----- Timing of protocolPoll() -----
+static double nowNs(){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static std::vector<double> rxPollNs;
+static double   idleNs = 0;
+static uint64_t idlePolls = 0;
+
+static void poll(){
+  uint32_t before = captureTotal();
+  double t0 = nowNs();
+  protocolPoll();
+  double ns = nowNs() - t0;
+  bool rx = false;
+  for (uint32_t i=before;i<captureTotal();i++){ const CaptureRec* r = captureAt(i); rx |= r && !(r->flags & CAP_TX); }
+  if (rx) rxPollNs.push_back(ns);
+  else { idleNs += ns; idlePolls++; }
+}
+
+static double pct(std::vector<double>& v, double p){
+  if (v.empty()) return 0;
+  size_t i = std::min(v.size() - 1, (size_t)(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+int main(int argc, char** argv){
+  int pick = -2;                                   // -2: the only source there is
+  double stepMs = 2;
+  bool check = false;
+  const char* pcapPath = nullptr;
+  const char* input = nullptr;
+  for (int i=1;i<argc;i++){
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) pick = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) stepMs = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc) pcapPath = argv[++i];
+    else if (!strcmp(argv[i], "-c")) check = true;
+    else if (!strcmp(argv[i], "-v")) verbose = true;
+    else if (argv[i][0] == '-' && argv[i][1]){
+      fprintf(stderr, "usage: %s [-n node] [-s step_ms] [-c] [-v] [-w out.pcap] [capture.log]\n", argv[0]);
+      return 2;
+    }
+    else input = argv[i];
+  }
+  FILE* f = input ? fopen(input, "r") : stdin;
+  if (!f){ perror(input); return 1; }
+  readDump(f);
+  if (input) fclose(f);
+
+  if (pick == -2){
+    if (sources.size() != 1){
+      fprintf(stderr, "%zu captures in the log, pick one with -n:", sources.size());
+      for (auto& kv : sources) fprintf(stderr, " %d", kv.first);
+      fprintf(stderr, "\n");
+      return 1;
+    }
+    pick = sources.begin()->first;
+  }
+  if (!sources.count(pick)){ fprintf(stderr, "no capture from node %d\n", pick); return 1; }
+  const Source& src = sources[pick];
+  if (pcapPath && !writePcap(pcapPath, src.recs)) return 1;
+
+  std::vector<Rec> rx;
+  uint32_t txCaptured = 0;
+  for (const Rec& r : src.recs){ if (r.tx) txCaptured++; else rx.push_back(r); }
+  if (rx.empty()){ printf("no received frames to replay\n"); return 0; }
+  feed = &rx;
+  replayRec.assign(rx.size(), UINT32_MAX);
+
+  // Boot the firmware as the captured node
+  uint8_t addr = (uint8_t)src.addr, named[] = "replay";
+  if (addr) hostNvsPut(0, "loraim", "addr", &addr, 1);
+  hostNvsPut(0, "loraim", "name", named, sizeof(named));
+  sxFakeReset(chip);
+  sxFakeSelect(&chip);
+  halAttach(&hostApi, 0, src.nodeId ? unfmix(src.nodeId) : 0x0000A1B2C3D4E5F6ull, 1);
+  setup();
+  if (src.nodeId && addrNodeId() != src.nodeId) fprintf(stderr, "warning: node ID %08lx, not %08lx\n",
+                                                         (unsigned long)addrNodeId(), (unsigned long)src.nodeId);
+  printf("replaying %zu received frames (%u sent) of node %08lx addr %u, %.3f s of capture\n",
+         rx.size(), txCaptured, (unsigned long)addrNodeId(), addrSelf(), (rx.back().us - rx.front().us) / 1e6);
+
+  // The board's clock where the capture starts, unless booting took longer
+  if (rx.front().us > clockUs + LEAD_US) clockUs = rx.front().us - LEAD_US;
+  else offsetUs = clockUs + LEAD_US - rx.front().us;
+  seen = captureTotal();
+
+  uint64_t stepUs = (uint64_t)(stepMs * 1000);
+  if (!stepUs) stepUs = 1;
+  std::vector<std::string> replayVerdict(rx.size());
+  // A frame's verdict is final once a later frame has been read (or at the end)
+  auto resolve = [&](size_t keep){
+    for (size_t k=0;k+keep<unresolved.size();k++){
+      size_t i = unresolved[k];
+      const CaptureRec* r = captureAt(replayRec[i]);
+      replayVerdict[i] = !r ? "overwritten" : r->verdict == CAPTURE_PENDING ? "pending" : metricCounterName(r->verdict);
+    }
+    unresolved.erase(unresolved.begin(), unresolved.end() - std::min(keep, unresolved.size()));
+  };
+  double wall0 = nowNs();
+  uint64_t endUs = 0;
+  while (next < rx.size() || inFlight >= 0 || clockUs < endUs){
+    uint64_t t = clockUs + stepUs;
+    if (next < rx.size() && dueUs(next) > clockUs) t = std::min(t, dueUs(next));
+    advance(t, true);
+    poll();
+    resolve(1);
+    if (!endUs && next >= rx.size() && inFlight < 0) endUs = clockUs + TAIL_US;
+  }
+  collect();
+  resolve(0);
+  double wallMs = (nowNs() - wall0) / 1e6;
+
+  // ----- Report -----
+  uint32_t match = 0, differ = 0;
+  std::map<std::string, uint32_t> captured, replayed;
+  for (size_t i=0;i<rx.size();i++){
+    captured[rx[i].verdict]++;
+    if (replayRec[i] == UINT32_MAX) continue;
+    replayed[replayVerdict[i]]++;
+    if (replayVerdict[i] == rx[i].verdict){ match++; continue; }
+    differ++;
+    const Rec& r = rx[i];
+    printf("  frame %zu at %.3f s, type 0x%02x from %u: board %s, replay %s\n", i, r.us / 1e6,
+           r.data.size() > 2 ? r.data[2] : 0, r.data.empty() ? 0 : r.data[0], r.verdict.c_str(), replayVerdict[i].c_str());
+  }
+  printf("%-16s %8s %8s\n", "verdict", "board", "replay");
+  std::map<std::string, bool> names;
+  for (auto& kv : captured) names[kv.first] = true;
+  for (auto& kv : replayed) names[kv.first] = true;
+  for (auto& kv : names) printf("%-16s %8u %8u\n", kv.first.c_str(), captured[kv.first], replayed[kv.first]);
+  printf("frames: %u same verdict, %u different, %u not taken by the radio, %u never read\n", match, differ, notTaken, lost);
+  printf("sent: board %u, replay %u\n", txCaptured, txSent);
+
+  double sum = 0;
+  for (double ns : rxPollNs) sum += ns;
+  size_t n = rxPollNs.size();
+  if (n) printf("protocolPoll with a frame: %zu, mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                n, sum / n / 1e3, pct(rxPollNs, 0.5) / 1e3, pct(rxPollNs, 0.99) / 1e3, pct(rxPollNs, 1.0) / 1e3);
+  if (idlePolls) printf("protocolPoll idle: %llu, mean %.2f us\n", (unsigned long long)idlePolls, idleNs / idlePolls / 1e3);
+  printf("%.1f s replayed in %.0f ms\n", (clockUs - offsetUs - rx.front().us) / 1e6, wallMs);
+  return check && (differ || notTaken || lost) ? 1 : 0;
+}
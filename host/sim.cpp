@@ -0,0 +1,527 @@
+#include "sim.h"
+#include "../airtime.h"
+#include <dlfcn.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <math.h>
+#include <map>
+#include <queue>
+#include <vector>
+#include <string>
+
+static const size_t   NODE_STACK = 256 * 1024;
+static const uint16_t PREAMBLE_SYNC_SYMS = 5;     // preamble symbols a receiver needs to sync
+
+struct Air {
+  uint32_t id;
+  int      from;
+  uint64_t start, end;
+  long     freq;
+  uint8_t  sf, sync;
+  uint32_t bw;
+  bool     implicit;
+  float    dbm;
+  uint8_t  len;
+  uint8_t  buf[256];
+  bool     cut;                 // sender aborted
+  bool     done;                // end handled
+  uint64_t lockBy;              // receivers entering RX after this miss the preamble
+};
+
+struct Node {
+  void*             so;
+  const SimNodeApi* api;
+  SxFakeChip*       chip;
+  ucontext_t        ctx;
+  char*             stack;
+  float             x, y, ppm;
+  uint32_t          airId;      // frame it's sending, 0 = none
+  uint32_t          lockId;     // frame it's receiving, 0 = none
+  float             lockSigMw, lockIntfMw;
+  long              lockFreq;
+  uint64_t          airUs;
+  bool              dead;
+  uint32_t          gen;        // bumped by a reboot; older wakes are stale
+  uint64_t          mac;
+  std::string       name;
+  std::map<std::string, std::vector<uint8_t> > nvs;   // "namespace/key"
+  SimFlashStats     flash;
+};
+
+struct Wake {
+  uint64_t t;
+  uint64_t order;
+  int      node;
+  uint32_t gen;
+  bool operator<(const Wake& o) const { return t != o.t ? t > o.t : order > o.order; }
+};
+
+static SimConfig cfg;
+static uint64_t  now = 0;
+static std::vector<Node*> nodes;
+static std::priority_queue<Wake> wakes;
+static uint64_t  wakeOrder = 0;
+static std::vector<Air> air;         // on air (ended ones go at the next prune)
+static uint32_t  nextAirId = 1;
+static SimMediumStats stats;
+static ucontext_t schedCtx;
+static int       running = -1;
+static uint64_t  rng = 1;
+static std::string tmpDir;
+static SimTxHook   txHook = nullptr;
+static SimChatHook chatHook = nullptr;
+static void*       hookCtx = nullptr;
+struct Jammer { long freq; float mw; };
+static std::vector<Jammer> jammers;
+
+// ----- Randomness (medium side; nodes have their own) -----
+static uint32_t simRand(){
+  rng ^= rng >> 12; rng ^= rng << 25; rng ^= rng >> 27;
+  return (uint32_t)((rng * 0x2545F4914F6CDD1Dull) >> 32);
+}
+static float simUniform(){ return (simRand() + 0.5f) / 4294967296.0f; }
+static float simGauss(){ return sqrtf(-2.0f * logf(simUniform())) * cosf(6.2831853f * simUniform()); }
+
+static uint32_t mix(uint32_t h){
+  h ^= h >> 16; h *= 0x7feb352d; h ^= h >> 15; h *= 0x846ca68b; h ^= h >> 16;
+  return h;
+}
+
+// Box-Muller on a hash, so a link's shadowing is fixed for the run and symmetric
+static float linkShadow(int a, int b){
+  if (cfg.shadowDb <= 0) return 0;
+  if (a > b){ int t = a; a = b; b = t; }
+  uint32_t h1 = mix(cfg.seed ^ mix((uint32_t)a * 7919u + (uint32_t)b));
+  uint32_t h2 = mix(h1 + 0x9E3779B9u);
+  float u1 = (h1 + 0.5f) / 4294967296.0f, u2 = (h2 + 0.5f) / 4294967296.0f;
+  return cfg.shadowDb * sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+// ----- Chip register decoding -----
+static uint8_t  chipSf(const SxFakeChip& c){ return c.regs[SX_REG_MODEM_CONFIG_2] >> 4; }
+static uint8_t  chipCr4(const SxFakeChip& c){ return (uint8_t)(4 + ((c.regs[SX_REG_MODEM_CONFIG_1] >> 1) & 7)); }
+static bool     chipCrc(const SxFakeChip& c){ return c.regs[SX_REG_MODEM_CONFIG_2] & 0x04; }
+static uint16_t chipPreamble(const SxFakeChip& c){ return (uint16_t)(c.regs[SX_REG_PREAMBLE_MSB] << 8 | c.regs[SX_REG_PREAMBLE_MSB + 1]); }
+static uint32_t chipBw(const SxFakeChip& c){
+  static const uint32_t steps[] = { 7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000 };
+  uint8_t i = c.regs[SX_REG_MODEM_CONFIG_1] >> 4;
+  return steps[i < 10 ? i : 9];
+}
+static float chipPowerDbm(const SxFakeChip& c){
+  float dbm = (c.regs[SX_REG_PA_CONFIG] & 0x0F) + 2;
+  return c.regs[SX_REG_PA_DAC] == 0x87 ? dbm + 3 : dbm;
+}
+static bool chipListening(const SxFakeChip& c){
+  return sxFakeMode(c) == SX_MODE_RX_CONT && (c.regs[SX_REG_OP_MODE] & SX_MODE_LORA);
+}
+
+static float snrFloorDb(uint8_t sf){ return -2.5f * (sf - 4); }   // SF7 -7.5 ... SF12 -20
+static float mw(float dbm){ return powf(10.0f, dbm / 10.0f); }
+static float dbm(float mw){ return 10.0f * log10f(mw); }
+static float noiseMw(long freq, uint32_t bw){
+  float n = mw(-174.0f + 10.0f * log10f((float)bw) + cfg.noiseFigureDb);
+  for (size_t i=0;i<jammers.size();i++) if (labs(jammers[i].freq - freq) < (long)bw) n += jammers[i].mw;
+  return n;
+}
+
+static float pathLossDb(int a, int b){
+  float dx = nodes[a]->x - nodes[b]->x, dy = nodes[a]->y - nodes[b]->y;
+  float d = sqrtf(dx*dx + dy*dy);
+  if (d < 1) d = 1;
+  return cfg.pathLoss0Db + 10.0f * cfg.pathExp * log10f(d) + linkShadow(a, b);
+}
+
+static float rxDbm(const Air& f, int to){ return f.dbm - pathLossDb(f.from, to); }
+
+static Air* airFind(uint32_t id){
+  for (size_t i=0;i<air.size();i++) if (air[i].id == id) return &air[i];
+  return nullptr;
+}
+
+static bool onAir(const Air& f){ return !f.cut && f.start <= now && now < f.end; }
+
+// ----- Medium -----
+// A receiver syncs on a frame if it's listening on the same channel/SF/BW/sync
+// word before the preamble is nearly over, and the SINR then clears the SF floor.
+// What else overlaps the frame from then on adds to its interference.
+static bool tryLock(int r, const Air& f){
+  Node& rx = *nodes[r];
+  if (rx.dead || rx.lockId || rx.airId || f.from == r || !chipListening(*rx.chip)) return false;
+  if (sxFakeFreqHz(*rx.chip) != f.freq || chipSf(*rx.chip) != f.sf || chipBw(*rx.chip) != f.bw) return false;
+  if (rx.chip->regs[SX_REG_SYNC_WORD] != f.sync) return false;
+  float p = mw(rxDbm(f, r) + (cfg.fadingDb > 0 ? cfg.fadingDb * simGauss() : 0)), intf = 0;
+  for (size_t k=0;k<air.size();k++)
+    if (air[k].id != f.id && onAir(air[k]) && air[k].freq == f.freq && air[k].from != r) intf += mw(rxDbm(air[k], r));
+  if (dbm(p) - dbm(noiseMw(f.freq, f.bw) + intf) < snrFloorDb(f.sf)) return false;
+  rx.lockId = f.id;
+  rx.lockFreq = f.freq;
+  rx.lockSigMw = p;
+  rx.lockIntfMw = intf;
+  return true;
+}
+
+static void airStart(int from){
+  Node& n = *nodes[from];
+  SxFakeChip& c = *n.chip;
+  Air f;
+  f.id = nextAirId++;
+  f.from = from;
+  f.start = now;
+  f.freq = c.txFreqHz;
+  f.sf = chipSf(c);
+  f.bw = chipBw(c);
+  f.sync = c.regs[SX_REG_SYNC_WORD];
+  f.implicit = c.txImplicit;
+  f.dbm = chipPowerDbm(c);
+  f.len = c.txLen;
+  memcpy(f.buf, c.tx, c.txLen);
+  f.cut = false;
+  f.done = false;
+  uint16_t pre = chipPreamble(c);
+  uint32_t symUs = (uint32_t)((1000000ull << f.sf) / f.bw);
+  f.lockBy = now + (pre > PREAMBLE_SYNC_SYMS ? (uint64_t)(pre - PREAMBLE_SYNC_SYMS) * symUs : 0);
+  uint32_t us = loraAirtimeUs(f.len, f.sf, f.bw, chipCr4(c), pre, f.implicit, chipCrc(c));
+  f.end = now + us;
+  n.airId = f.id;
+  n.airUs += us;
+  stats.txFrames++;
+  stats.airUs += us;
+
+  if (n.lockId){ n.lockId = 0; stats.halfDuplex++; }
+  if (txHook) txHook(hookCtx, from, f.buf, f.len, us);
+
+  air.push_back(f);
+  for (size_t r=0;r<nodes.size();r++){
+    Node& rx = *nodes[r];
+    if (!rx.lockId || (int)r == from){ tryLock((int)r, f); continue; }
+    if (rx.lockFreq != f.freq) continue;
+    float p = mw(rxDbm(f, (int)r));
+    const Air* cur = airFind(rx.lockId);
+    if (cur && now <= cur->lockBy && dbm(p) - dbm(rx.lockSigMw) >= cfg.captureDb){
+      // still in the first frame's preamble: a much stronger one takes the receiver over
+      float was = rx.lockSigMw;
+      rx.lockId = 0;
+      if (tryLock((int)r, f)) continue;
+      rx.lockId = cur->id;
+      rx.lockSigMw = was;
+    }
+    rx.lockIntfMw += p;
+  }
+}
+
+static void airEnd(Air& f){
+  f.done = true;
+  Node& tx = *nodes[f.from];
+  if (tx.airId == f.id){ tx.airId = 0; sxFakeFinishTx(*tx.chip); }
+
+  for (size_t r=0;r<nodes.size();r++){
+    Node& rx = *nodes[r];
+    if (rx.lockId != f.id) continue;
+    rx.lockId = 0;
+    if (f.cut) continue;
+    if (cfg.lossPct > 0 && simUniform() * 100.0f < cfg.lossPct){ stats.randomLoss++; continue; }
+    float noise = noiseMw(f.freq, f.bw);
+    float snr = dbm(rx.lockSigMw) - dbm(noise);
+    float sinr = dbm(rx.lockSigMw) - dbm(noise + rx.lockIntfMw);
+    bool crcOk = true;
+    if (rx.lockIntfMw > 0){
+      // an overlap is survived at captureDb over the interference alone, as
+      // long as noise plus interference stay under the SF floor
+      float sir = dbm(rx.lockSigMw) - dbm(rx.lockIntfMw);
+      if (sir < 0 || sinr < snrFloorDb(f.sf)){ stats.collisions++; continue; }
+      if (sir < cfg.captureDb) crcOk = false;
+    }
+    float errHz = (tx.ppm - rx.ppm) * (float)f.freq / 1e6f;
+    int32_t fei = (int32_t)(errHz * (float)SX_XTAL_HZ * 500000.0f / (16777216.0f * (float)f.bw));
+    int snrQ4 = (int)lroundf(snr * 4);
+    snrQ4 = snrQ4 < -128 ? -128 : (snrQ4 > 127 ? 127 : snrQ4);
+    if (!sxFakeDeliver(*rx.chip, f.buf, f.len, f.implicit, (int)lroundf(dbm(rx.lockSigMw)),
+                       (int8_t)snrQ4, fei, crcOk)) continue;
+    if (crcOk) stats.delivered++; else stats.crcErrors++;
+  }
+}
+
+static void airPrune(){
+  size_t k = 0;
+  for (size_t i=0;i<air.size();i++)
+    if (!air[i].done) air[k++] = air[i];
+  air.resize(k);
+}
+
+// Carrier sense: what the RSSI register reads on the channel the node is on
+// now (it may have retuned since it was resumed)
+static void mediumRssi(SxFakeChip&){
+  if (running < 0) return;
+  Node& n = *nodes[running];
+  long freq = sxFakeFreqHz(*n.chip);
+  float total = noiseMw(freq, chipBw(*n.chip));
+  for (size_t k=0;k<air.size();k++)
+    if (onAir(air[k]) && air[k].freq == freq && air[k].from != running) total += mw(rxDbm(air[k], running));
+  sxFakeSetRssi(*n.chip, (int)lroundf(dbm(total)));
+}
+
+// Whatever the node did to its radio: started or aborted a TX, left RX mid-frame
+static void mediumAfterRun(int i){
+  Node& n = *nodes[i];
+  SxFakeChip& c = *n.chip;
+  if (n.airId && !c.txOnAir){                     // aborted mid-frame
+    Air* f = airFind(n.airId);
+    n.airId = 0;
+    if (f){ f->cut = true; f->end = now; airEnd(*f); }
+  }
+  if (n.lockId && (!chipListening(c) || sxFakeFreqHz(c) != n.lockFreq)){
+    n.lockId = 0;
+    stats.halfDuplex++;
+  }
+  if (c.txOnAir && !n.airId) airStart(i);
+  if (!n.lockId && !n.airId)                      // (back) in RX: catch a preamble still going
+    for (size_t k=0;k<air.size() && !n.lockId;k++)
+      if (!air[k].done && !air[k].cut && now <= air[k].lockBy) tryLock(i, air[k]);
+}
+
+// ----- Scheduler -----
+static void wakeAt(int node, uint64_t t){ wakes.push(Wake{t, wakeOrder++, node, nodes[node]->gen}); }
+
+static void hostSleepUs(uint64_t us){
+  int i = running;
+  wakeAt(i, now + us);
+  swapcontext(&nodes[i]->ctx, &schedCtx);
+}
+static void hostIdle(){ hostSleepUs(cfg.loopUs); }
+static void hostLog(uint32_t node, const char* line){
+  if (cfg.log) printf("%10.3f [%u] %s\n", now / 1000.0, node, line);
+}
+
+static std::string nvsKey(const char* ns, const char* key){ return std::string(ns) + "/" + key; }
+
+static int hostNvsGet(uint32_t node, const char* ns, const char* key, void* buf, uint32_t cap){
+  std::map<std::string, std::vector<uint8_t> >& m = nodes[node]->nvs;
+  std::map<std::string, std::vector<uint8_t> >::const_iterator it = m.find(nvsKey(ns, key));
+  if (it == m.end()) return -1;
+  uint32_t n = (uint32_t)it->second.size();
+  if (buf) memcpy(buf, it->second.data(), n < cap ? n : cap);
+  return (int)n;
+}
+
+static void hostNvsPut(uint32_t node, const char* ns, const char* key, const void* v, uint32_t n){
+  nodes[node]->nvs[nvsKey(ns, key)].assign((const uint8_t*)v, (const uint8_t*)v + n);
+  nodes[node]->flash.writes++;
+  nodes[node]->flash.bytes += n;
+}
+
+static void hostNvsErase(uint32_t node, const char* ns, const char* key){
+  std::map<std::string, std::vector<uint8_t> >& m = nodes[node]->nvs;
+  if (key) m.erase(nvsKey(ns, key));
+  else {
+    std::string pre = std::string(ns) + "/";
+    for (std::map<std::string, std::vector<uint8_t> >::iterator it = m.begin(); it != m.end();)
+      it = it->first.compare(0, pre.size(), pre) == 0 ? m.erase(it) : ++it;
+  }
+  nodes[node]->flash.writes++;
+}
+
+static void hostChat(uint32_t node, const SimChatInfo* m, int oldStatus){
+  if (chatHook) chatHook(hookCtx, (int)node, m, oldStatus);
+}
+
+static const SimHostApi hostApi = { &now, hostSleepUs, hostIdle, hostLog,
+                                    hostNvsGet, hostNvsPut, hostNvsErase, hostChat };
+
+static void nodeMain(){
+  nodes[running]->api->run();
+  nodes[running]->dead = true;                    // run() never returns on a healthy node
+  swapcontext(&nodes[running]->ctx, &schedCtx);
+}
+
+static void resume(int i){
+  if (nodes[i]->dead) return;
+  running = i;
+  sxFakeSelect(nodes[i]->chip);
+  swapcontext(&schedCtx, &nodes[i]->ctx);
+  running = -1;
+  mediumAfterRun(i);
+}
+
+static Air* nextAirEnd(){
+  Air* best = nullptr;
+  for (size_t k=0;k<air.size();k++){
+    Air& f = air[k];
+    if (f.done) continue;
+    if (!best || f.end < best->end || (f.end == best->end && f.id < best->id)) best = &f;
+  }
+  return best;
+}
+
+static void runTo(uint64_t end){
+  for (;;){
+    Air* f = nextAirEnd();
+    uint64_t tw = wakes.empty() ? UINT64_MAX : wakes.top().t;
+    if (f && f->end <= tw && f->end <= end){
+      now = f->end;
+      airEnd(*f);
+      airPrune();
+      continue;
+    }
+    if (tw > end) break;
+    Wake w = wakes.top();
+    wakes.pop();
+    if (w.gen != nodes[w.node]->gen) continue;
+    now = w.t;
+    resume(w.node);
+  }
+  now = end;
+}
+
+// ----- Public -----
+SimConfig simDefaults(){
+  SimConfig c;
+  c.seed = 1;
+  c.loopUs = 1000;
+  c.pathLoss0Db = 40;
+  c.pathExp = 2.7f;
+  c.shadowDb = 0;
+  c.fadingDb = 0;
+  c.noiseFigureDb = 6;
+  c.captureDb = 6;
+  c.lossPct = 0;
+  c.ppm = 10;
+  c.nodeLib = "build/node.so";
+  c.log = false;
+  return c;
+}
+
+bool simInit(const SimConfig& c){
+  simShutdown();
+  cfg = c;
+  rng = ((uint64_t)c.seed << 1 | 1) * 0x9E3779B97F4A7C15ull;
+  char tmpl[] = "/tmp/loraim-sim-XXXXXX";
+  if (!mkdtemp(tmpl)) return false;
+  tmpDir = tmpl;
+  return true;
+}
+
+void simShutdown(){
+  for (size_t i=0;i<nodes.size();i++){
+    if (nodes[i]->so) dlclose(nodes[i]->so);
+    free(nodes[i]->stack);
+    delete nodes[i];
+  }
+  nodes.clear();
+  while (!wakes.empty()) wakes.pop();
+  air.clear();
+  jammers.clear();
+  txHook = nullptr; chatHook = nullptr; hookCtx = nullptr;
+  memset(&stats, 0, sizeof(stats));
+  now = 0; nextAirId = 1; wakeOrder = 0;
+  if (!tmpDir.empty()) rmdir(tmpDir.c_str());
+  tmpDir.clear();
+}
+
+// dlopen() hands back the same handle for the same file, so each node loads
+// its own copy: private firmware globals, no cross-talk.
+static void* loadCopy(int index){
+  char path[512];
+  snprintf(path, sizeof(path), "%s/node%d-%u.so", tmpDir.c_str(), index, nodes[index]->gen);   // a reused name gets the old copy back
+  FILE* in = fopen(cfg.nodeLib, "rb");
+  FILE* out = in ? fopen(path, "wb") : nullptr;
+  if (!out){ if (in) fclose(in); return nullptr; }
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) fwrite(buf, 1, n, out);
+  fclose(in); fclose(out);
+  void* so = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!so) fprintf(stderr, "sim: %s\n", dlerror());
+  unlink(path);
+  return so;
+}
+
+// (Re)starts node i from power-on: a fresh copy of node.so, same MAC, same flash.
+static bool boot(int i, uint8_t shortAddr){
+  Node& n = *nodes[i];
+  if (n.so) dlclose(n.so);
+  n.so = loadCopy(i);
+  SimNodeEntry entry = n.so ? (SimNodeEntry)dlsym(n.so, SIM_NODE_ENTRY) : nullptr;
+  if (!entry) return false;
+  n.api = entry(&hostApi, (uint32_t)i, n.mac, cfg.seed, n.name.c_str(), shortAddr);
+  n.chip = n.api->chip();
+  n.chip->rssiRead = mediumRssi;
+  n.airId = n.lockId = 0;
+  n.dead = false;
+  n.gen++;
+  getcontext(&n.ctx);
+  n.ctx.uc_stack.ss_sp = n.stack;
+  n.ctx.uc_stack.ss_size = NODE_STACK;
+  n.ctx.uc_link = nullptr;
+  makecontext(&n.ctx, nodeMain, 0);
+  wakeAt(i, now + simRand() % cfg.loopUs);       // boards don't power up in lockstep
+  return true;
+}
+
+int simAddNode(float x, float y, const char* name, uint8_t shortAddr){
+  int i = (int)nodes.size();
+  Node* n = new Node();
+  n->so = nullptr;
+  n->mac = 0x24A1600000ull | (mix(cfg.seed * 131u + (uint32_t)i) & 0xFFFFFF);   // Heltec-style OUI
+  n->name = name ? name : "";
+  n->x = x; n->y = y;
+  n->ppm = cfg.ppm * (2 * simUniform() - 1);
+  n->stack = (char*)malloc(NODE_STACK);
+  nodes.push_back(n);
+  if (boot(i, shortAddr)) return i;
+  if (n->so) dlclose(n->so);
+  free(n->stack);
+  delete n;
+  nodes.pop_back();
+  return -1;
+}
+
+void simReboot(int i){
+  Node& n = *nodes[i];
+  if (n.airId){
+    Air* f = airFind(n.airId);
+    n.airId = 0;
+    if (f){ f->cut = true; f->end = now; airEnd(*f); }
+  }
+  n.lockId = 0;
+  if (!boot(i, 0)) n.dead = true;
+}
+
+int  simNodeCount(){ return (int)nodes.size(); }
+void simSetPosition(int i, float x, float y){ nodes[i]->x = x; nodes[i]->y = y; }
+uint64_t simNowUs(){ return now; }
+
+void simRunFor(uint32_t ms){ runTo(now + (uint64_t)ms * 1000); }
+
+bool simRunUntil(bool (*done)(void*), void* ctx, uint32_t timeoutMs, uint32_t stepMs){
+  uint64_t end = now + (uint64_t)timeoutMs * 1000;
+  while (!done(ctx)){
+    if (now >= end) return false;
+    runTo(std::min(end, now + (uint64_t)stepMs * 1000));
+  }
+  return true;
+}
+
+void simCommand(int i, const char* fmt, ...){
+  char line[4200];                    // fits a `blob` of FRAG_MSG_MAX text
+  va_list ap; va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  nodes[i]->api->command(line);
+}
+
+SimNodeInfo simInfo(int i){
+  SimNodeInfo o;
+  nodes[i]->api->info(&o);
+  return o;
+}
+
+bool simChat(int i, int k, SimChatInfo* out){ return nodes[i]->api->chat(k, out); }
+
+SimMediumStats simMediumStats(){ return stats; }
+uint64_t simNodeAirUs(int i){ return nodes[i]->airUs; }
+SimFlashStats simNodeFlash(int i){ return nodes[i]->flash; }
+
+void simSetHooks(SimTxHook tx, SimChatHook chat, void* ctx){ txHook = tx; chatHook = chat; hookCtx = ctx; }
+void simSetJammer(long freqHz, float dbm){ jammers.push_back(Jammer{freqHz, mw(dbm)}); }
+float simLinkRssi(int from, int to){ return chipPowerDbm(*nodes[from]->chip) - pathLossDb(from, to); }
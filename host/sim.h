@@ -0,0 +1,82 @@
+#pragma once
+#include <stdint.h>
+#include "node_api.h"
+
+// ----- Virtual LoRa medium -----
+// N unmodified firmware instances (node.so, one dlopen()ed copy each) run as
+// coroutines on one virtual microsecond clock. A node runs until it sleeps
+// (delay(), or the end of a loop() pass) and time only moves between runs, so a
+// run is exactly repeatable for a given seed and far faster than real time.
+//
+// The medium watches every node's fake SX127x: a TX start puts the frame on
+// air for its time-on-air (airtime.h, from the chip's own modem registers), and
+// at the end every receiver that locked onto it gets it through sxFakeDeliver.
+// Per receiver:
+//  - power: log-distance path loss, optional per-link shadowing and per-frame fading
+//  - lock:  in RX on the same channel/SF/BW/sync word, not already locked, and
+//           SINR at the start at least the SF's demodulation floor
+//  - half duplex: leaving RX (or retuning) during the frame loses it
+//  - collisions: other frames on the channel overlapping it add interference;
+//           signal over interference >= captureDb still decodes, >= 0 dB gives
+//           a CRC error, below that (or SINR under the SF floor) nothing
+//  - carrier sense: the RSSI register reads noise + whatever is on air
+struct SimConfig {
+  uint32_t    seed;
+  uint32_t    loopUs;           // gap between loop() passes
+  float       pathLoss0Db;      // at 1 m
+  float       pathExp;
+  float       shadowDb;         // per-link Gaussian sigma, 0 = off
+  float       fadingDb;         // per-frame Gaussian sigma at each receiver, 0 = off
+  float       noiseFigureDb;
+  float       captureDb;
+  float       lossPct;          // extra random loss per frame and receiver
+  float       ppm;              // crystal error spread (+/-), shows up as FEI
+  const char* nodeLib;          // path to node.so
+  bool        log;              // print nodes' Serial output
+};
+SimConfig simDefaults();
+
+struct SimMediumStats {
+  uint32_t txFrames;
+  uint64_t airUs;               // summed over transmitters
+  uint32_t delivered;           // clean RX_DONE
+  uint32_t crcErrors;           // collided, decoded with a bad CRC
+  uint32_t collisions;          // collided, not decoded at all
+  uint32_t halfDuplex;          // receiver left RX mid-frame
+  uint32_t randomLoss;
+};
+
+bool     simInit(const SimConfig& cfg);
+void     simShutdown();
+// Index, -1 if node.so won't load. shortAddr pins the primary short (0 = the
+// firmware picks one from the node ID, as on a fresh board).
+int      simAddNode(float x, float y, const char* name, uint8_t shortAddr = 0);
+void     simReboot(int node);                  // power cycle: RAM gone, flash kept
+int      simNodeCount();
+void     simSetPosition(int node, float x, float y);
+
+uint64_t simNowUs();
+void     simRunFor(uint32_t ms);
+// Runs until done(ctx) holds (checked every stepMs) or timeoutMs passes.
+bool     simRunUntil(bool (*done)(void* ctx), void* ctx, uint32_t timeoutMs, uint32_t stepMs = 10);
+
+void     simCommand(int node, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+SimNodeInfo simInfo(int node);
+bool     simChat(int node, int i, SimChatInfo* out);
+
+SimMediumStats simMediumStats();
+uint64_t simNodeAirUs(int node);
+float    simLinkRssi(int from, int to);        // mean dBm at `to` at its current TX power
+
+struct SimFlashStats { uint32_t writes; uint32_t bytes; };   // every put or erase is a write
+SimFlashStats simNodeFlash(int node);
+
+// Observers for benchmarks: every frame put on air, every chat log change
+// (oldStatus -1 = new message). Called from inside the run; don't run the sim.
+typedef void (*SimTxHook)(void* ctx, int node, const uint8_t* buf, uint8_t len, uint32_t airUs);
+typedef void (*SimChatHook)(void* ctx, int node, const SimChatInfo* m, int oldStatus);
+void     simSetHooks(SimTxHook tx, SimChatHook chat, void* ctx);
+
+// A constant interferer on one frequency: adds to every node's noise floor
+// there (and to what its channel survey reads).
+void     simSetJammer(long freqHz, float dbm);
@@ -0,0 +1,123 @@
+#include "sx127x_fake.h"
+
+static SxFakeChip defaultChip;
+static SxFakeChip* cur = nullptr;
+
+static int rssiOffset(const SxFakeChip& c){ return sxFakeFreqHz(c) < 525000000 ? 164 : 157; }
+
+static void raise(SxFakeChip& c, uint8_t irq, uint8_t mapping){
+  c.regs[SX_REG_IRQ_FLAGS] |= irq;
+  if ((c.regs[SX_REG_DIO_MAPPING_1] & 0xC0) == mapping && c.dio0Isr) c.dio0Isr();
+}
+
+void sxFakeReset(SxFakeChip& c){
+  memset(&c, 0, sizeof(c));
+  c.regs[SX_REG_OP_MODE]        = 0x09;   // FSK, standby
+  c.regs[SX_REG_FRF_MSB]        = 0x6C;   // 434 MHz
+  c.regs[SX_REG_FRF_MSB + 1]    = 0x80;
+  c.regs[SX_REG_MODEM_CONFIG_1] = 0x72;
+  c.regs[SX_REG_MODEM_CONFIG_2] = 0x70;
+  c.regs[SX_REG_PAYLOAD_LENGTH] = 0x01;
+  c.regs[SX_REG_FIFO_TX_BASE]   = 0x80;
+  c.regs[SX_REG_VERSION]        = SX_VERSION;
+  c.regs[SX_REG_RSSI]           = 0;
+}
+
+void sxFakeSelect(SxFakeChip* c){ cur = c; }
+SxFakeChip* sxFakeCurrent(){
+  if (!cur){ sxFakeReset(defaultChip); cur = &defaultChip; }
+  return cur;
+}
+
+uint8_t sxFakeMode(const SxFakeChip& c){ return c.regs[SX_REG_OP_MODE] & SX_MODE_MASK; }
+bool    sxFakeImplicit(const SxFakeChip& c){ return c.regs[SX_REG_MODEM_CONFIG_1] & 0x01; }
+long sxFakeFreqHz(const SxFakeChip& c){
+  uint32_t frf = (uint32_t)c.regs[SX_REG_FRF_MSB] << 16 | (uint32_t)c.regs[SX_REG_FRF_MSB + 1] << 8 | c.regs[SX_REG_FRF_MSB + 2];
+  return (long)(((uint64_t)frf * SX_XTAL_HZ) >> 19);
+}
+
+// ----- Register side effects -----
+static void onWrite(SxFakeChip& c, uint8_t reg, uint8_t v){
+  if (reg == SX_REG_FIFO){
+    c.fifo[c.regs[SX_REG_FIFO_ADDR_PTR]++] = v;
+    return;
+  }
+  if (reg == SX_REG_IRQ_FLAGS){ c.regs[reg] &= (uint8_t)~v; return; }
+  if (reg == SX_REG_VERSION) return;
+  c.regs[reg] = v;
+  if (reg == SX_REG_OP_MODE && (v & SX_MODE_MASK) == SX_MODE_TX && !c.txOnAir){
+    c.txLen = c.regs[SX_REG_PAYLOAD_LENGTH];
+    for (int i=0;i<c.txLen;i++) c.tx[i] = c.fifo[(uint8_t)(c.regs[SX_REG_FIFO_TX_BASE] + i)];
+    c.txImplicit = sxFakeImplicit(c);
+    c.txFreqHz = sxFakeFreqHz(c);
+    c.txOnAir = true;
+  }
+  if (reg == SX_REG_OP_MODE && (v & SX_MODE_MASK) != SX_MODE_TX) c.txOnAir = false;   // aborted
+}
+
+static uint8_t onRead(SxFakeChip& c, uint8_t reg){
+  if (reg == SX_REG_FIFO) return c.fifo[c.regs[SX_REG_FIFO_ADDR_PTR]++];
+  if (reg == SX_REG_RSSI && c.rssiRead) c.rssiRead(c);
+  return c.regs[reg];
+}
+
+// ----- sx127x.h bus -----
+void sxBusBegin(const RadioPins&, void (*dio0Isr)()){
+  SxFakeChip& c = *sxFakeCurrent();
+  c.dio0Isr = dio0Isr;
+}
+
+uint8_t sxRead(uint8_t reg){
+  uint8_t v;
+  sxReadBurst(reg, &v, 1);
+  return v;
+}
+
+void sxWrite(uint8_t reg, uint8_t v){ sxWriteBurst(reg, &v, 1); }
+
+// Like the chip, a burst keeps the address except on the FIFO, whose pointer moves.
+void sxReadBurst(uint8_t reg, uint8_t* buf, uint8_t n){
+  SxFakeChip& c = *sxFakeCurrent();
+  reg &= 0x7F;
+  c.busOps++; c.busBytes += 1u + n;
+  for (uint8_t i=0;i<n;i++) buf[i] = onRead(c, reg == SX_REG_FIFO ? reg : (uint8_t)((reg + i) & 0x7F));
+}
+
+void sxWriteBurst(uint8_t reg, const uint8_t* buf, uint8_t n){
+  SxFakeChip& c = *sxFakeCurrent();
+  reg &= 0x7F;
+  c.busOps++; c.busBytes += 1u + n;
+  for (uint8_t i=0;i<n;i++) onWrite(c, reg == SX_REG_FIFO ? reg : (uint8_t)((reg + i) & 0x7F), buf[i]);
+}
+
+// ----- Test / medium side -----
+void sxFakeFinishTx(SxFakeChip& c){
+  if (!c.txOnAir) return;
+  c.txOnAir = false;
+  c.regs[SX_REG_OP_MODE] = (c.regs[SX_REG_OP_MODE] & ~SX_MODE_MASK) | SX_MODE_STDBY;   // the chip drops to standby
+  raise(c, SX_IRQ_TX_DONE, SX_DIO0_TX_DONE);
+}
+
+void sxFakeSetRssi(SxFakeChip& c, int dbm){
+  c.regs[SX_REG_RSSI] = (uint8_t)constrain(dbm + rssiOffset(c), 0, 255);
+}
+
+bool sxFakeDeliver(SxFakeChip& c, const uint8_t* buf, uint8_t len, bool implicitHeader,
+                   int rssiDbm, int8_t snrQ4, int32_t feiRaw, bool crcOk){
+  if (sxFakeMode(c) != SX_MODE_RX_CONT || !(c.regs[SX_REG_OP_MODE] & SX_MODE_LORA)) return false;
+  bool implicitRx = sxFakeImplicit(c);
+  if (implicitRx != implicitHeader) return false;            // header mismatch: nothing decodes
+  if (implicitRx && len != c.regs[SX_REG_PAYLOAD_LENGTH]) crcOk = false;
+  uint8_t base = c.regs[SX_REG_FIFO_RX_BASE];
+  for (int i=0;i<len;i++) c.fifo[(uint8_t)(base + i)] = buf[i];
+  c.regs[SX_REG_FIFO_RX_CURRENT] = base;
+  c.regs[SX_REG_RX_NB_BYTES] = len;
+  c.regs[SX_REG_PKT_SNR]  = (uint8_t)snrQ4;
+  c.regs[SX_REG_PKT_RSSI] = (uint8_t)constrain(rssiDbm + rssiOffset(c), 0, 255);
+  uint32_t fei = (uint32_t)feiRaw & 0xFFFFF;
+  c.regs[SX_REG_FEI_MSB]     = (uint8_t)(fei >> 16);
+  c.regs[SX_REG_FEI_MSB + 1] = (uint8_t)(fei >> 8);
+  c.regs[SX_REG_FEI_MSB + 2] = (uint8_t)fei;
+  raise(c, SX_IRQ_RX_DONE | (crcOk ? 0 : SX_IRQ_CRC_ERROR), SX_DIO0_RX_DONE);
+  return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+#include "../sx127x.h"
+
+// ----- Register-level SX127x stand-in for host builds -----
+// Implements the sx127x.h bus on plain memory: the register file, a 256-byte
+// FIFO behind SX_REG_FIFO with the address pointer auto-incrementing, IRQ
+// flags cleared by writing 1, and DIO0 raised on TX_DONE / RX_DONE according
+// to the DIO mapping. Nothing happens on its own: a test (or the virtual
+// medium) ends transmissions and delivers frames through the calls below.
+struct SxFakeChip {
+  uint8_t  regs[0x80];
+  uint8_t  fifo[256];
+  void   (*dio0Isr)();
+  bool     txOnAir;          // entered TX, not finished yet
+  uint8_t  tx[256];          // what the FIFO held when TX started
+  uint8_t  txLen;
+  bool     txImplicit;
+  long     txFreqHz;
+  uint32_t busOps;           // SPI transactions (a burst counts once)
+  uint32_t busBytes;
+  void   (*rssiRead)(SxFakeChip& c);   // optional: refresh SX_REG_RSSI before it's read
+};
+
+void        sxFakeReset(SxFakeChip& c);         // power-on register values
+void        sxFakeSelect(SxFakeChip* c);        // chip the bus functions talk to
+SxFakeChip* sxFakeCurrent();
+
+uint8_t sxFakeMode(const SxFakeChip& c);        // SX_MODE_* (without SX_MODE_LORA)
+long    sxFakeFreqHz(const SxFakeChip& c);
+bool    sxFakeImplicit(const SxFakeChip& c);
+
+void sxFakeFinishTx(SxFakeChip& c);             // TX_DONE: back to standby, DIO0 if mapped
+void sxFakeSetRssi(SxFakeChip& c, int dbm);     // what carrier sense reads
+
+// A frame arriving at the antenna. Taken only in RX continuous; an implicit-
+// header receiver takes exactly PAYLOAD_LENGTH bytes. False if not received.
+bool sxFakeDeliver(SxFakeChip& c, const uint8_t* buf, uint8_t len, bool implicitHeader,
+                   int rssiDbm, int8_t snrQ4, int32_t feiRaw, bool crcOk = true);
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// ----- Trace dump -> Chrome trace JSON -----
+// trace2json [-o out.json] [dump...]
+// Reads what the serial "trace" command prints (trace.h), from a board's serial
+// capture or from a simulator log (lines prefixed "<time> [node] "), stdin if no
+// file is given. Every node, or every input file without node prefixes, becomes
+// one process with two lanes: the CPU (nested B/E spans) and the radio (time on
+// air). Open the result in chrome://tracing or ui.perfetto.dev.
+//
+// A later dump of the same node replaces the earlier one. micros() wrapping is
+// undone per node. Boards' clocks are unrelated, so only nodes of one
+// simulator run (one virtual clock) line up with each other.
+
+struct Ev {
+  uint64_t    us;
+  char        ph;
+  std::string name;
+  unsigned    arg;
+};
+
+struct Node {
+  std::vector<Ev> evs;
+  uint64_t        lastUs = 0;
+  uint64_t        wraps = 0;
+};
+
+static std::map<int, Node> nodes;
+
+static void readDump(FILE* f, int fileIdx){
+  char line[512];
+  while (fgets(line, sizeof(line), f)){
+    int pid = fileIdx;
+    const char* p = line;
+    const char* br = strchr(line, '[');
+    if (br){                                        // simulator log: "  8850.178 [1] ..."
+      int n; char close;
+      if (sscanf(br, "[%d%c", &n, &close) == 2 && close == ']'){ pid = n; p = br + strcspn(br, "]") + 1; }
+    }
+    while (*p == ' ') p++;
+
+    if (!strncmp(p, "trace ", 6) && strstr(p, " events")){ nodes[pid] = Node(); continue; }
+
+    unsigned long us; char ph; char name[32]; unsigned arg;
+    if (sscanf(p, "T %lu %c %31s %u", &us, &ph, name, &arg) != 4) continue;
+    Node& nd = nodes[pid];
+    uint64_t t = nd.wraps + us;
+    if (!nd.evs.empty() && t + (1ull << 31) < nd.lastUs){ nd.wraps += 1ull << 32; t += 1ull << 32; }
+    nd.lastUs = t;
+    nd.evs.push_back(Ev{ t, ph, name, arg });
+  }
+}
+
+static void jsonEvent(FILE* o, bool& first, const char* body){
+  fprintf(o, "%s\n  %s", first ? "" : ",", body);
+  first = false;
+}
+
+int main(int argc, char** argv){
+  const char* outPath = nullptr;
+  std::vector<const char*> inputs;
+  for (int i=1;i<argc;i++){
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) outPath = argv[++i];
+    else if (argv[i][0] == '-' && argv[i][1]){ fprintf(stderr, "usage: %s [-o out.json] [dump...]\n", argv[0]); return 2; }
+    else inputs.push_back(argv[i]);
+  }
+  if (inputs.empty()) readDump(stdin, 0);
+  for (size_t i=0;i<inputs.size();i++){
+    FILE* f = fopen(inputs[i], "r");
+    if (!f){ perror(inputs[i]); return 1; }
+    readDump(f, (int)i);
+    fclose(f);
+  }
+
+  FILE* o = outPath ? fopen(outPath, "w") : stdout;
+  if (!o){ perror(outPath); return 1; }
+  fprintf(o, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  bool first = true;
+  char buf[256];
+  size_t total = 0, dropped = 0;
+  for (auto& kv : nodes){
+    int pid = kv.first;
+    snprintf(buf, sizeof(buf), "{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":\"node %d\"}}", pid, pid);
+    jsonEvent(o, first, buf);
+    snprintf(buf, sizeof(buf), "{\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"name\":\"thread_name\",\"args\":{\"name\":\"cpu\"}}", pid);
+    jsonEvent(o, first, buf);
+    snprintf(buf, sizeof(buf), "{\"ph\":\"M\",\"pid\":%d,\"tid\":2,\"name\":\"thread_name\",\"args\":{\"name\":\"radio\"}}", pid);
+    jsonEvent(o, first, buf);
+
+    std::vector<const Ev*> open;                  // B/E must nest; the ring may start mid-span
+    for (const Ev& e : kv.second.evs){
+      if (e.ph == 'E'){
+        if (open.empty() || open.back()->name != e.name){ dropped++; continue; }
+        open.pop_back();
+      }
+      if (e.ph == 'B') open.push_back(&e);
+      char args[64];
+      if ((e.name == "key" || e.name == "t9") && e.arg >= 32 && e.arg < 127)
+        snprintf(args, sizeof(args), "{\"arg\":%u,\"char\":\"%s%c\"}", e.arg, e.arg == '"' || e.arg == '\\' ? "\\" : "", (char)e.arg);
+      else snprintf(args, sizeof(args), "{\"arg\":%u}", e.arg);
+      if (e.ph == 'X')
+        snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%u,\"pid\":%d,\"tid\":2,\"args\":%s}",
+                 e.name.c_str(), (unsigned long long)e.us, e.arg * 1000, pid, args);
+      else
+        snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":1,\"args\":%s}",
+                 e.name.c_str(), e.ph, (unsigned long long)e.us, pid, args);
+      jsonEvent(o, first, buf);
+      total++;
+    }
+  }
+  fprintf(o, "\n]}\n");
+  if (outPath) fclose(o);
+  fprintf(stderr, "%zu events from %zu node(s)", total, nodes.size());
+  if (dropped) fprintf(stderr, ", %zu unmatched ends dropped", dropped);
+  fprintf(stderr, "\n");
+  return 0;
+}
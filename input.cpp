@@ -4,7 +4,9 @@
 #include "ui.h"
 #include "storage.h"
 #include "protocol.h"
+#include "outbox.h"
 #include "buzz.h"
+#include "trace.h"
 
 // Keypad wiring (adjust to your board pins)
 static const byte ROWS = 4, COLS = 4;
@@ -45,15 +47,20 @@ void storageContactsSelSet(int v){
   contactsSel = v;
 }
 
-// ----- Config menu selection (wraps 0..2) -----
+// ----- Config menu selection (wraps 0..5) -----
 static int configSel = 0;
-static constexpr int CONFIG_ITEMS = 3;
+static constexpr int CONFIG_ITEMS = 6;
 
 int  configSelGet(){ return configSel; }
 void configSelSet(int v){
   configSel = (v % CONFIG_ITEMS + CONFIG_ITEMS) % CONFIG_ITEMS;
 }
 
+// ----- Diagnostics scroll (first row, keeps a full screen of 4) -----
+static int metricsScroll = 0;
+int  metricsScrollGet(){ return metricsScroll; }
+void metricsScrollSet(int v){ metricsScroll = constrain(v, 0, max(0, uiDiagRowCount() - 4)); }
+
 // ----- Confirm dialog selection: 0=No, 1=Yes -----
 static int confirmSel = 0;
 int  confirmSelGet(){ return confirmSel; }
@@ -86,6 +93,7 @@ static void t9ToggleUpper(){ t9Uppercase = !t9Uppercase; if (t9Uppercase) t9Numb
 static void t9ToggleNumbers(){ t9Numbers = !t9Numbers; lastDigit=0; if (t9Numbers) t9Uppercase=false; }
 
 static void t9HandleDigit(char d, int maxLen){
+  TRACE_SPAN(TR_T9, d);
   uint32_t now = millis();
 
   // Numbers mode: digits go in directly (respect maxLen)
@@ -135,6 +143,7 @@ static void t9HandleDigit(char d, int maxLen){
 void inputPoll(){
   char k = keypad.getKey();
   if (!k) return;
+  TRACE_SPAN(TR_KEY, k);               // everything the key sets off, sends included
 
   if (page == PAGE_NAME){
     if (k=='E'){
@@ -203,6 +212,22 @@ void inputPoll(){
         page = PAGE_CONTACTS;
         uiDrawContacts();
         return;
+      } else if (sel == 2){
+        // Relay on/off (toggles in place)
+        storageSetRelayEnabled(!storageRelayEnabled());
+        uiDrawConfig();
+        return;
+      } else if (sel == 3){
+        // TDMA on/off
+        storageSetTdmaEnabled(!storageTdmaEnabled());
+        uiDrawConfig();
+        return;
+      } else if (sel == 4){
+        // Diagnostics
+        metricsScrollSet(0);
+        page = PAGE_METRICS;
+        uiDrawMetrics();
+        return;
       } else {
         // Factory reset
         confirmSelSet(0);       // default to "No"
@@ -214,6 +239,13 @@ void inputPoll(){
     return;
   }
 
+  if (page == PAGE_METRICS){
+    if (k=='U'){ metricsScrollSet(metricsScrollGet()-1); uiDrawMetrics(); return; }
+    if (k=='D'){ metricsScrollSet(metricsScrollGet()+1); uiDrawMetrics(); return; }
+    if (k=='X'){ page = PAGE_CONFIG; uiDrawConfig(); return; }
+    return;
+  }
+
   if (page == PAGE_CONFIRM_RESET){
     if (k=='U' || k=='D'){ confirmSelToggle(); uiDrawConfirmReset(); return; } // toggle Yes/No
     if (k=='X'){ // ESC = cancel
@@ -225,6 +257,7 @@ void inputPoll(){
       if (confirmSelGet() == 1){
         // YES -> wipe and go to name entry
         storageFactoryReset();      // keeps your 3 methods available
+        outboxClear();
         uiEnterBootPage();          // your existing helper that shows name screen
       } else {
         // NO -> back to config
@@ -250,7 +283,7 @@ void inputPoll(){
       uint32_t code6 = (uint32_t)random(100000, 1000000);
 
       // send request + show our code
-      protocolSendInviteRequest(toId, code6);
+      protocolSendInviteRequest(toId, g_disc[searchSelGet()].node, code6);
       uiShowInviteCode(toId, code6);
 
       page = PAGE_INVITE_CODE;
@@ -297,13 +330,7 @@ void inputPoll(){
       uint32_t code = (uint32_t)s.toInt();
 
       if (code == inviterCodeExpected){
-        // add contact (by Contact&)
-        Contact c{};
-        c.id = inviterId;
-        strlcpy(c.name, inviterName, sizeof(c.name));
-        storageAddContact(c);
-
-        // notify inviter
+        // add contact with the negotiated pair addresses + notify inviter
         protocolSendInviteAccept(inviterId, code);
 
         // done
@@ -350,7 +377,7 @@ void inputPoll(){
   }
 
   if (page == PAGE_BROADCAST){
-    if (k>='1' && k<='9'){ t9HandleDigit(k, CHAT_MSG_MAX_LEN); uiDrawChat(); return; }
+    if (k>='1' && k<='9'){ t9HandleDigit(k, BROADCAST_MSG_MAX_LEN); uiDrawChat(); return; }
     if (k=='0'){ if (t9Numbers) composeBuffer+='0'; else t9InsertSpace(); uiDrawChat(); return; }
     if (k=='*'){ t9ToggleUpper(); uiDrawChat(); return; }
     if (k=='#'){ t9ToggleNumbers(); uiDrawChat(); return; }
@@ -24,5 +24,9 @@ int  confirmSelGet();
 void confirmSelSet(int v);
 void confirmSelToggle();
 
+// Diagnostics page: first metrics row shown
+int  metricsScrollGet();
+void metricsScrollSet(int v);
+
 int  searchSelGet();
 void searchSelSet(int v);
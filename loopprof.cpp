@@ -0,0 +1,119 @@
+#include "loopprof.h"
+
+#if LOOP_PROF
+#include "metrics.h"
+#include "ui.h"
+
+static const uint32_t CYCLES_PER_US   = 240;
+static const uint8_t  LOOP_HIST_SHIFT = 8;        // <256 us .. <16 ms, >= 16 ms
+static const uint16_t ALARM_PRINT_MS  = 1000;     // at most one alarm line per second
+
+// [LS_COUNT] is the whole iteration
+static const char* const STAGE_NAMES[LS_COUNT + 1] = {
+  "protocolPoll", "searchTick", "inputPoll", "buzzTick", "vibTick", "uiTick", "console", "loop"
+};
+static const char* const ROW_NAMES[LS_COUNT + 1] = {
+  "loop.poll", "loop.search", "loop.input", "loop.buzz", "loop.vib", "loop.ui", "loop.console", "loop"
+};
+
+struct StageStats {
+  HistValue h;                           // us
+  uint32_t  minUs;
+  uint64_t  sumUs;                       // h.sum wraps after ~70 min in a stage
+};
+static StageStats stats[LS_COUNT + 1];
+
+uint32_t loopProfStart = 0, loopProfCycles[LS_COUNT];
+
+// Slowest iteration since the last reset
+static uint32_t worstUs = 0, worstAtMs = 0;
+static uint32_t worstStageUs[LS_COUNT];
+static uint8_t  worstPage = 0;
+
+static uint16_t alarmMs = LOOP_ALARM_MS;
+static uint32_t alarms = 0, alarmsUnprinted = 0, alarmPrintMs = 0;
+
+static void record(StageStats& s, uint32_t us){
+  if (s.h.count == 0 || us < s.minUs) s.minUs = us;
+  s.sumUs += us;
+  histAdd(s.h, us, LOOP_HIST_SHIFT);
+}
+
+static void printStages(const uint32_t* us){
+  for (int i=0;i<LS_COUNT;i++) if (us[i]) Serial.printf(" %s %lu", STAGE_NAMES[i], (unsigned long)us[i]);
+  Serial.printf(" us\n");
+}
+
+void loopProfEnd(){
+  uint32_t totalUs = (ESP.getCycleCount() - loopProfStart) / CYCLES_PER_US;
+  uint32_t us[LS_COUNT];
+  for (int i=0;i<LS_COUNT;i++){
+    us[i] = loopProfCycles[i] / CYCLES_PER_US;
+    record(stats[i], us[i]);
+  }
+  record(stats[LS_COUNT], totalUs);
+
+  if (totalUs > worstUs){
+    worstUs = totalUs;
+    worstAtMs = millis();
+    worstPage = page;
+    memcpy(worstStageUs, us, sizeof(us));
+  }
+
+  if (alarmMs == 0 || totalUs < alarmMs * 1000UL) return;
+  alarms++;
+  uint32_t now = millis();
+  if (alarmPrintMs && now - alarmPrintMs < ALARM_PRINT_MS){ alarmsUnprinted++; return; }
+  alarmPrintMs = now;
+  Serial.printf("loop: %lu ms at %lu ms, page %u", (unsigned long)(totalUs / 1000), (unsigned long)now, page);
+  if (alarmsUnprinted) Serial.printf(" (+%lu not shown)", (unsigned long)alarmsUnprinted);
+  Serial.printf(":");
+  printStages(us);
+  alarmsUnprinted = 0;
+}
+
+void loopProfReset(){
+  memset(stats, 0, sizeof(stats));
+  worstUs = 0;
+  alarms = alarmsUnprinted = 0;
+}
+
+void loopProfSetAlarmMs(uint16_t ms){ alarmMs = ms; }
+
+void loopProfDump(){
+  Serial.printf("loop %lu iterations, %lu over %u ms\n",
+                (unsigned long)stats[LS_COUNT].h.count, (unsigned long)alarms, alarmMs);
+  Serial.printf("%-12s %8s %8s %8s us\n", "stage", "min", "avg", "max");
+  for (int i=0;i<=LS_COUNT;i++){
+    const StageStats& s = stats[i];
+    unsigned long avg = s.h.count ? (unsigned long)(s.sumUs / s.h.count) : 0;
+    Serial.printf("%-12s %8lu %8lu %8lu\n", STAGE_NAMES[i], (unsigned long)s.minUs, avg, (unsigned long)s.h.max);
+  }
+  for (int i=0;i<=LS_COUNT;i++) histDump(STAGE_NAMES[i], stats[i].h, LOOP_HIST_SHIFT);
+  if (worstUs){
+    Serial.printf("worst %lu us at %lu ms, page %u:", (unsigned long)worstUs, (unsigned long)worstAtMs, worstPage);
+    printStages(worstStageUs);
+  }
+}
+
+// stages and the whole loop as avg/max us, then the alarm count and the worst iteration
+int loopProfRowCount(){ return LS_COUNT + 3; }
+
+void loopProfRow(int i, const char*& name, char* value, size_t n){
+  if (i <= LS_COUNT){
+    const StageStats& s = stats[i];
+    name = ROW_NAMES[i];
+    if (s.h.count == 0) snprintf(value, n, "-");
+    else snprintf(value, n, "%lu/%lu", (unsigned long)(s.sumUs / s.h.count), (unsigned long)s.h.max);
+  } else if (i == LS_COUNT + 1){
+    name = "loop.alarms";
+    snprintf(value, n, "%lu >%ums", (unsigned long)alarms, alarmMs);
+  } else {
+    name = "loop.worst";
+    int top = 0;
+    for (int k=1;k<LS_COUNT;k++) if (worstStageUs[k] > worstStageUs[top]) top = k;
+    if (worstUs == 0) snprintf(value, n, "-");
+    else snprintf(value, n, "%lums %s", (unsigned long)(worstUs / 1000), ROW_NAMES[top] + 5);
+  }
+}
+#endif
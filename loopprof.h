@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- loop() stage profiler -----
+// Each call in loop() is bracketed by the CPU cycle counter (ESP.getCycleCount,
+// 240 per us; wraps after ~17 s, longer stages read short). Per stage and for
+// the whole iteration: min/avg/max and a histogram (metrics.h format, us), the
+// slowest iteration with every stage's share, and an alarm line on Serial for
+// any iteration over the threshold. Read out on the Diagnostics page and with
+// the serial "loop" command (console.h).
+// Build with LOOP_PROF 0 and LOOP_STAGE is the bare call, the rest empty.
+#ifndef LOOP_PROF
+#define LOOP_PROF 1
+#endif
+
+enum LoopStage : uint8_t { LS_PROTOCOL, LS_SEARCH, LS_INPUT, LS_BUZZ, LS_VIB, LS_UI, LS_CONSOLE, LS_COUNT };
+
+static const uint16_t LOOP_ALARM_MS = 100;     // default threshold, "loop alarm <ms>" changes it
+
+#if LOOP_PROF
+extern uint32_t loopProfStart, loopProfCycles[LS_COUNT];
+
+#define LOOP_BEGIN() (loopProfStart = ESP.getCycleCount())
+#define LOOP_STAGE(s, call) do { uint32_t c0_ = ESP.getCycleCount(); call; loopProfCycles[s] = ESP.getCycleCount() - c0_; } while (0)
+#define LOOP_END() loopProfEnd()
+
+void loopProfEnd();                      // folds this iteration's stage times in
+void loopProfReset();
+void loopProfSetAlarmMs(uint16_t ms);    // 0 = off
+void loopProfDump();
+
+// Diagnostics page rows
+int  loopProfRowCount();
+void loopProfRow(int i, const char*& name, char* value, size_t n);
+#else
+#define LOOP_BEGIN() ((void)0)
+#define LOOP_STAGE(s, call) call
+#define LOOP_END() ((void)0)
+
+static inline void loopProfReset(){}
+static inline void loopProfSetAlarmMs(uint16_t){}
+static inline void loopProfDump(){ Serial.printf("loop profiling compiled out (LOOP_PROF 0)\n"); }
+static inline int  loopProfRowCount(){ return 0; }
+static inline void loopProfRow(int, const char*&, char*, size_t){}
+#endif
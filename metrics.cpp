@@ -0,0 +1,77 @@
+#include "metrics.h"
+
+uint32_t   metricCounters[MC_COUNT];
+GaugeValue metricGauges[MG_COUNT] = {
+  { 0, INT32_MIN }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }
+};
+HistValue  metricHists[MH_COUNT];
+
+static const char* const COUNTER_NAMES[MC_COUNT] = {
+  "rx.ok", "rx.malformed", "rx.phy_crc", "rx.ctrl_bad", "rx.no_buffer", "rx.echo", "rx.copy",
+  "rx.not_for_me", "rx.no_route", "rx.bad_mac", "tx.frames", "tx.fail",
+  "msg.delivered", "msg.unreached", "msg.refused", "mesh.relayed", "mesh.cancelled",
+  "replay.accepted", "replay.dup", "replay.stale"
+};
+static const char* const GAUGE_NAMES[MG_COUNT] = {
+  "rx.rssi", "q.frame_pool", "q.relay", "q.outbox", "q.chat_log"
+};
+static const char* const HIST_NAMES[MH_COUNT] = {
+  "ack_rtt_ms", "retries", "tx.air_ms", "ui.flush_us"
+};
+static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == MC_COUNT, "COUNTER_NAMES");
+static_assert(sizeof(GAUGE_NAMES) / sizeof(GAUGE_NAMES[0]) == MG_COUNT, "GAUGE_NAMES");
+static_assert(sizeof(HIST_NAMES) / sizeof(HIST_NAMES[0]) == MH_COUNT, "HIST_NAMES");
+
+void metricsReset(){
+  memset(metricCounters, 0, sizeof(metricCounters));
+  for (int g=0;g<MG_COUNT;g++)
+    if (metricGauges[g].max != INT32_MIN) metricGauges[g].max = metricGauges[g].now;
+  memset(metricHists, 0, sizeof(metricHists));
+}
+
+const char* metricCounterName(uint8_t c){ return c < MC_COUNT ? COUNTER_NAMES[c] : "?"; }
+
+int metricsRowCount(){ return MC_COUNT + MG_COUNT + MH_COUNT; }
+
+void metricsRow(int i, const char*& name, char* value, size_t n){
+  if (i < MC_COUNT){
+    name = COUNTER_NAMES[i];
+    snprintf(value, n, "%lu", (unsigned long)metricCounters[i]);
+    return;
+  }
+  i -= MC_COUNT;
+  if (i < MG_COUNT){
+    const GaugeValue& g = metricGauges[i];
+    name = GAUGE_NAMES[i];
+    if (g.max == INT32_MIN) snprintf(value, n, "-");
+    else snprintf(value, n, "%ld ^%ld", (long)g.now, (long)g.max);
+    return;
+  }
+  i -= MG_COUNT;
+  const HistValue& h = metricHists[i];
+  name = HIST_NAMES[i];
+  if (h.count == 0) snprintf(value, n, "-");
+  else snprintf(value, n, "%lu/%lu/%lu", (unsigned long)h.count, (unsigned long)(h.sum / h.count), (unsigned long)h.max);
+}
+
+// counters: name value / gauges: name now max /
+// histograms: name count sum max, then "<edge:count" per bucket
+void metricsDump(){
+  Serial.printf("metrics %lu ms\n", (unsigned long)millis());
+  for (int i=0;i<MC_COUNT;i++) Serial.printf("%s %lu\n", COUNTER_NAMES[i], (unsigned long)metricCounters[i]);
+  for (int i=0;i<MG_COUNT;i++){
+    const GaugeValue& g = metricGauges[i];
+    if (g.max == INT32_MIN) Serial.printf("%s -\n", GAUGE_NAMES[i]);
+    else Serial.printf("%s %ld %ld\n", GAUGE_NAMES[i], (long)g.now, (long)g.max);
+  }
+  for (int i=0;i<MH_COUNT;i++) histDump(HIST_NAMES[i], metricHists[i], METRIC_HIST_SHIFT[i]);
+}
+
+void histDump(const char* name, const HistValue& h, uint8_t shift){
+  Serial.printf("%s %lu %lu %lu", name, (unsigned long)h.count, (unsigned long)h.sum, (unsigned long)h.max);
+  for (int b=0;b<METRIC_BUCKETS;b++){
+    if (b < METRIC_BUCKETS - 1) Serial.printf(" <%lu:%lu", 1UL << (shift + b), (unsigned long)h.bucket[b]);
+    else Serial.printf(" +:%lu", (unsigned long)h.bucket[b]);
+  }
+  Serial.printf("\n");
+}
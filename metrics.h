@@ -0,0 +1,90 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Metrics registry -----
+// Counters, gauges and histograms with a fixed set of ids, all in static
+// arrays: recording is an indexed add (histograms: a shift and a clz), no
+// lookups, no locks. Names and units live in metrics.cpp, which formats them
+// for the Diagnostics page and the serial "metrics" command (console.h).
+enum MetricCounter : uint8_t {
+  // every frame the radio handed over ends in exactly one of these
+  MC_RX_OK,           // dispatched to its handler
+  MC_RX_MALFORMED,    // shorter than a Packet, or its crc8 doesn't match
+  MC_RX_PHY_CRC,      // dropped by the PHY CRC, never handed over (radio.cpp)
+  MC_RX_CTRL_BAD,     // control frame: bad CRC or not for us
+  MC_RX_NO_BUFFER,    // frame pool exhausted (all buffers queued for relay)
+  MC_RX_ECHO,         // our own frame relayed back
+  MC_RX_COPY,         // mesh copy of a frame seen already
+  MC_RX_NOT_FOR_ME,   // addressed elsewhere (considered for relay)
+  MC_RX_NO_ROUTE,     // no handler for the type, or the wrong addressing for it
+  // later, inside handlers
+  MC_RX_BAD_MAC,      // sealed body failed its link tag
+  MC_TX_FRAMES,
+  MC_TX_FAIL,         // radio refused the frame
+  MC_MSG_DELIVERED,   // direct messages by outcome
+  MC_MSG_UNREACHED,
+  MC_MSG_REFUSED,
+  MC_MESH_RELAYED,    // rebroadcasts sent
+  MC_MESH_CANCELLED,  // pending rebroadcasts dropped: enough copies overheard
+  MC_REPLAY_ACCEPTED, // anti-replay window (DATA and long messages), after the tag
+  MC_REPLAY_DUP,      // already inside the window: re-ACKed, not decrypted
+  MC_REPLAY_STALE,    // older than the window: dropped
+  MC_COUNT
+};
+
+enum MetricGauge : uint8_t {
+  MG_RX_RSSI,         // last frame (max: strongest)
+  MG_FRAME_POOL,      // RX buffers in use
+  MG_RELAY_QUEUE,
+  MG_OUTBOX,
+  MG_CHAT_LOG,
+  MG_COUNT
+};
+
+enum MetricHist : uint8_t {
+  MH_ACK_RTT_MS,      // first-try DATA -> ACK
+  MH_RETRIES,         // per direct message, 0 = first try
+  MH_TX_AIR_MS,       // per frame sent
+  MH_FLUSH_US,        // display push
+  MH_COUNT
+};
+
+// Bucket b < 7 holds values below 2^(shift+b), bucket 7 the rest.
+static const uint8_t METRIC_BUCKETS = 8;
+static constexpr uint8_t METRIC_HIST_SHIFT[MH_COUNT] = { 5, 0, 5, 10 };
+
+struct GaugeValue { int32_t now, max; };
+struct HistValue  { uint32_t count, sum, max; uint32_t bucket[METRIC_BUCKETS]; };
+
+extern uint32_t   metricCounters[MC_COUNT];
+extern GaugeValue metricGauges[MG_COUNT];
+extern HistValue  metricHists[MH_COUNT];
+
+static inline void metricInc(MetricCounter c){ metricCounters[c]++; }
+
+static inline void metricSet(MetricGauge g, int32_t v){
+  GaugeValue& x = metricGauges[g];
+  x.now = v;
+  if (v > x.max) x.max = v;
+}
+
+static inline void histAdd(HistValue& x, uint32_t v, uint8_t shift){
+  uint32_t top = v >> shift;
+  uint8_t b = top ? (uint8_t)min(32 - __builtin_clz(top), (int)METRIC_BUCKETS - 1) : 0;
+  x.bucket[b]++;
+  x.count++;
+  x.sum += v;
+  if (v > x.max) x.max = v;
+}
+
+static inline void metricObserve(MetricHist h, uint32_t v){ histAdd(metricHists[h], v, METRIC_HIST_SHIFT[h]); }
+
+void metricsReset();
+const char* metricCounterName(uint8_t c);   // "?" out of range
+
+// Flat list for display: counters, then gauges, then histograms
+int  metricsRowCount();
+void metricsRow(int i, const char*& name, char* value, size_t n);
+
+void metricsDump();                      // everything, with buckets, to Serial
+void histDump(const char* name, const HistValue& h, uint8_t shift);   // one line, metricsDump format
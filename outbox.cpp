@@ -0,0 +1,121 @@
+#include "outbox.h"
+#include <Preferences.h>
+
+static Preferences prefs;
+static OutboxEntry q[OUTBOX_MAX];
+static uint32_t addClock = 0;      // insertion order, so flushes keep message order
+static uint32_t order[OUTBOX_MAX];
+static uint32_t lastSaveMs = 0;
+
+// Flash blob per slot: peer, seq(2), ttl minutes left(2), text (no NUL)
+static void keyFor(int i, char* k){ snprintf(k, 4, "e%d", i); }
+
+static void saveSlot(int i, uint32_t now){
+  char k[4]; keyFor(i, k);
+  if (!q[i].used){ prefs.remove(k); return; }
+  uint8_t buf[5 + CHAT_MSG_MAX_LEN];
+  size_t n = strlen(q[i].text);
+  int32_t left = (int32_t)(q[i].expiresMs - now);
+  uint16_t ttlMin = left > 0 ? (uint16_t)min((uint32_t)0xFFFF, (uint32_t)left / 60000 + 1) : 0;
+  buf[0] = q[i].peer;
+  buf[1] = (uint8_t)(q[i].seq >> 8);  buf[2] = (uint8_t)q[i].seq;
+  buf[3] = (uint8_t)(ttlMin >> 8);    buf[4] = (uint8_t)ttlMin;
+  memcpy(buf + 5, q[i].text, n);
+  prefs.putBytes(k, buf, 5 + n);
+}
+
+void outboxInit(){
+  uint32_t now = millis();
+  prefs.begin("outbox", false);
+  for (int i=0;i<OUTBOX_MAX;i++){
+    char k[4]; keyFor(i, k);
+    q[i].used = false;
+    uint8_t buf[5 + CHAT_MSG_MAX_LEN];
+    size_t n = prefs.isKey(k) ? prefs.getBytes(k, buf, sizeof(buf)) : 0;
+    if (n < 5) continue;
+    q[i].used = true;
+    q[i].peer = buf[0];
+    q[i].seq  = (uint16_t)(buf[1] << 8 | buf[2]);
+    q[i].expiresMs = now + ((uint32_t)(buf[3] << 8 | buf[4])) * 60000UL;
+    memcpy(q[i].text, buf + 5, n - 5);
+    q[i].text[n - 5] = 0;
+    order[i] = q[i].seq;            // restored entries: seq order is close enough
+    if (order[i] >= addClock) addClock = order[i] + 1;
+  }
+  prefs.end();
+  lastSaveMs = now;
+}
+
+void outboxTick(uint32_t now){
+  if (now - lastSaveMs < OUTBOX_SAVE_MS) return;
+  lastSaveMs = now;
+  if (outboxCount() == 0) return;
+  prefs.begin("outbox", false);
+  for (int i=0;i<OUTBOX_MAX;i++) if (q[i].used) saveSlot(i, now);
+  prefs.end();
+}
+
+bool outboxAdd(uint8_t peer, uint16_t seq, const char* text){
+  int i = outboxFindSeq(peer, seq);
+  if (i < 0) for (i=0;i<OUTBOX_MAX && q[i].used;i++) {}
+  if (i >= OUTBOX_MAX) return false;
+  uint32_t now = millis();
+  q[i].used = true;
+  q[i].peer = peer;
+  q[i].seq  = seq;
+  q[i].expiresMs = now + OUTBOX_TTL_MIN * 60000UL;
+  strlcpy(q[i].text, text, sizeof(q[i].text));
+  order[i] = addClock++;
+  prefs.begin("outbox", false);
+  saveSlot(i, now);
+  prefs.end();
+  return true;
+}
+
+int outboxFind(uint8_t peer){
+  int best = -1;
+  for (int i=0;i<OUTBOX_MAX;i++)
+    if (q[i].used && q[i].peer==peer && (best<0 || order[i] < order[best])) best = i;
+  return best;
+}
+
+int outboxFindSeq(uint8_t peer, uint16_t seq){
+  for (int i=0;i<OUTBOX_MAX;i++) if (q[i].used && q[i].peer==peer && q[i].seq==seq) return i;
+  return -1;
+}
+
+int outboxExpired(uint32_t now){
+  for (int i=0;i<OUTBOX_MAX;i++) if (q[i].used && (int32_t)(now - q[i].expiresMs) >= 0) return i;
+  return -1;
+}
+
+const OutboxEntry& outboxAt(int i){ return q[i]; }
+
+void outboxSetSeq(int i, uint16_t seq){
+  if (i<0 || i>=OUTBOX_MAX || !q[i].used) return;
+  q[i].seq = seq;
+  prefs.begin("outbox", false);
+  saveSlot(i, millis());
+  prefs.end();
+}
+
+void outboxRemoveAt(int i){
+  if (i<0 || i>=OUTBOX_MAX || !q[i].used) return;
+  q[i].used = false;
+  prefs.begin("outbox", false);
+  saveSlot(i, millis());
+  prefs.end();
+}
+
+int outboxCount(){
+  int n = 0;
+  for (int i=0;i<OUTBOX_MAX;i++) if (q[i].used) n++;
+  return n;
+}
+
+void outboxClear(){
+  for (int i=0;i<OUTBOX_MAX;i++) q[i].used = false;
+  prefs.begin("outbox", false);
+  prefs.clear();
+  prefs.end();
+}
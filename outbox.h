@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+#include "ui.h"
+
+// Persistent store-and-forward queue: chat messages a contact didn't ACK wait
+// here (in flash, namespace "outbox") until that contact is heard again.
+// Expiry counts powered-on time only; the board has no wall clock.
+static const int      OUTBOX_MAX     = 8;                  // whole queue, all contacts
+static const uint32_t OUTBOX_TTL_MIN = 24 * 60;            // one day of uptime
+static const uint32_t OUTBOX_SAVE_MS = 30UL * 60 * 1000;   // refresh stored TTLs this often
+
+struct OutboxEntry {
+  bool     used;
+  uint8_t  peer;
+  uint16_t seq;
+  uint32_t expiresMs;
+  char     text[CHAT_MSG_MAX_LEN + 1];
+};
+
+void outboxInit();                           // load from flash
+void outboxTick(uint32_t now);               // periodic TTL refresh in flash
+bool outboxAdd(uint8_t peer, uint16_t seq, const char* text);   // false if full
+int  outboxFind(uint8_t peer);               // oldest entry for peer, -1 if none
+int  outboxFindSeq(uint8_t peer, uint16_t seq);
+int  outboxExpired(uint32_t now);            // any expired entry, -1 if none
+const OutboxEntry& outboxAt(int i);
+void outboxSetSeq(int i, uint16_t seq);     // resent under a new seq (stays in order)
+void outboxRemoveAt(int i);
+int  outboxCount();
+void outboxClear();
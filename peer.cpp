@@ -0,0 +1,53 @@
+#include "peer.h"
+#include "storage.h"
+
+static PeerState table[PEER_SLOTS];
+static int count = 0;
+
+static inline int home(uint8_t id){ return (int)((id * 0x9E3779B1u) >> 27) & (PEER_SLOTS - 1); }
+
+PeerState* peerFind(uint8_t id){
+  for (int i=home(id), n=0; n<PEER_SLOTS; i=(i+1)&(PEER_SLOTS-1), n++){
+    if (!table[i].used) return nullptr;
+    if (table[i].id == id) return &table[i];
+  }
+  return nullptr;
+}
+
+static void removeSlot(int i){
+  // backward-shift: pull later members of the probe run into the hole
+  table[i].used = false;
+  count--;
+  for (int j=(i+1)&(PEER_SLOTS-1); table[j].used; j=(j+1)&(PEER_SLOTS-1)){
+    int h = home(table[j].id);
+    bool movable = (i <= j) ? (h <= i || h > j) : (h <= i && h > j);
+    if (movable){ table[i] = table[j]; table[j].used = false; i = j; }
+  }
+}
+
+PeerState* peerTouch(uint8_t id){
+  PeerState* p = peerFind(id);
+  if (p) return p;
+  if (count >= PEER_MAX){
+    int oldest = -1;
+    for (int i=0;i<PEER_SLOTS;i++){
+      if (!table[i].used || storageFindContact(table[i].id) >= 0) continue;   // contacts stay
+      if (oldest<0 || table[i].lastHeardMs < table[oldest].lastHeardMs) oldest = i;
+    }
+    if (oldest >= 0) removeSlot(oldest);
+  }
+  int i = home(id);
+  while (table[i].used) i = (i+1)&(PEER_SLOTS-1);
+  memset(&table[i], 0, sizeof(table[i]));
+  table[i].used = true;
+  table[i].id   = id;
+  table[i].chan = PEER_CHAN_UNKNOWN;
+  count++;
+  return &table[i];
+}
+
+int peerCount(){ return count; }
+
+PeerState* peerAt(int slot){
+  return (slot>=0 && slot<PEER_SLOTS && table[slot].used) ? &table[slot] : nullptr;
+}
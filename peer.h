@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Per-peer state -----
+// One record per node we've heard from, in an open-addressed table (linear
+// probing, backward-shift delete). Capacity is PEER_MAX live records; when
+// full, the non-contact heard least recently is forgotten. Contacts are never
+// evicted, so their replay windows survive a crowd of strangers (at most 10
+// contacts, storage.h). Anything not here reads as defaults: no replay
+// history, direct link, channel unknown.
+static const int     PEER_SLOTS        = 32;                 // power of two
+static const int     PEER_MAX          = PEER_SLOTS * 3 / 4; // keep probes short
+static const uint8_t PEER_CHAN_UNKNOWN = 0xFE;
+
+struct PeerState {
+  bool     used;
+  uint8_t  id;
+  // link
+  uint8_t  hops;          // hops the last frame from it took (mesh relay)
+  uint8_t  chan;          // listen channel it last announced (chan.h)
+  int8_t   rssi;          // of the last frame heard
+  uint32_t lastHeardMs;   // 0 = never
+  uint32_t frames;
+  // anti-replay window over its message seqs
+  bool     replayInit;
+  uint16_t replayTop;
+  uint64_t replayBits;
+  // pairing: last invite request / accept code, to ignore repeats
+  uint32_t inviteReqCode;
+  uint32_t inviteAckCode;
+};
+
+PeerState* peerFind(uint8_t id);       // nullptr if unknown
+PeerState* peerTouch(uint8_t id);      // find or create
+int        peerCount();
+PeerState* peerAt(int slot);           // iterate 0..PEER_SLOTS-1, nullptr for empty slots
@@ -1,16 +1,23 @@
-
 #include "protocol.h"
-#include <SPI.h>
-#if __has_include("lora/LoRa.h")
-  #include "lora/LoRa.h"
-#else
-  #include <LoRa.h>
-#endif
+#include "radio.h"
 #include "ui.h"
 #include "crypto.h"
 #include "buzz.h"
 #include "vib.h"
 #include "input.h"
+#include "frag.h"
+#include "compress.h"
+#include "airtime.h"
+#include "rtt.h"
+#include "outbox.h"
+#include "sync.h"
+#include "chan.h"
+#include "tdma.h"
+#include "peer.h"
+#include "addr.h"
+#include "metrics.h"
+#include "trace.h"
+#include "capture.h"
 
 // ----- LoRa pins / radio config (Heltec WiFi LoRa 32 V2) -----
 #define LORA_SCK   5
@@ -19,26 +26,49 @@
 #define LORA_SS   18
 #define LORA_RST  14
 #define LORA_DIO0 26
-static const long    LORA_BAND       = 915E6;
+static const long    LORA_BAND       = 915E6;   // rendezvous channel (see chan.h)
 static const uint8_t LORA_POWER_DBM  = 14;
+static const uint8_t  LORA_SF        = 7;
+static const uint32_t LORA_BW        = 125E3;
+static const uint8_t  LORA_CR4       = 5;     // coding rate 4/5
+static const uint16_t LORA_PREAMBLE  = 8;
 
-// ----- Device ID (manual for now; set 1 or 2) -----
-#ifndef DEVICE_ID
-#define DEVICE_ID 1
-#endif
-
-uint8_t protocolDeviceId(){ return DEVICE_ID; }
+// Our own messages in the chat log are filed under the primary short (addr.h)
+uint8_t protocolDeviceId(){ return addrSelf(); }
 
 // ----- Packet -----
+// sender/receiver are the end points; relays forward the frame unchanged except
+// for `hops`. `fid` is the sender's per-transmission counter (retries get a new one).
 struct Packet {
   uint8_t  sender;
   uint8_t  receiver;
   uint8_t  type;
+  uint8_t  hops;       // high nibble: hops taken, low nibble: hops left
+  uint8_t  fid;
+  uint8_t  chan;       // channel the sender listens on (chan.h)
   uint16_t seq;
   uint8_t  len;
   char     body[160];
   uint8_t  crc;
 } __attribute__((packed));
+static_assert(sizeof(Packet) == CAPTURE_MAX_LEN, "capture.h: frame size");
+
+// ----- Control frames (ACK / NACK / PONG) -----
+// Fixed 6 bytes, sent in implicit-header mode so they cost ~26 ms instead of a
+// full 170-byte frame. Only a node inside its reply slot listens for them: the
+// slot opens when its own request starts and lasts one retransmission timeout
+// (rtt.h), never less than request airtime + reply airtime + CTRL_TURNAROUND_MS.
+struct CtrlFrame {
+  uint8_t  sender;
+  uint8_t  receiver;
+  uint8_t  type;
+  uint16_t seq;
+  uint8_t  crc;
+} __attribute__((packed));
+static_assert(sizeof(CtrlFrame) == 6, "control frames are 6 bytes on air");
+
+static const uint16_t CTRL_SLOT_MS      = 150;   // reply window for peers without RTT samples
+static const uint16_t CTRL_TURNAROUND_MS = 20;   // fastest a peer can answer after RX done
 
 static uint8_t crc8(const uint8_t* data, size_t len){
   uint8_t c=0;
@@ -49,42 +79,138 @@ static uint8_t crc8(const uint8_t* data, size_t len){
   return c;
 }
 
+static inline void putU32BE(uint8_t* b, uint32_t v){
+  b[0]=uint8_t(v>>24); b[1]=uint8_t(v>>16); b[2]=uint8_t(v>>8); b[3]=uint8_t(v);
+}
+
+static inline uint32_t getU32BE(const uint8_t* b){
+  return (uint32_t)b[0]<<24 | (uint32_t)b[1]<<16 | (uint32_t)b[2]<<8 | (uint32_t)b[3];
+}
+
 DiscEntry g_disc[MAX_DISC];
 int g_discCount = 0;
-
-// Debug send receive msg
-static uint32_t dbg_rxCount = 0;
-static int8_t   dbg_lastRssi = 0;
-static uint8_t  dbg_lastType = 0, dbg_lastFrom = 0, dbg_lastTo = 0;
-static uint8_t  dbg_lastWhy  = 0;  // 0 ok, 1 short, 2 badcrc, 3 not-for-me
+static uint8_t discHeard[ADDR_SET_BYTES];          // every short a discovery frame came from, this search
 
 // ----- Chat storage -----
-static const int MAX_MSGS = 64;
-static ChatMsg chatBuf[MAX_MSGS];
-static int chatCount = 0;
+// Headers sit in a ring (index 0 = oldest). Texts are NUL-terminated in a byte
+// ring: a new message reserves room at the head, evicting the oldest messages
+// in the way, and received text is decoded straight into that room.
+static const int      MAX_MSGS   = 64;
+static const uint16_t CHAT_ARENA = 8192;      // >= 17 full-length messages
+static ChatMsg  chatRing[MAX_MSGS];
+static int      chatFirst = 0, chatCount = 0;
+static char     chatText[CHAT_ARENA];
+static uint16_t textHead = 0;                 // next free byte
+static char*    textPending = nullptr;        // reserved, not committed yet
 static int scrollOffset = 0;
 uint16_t nextSeq = 1;
+static uint16_t seqBlockEnd = 1;     // seqs are reserved in flash a block at a time
+static const uint16_t SEQ_BLOCK = 64;
 static const uint8_t  RETRIES        = 3;
-static const uint16_t ACK_TIMEOUT_MS = 1200;
+static const uint16_t ACK_TIMEOUT_MS = 1200;  // upper bound for the adaptive ACK timeout
+static const size_t   DATA_TEXT_MAX  = 160 - 4 - MAC_LEN;   // packed text that fits one DATA frame (- nonce, tag)
+static_assert(BROADCAST_MSG_MAX_LEN + 1 <= DATA_TEXT_MAX, "a broadcast that doesn't compress must still fit");
+
+// ----- Anti-replay (per sender, right after the link tag, before decryption or UI work) -----
+// IPsec-style window over the sender's message seqs: `top` is the highest seq
+// accepted, bit i of `bits` = seq top-i accepted. Seqs compare in 16-bit
+// serial arithmetic; anything REPLAY_WINDOW or more behind `top` is stale.
+// The window lives in the sender's PeerState (peer.h).
+static const uint8_t REPLAY_WINDOW = 64;
+
+enum ReplayVerdict : uint8_t { RP_NEW, RP_DUP, RP_STALE };
+
+static ReplayVerdict replayCheck(uint8_t from, uint16_t seq){
+  const PeerState* w = peerFind(from);
+  if (!w || !w->replayInit) return RP_NEW;
+  int16_t d = (int16_t)(seq - w->replayTop);
+  if (d > 0) return RP_NEW;
+  if (-d >= REPLAY_WINDOW) return RP_STALE;
+  return ((w->replayBits >> -d) & 1) ? RP_DUP : RP_NEW;
+}
 
-// One slot per possible sender ID (0..255). Zero-init is fine.
-static uint16_t lastSeqSeen[256] = {0};
+static void replayAccept(uint8_t from, uint16_t seq){
+  PeerState* w = peerTouch(from);
+  metricInc(MC_REPLAY_ACCEPTED);
+  if (!w->replayInit){ w->replayInit = true; w->replayTop = seq; w->replayBits = 1; return; }
+  int16_t d = (int16_t)(seq - w->replayTop);
+  if (d > 0){
+    w->replayBits = (d >= REPLAY_WINDOW) ? 1 : ((w->replayBits << d) | 1);
+    w->replayTop = seq;
+  } else w->replayBits |= (uint64_t)1 << -d;
+}
 
-// Optional: also suppress duplicate INV_REQ/ACK repeats by code
-static uint32_t lastInviteReqCode[256] = {0};
-static uint32_t lastInviteAckCode[256] = {0};
+// Counts the rejection; true if the frame must be dropped.
+static bool replayReject(uint8_t from, uint16_t seq, ReplayVerdict& v){
+  v = replayCheck(from, seq);
+  if (v == RP_DUP)   metricInc(MC_REPLAY_DUP);
+  if (v == RP_STALE) metricInc(MC_REPLAY_STALE);
+  return v != RP_NEW;
+}
 
 int  protocolChatCount(){ return chatCount; }
-void protocolGetChat(int idx, ChatMsg& out){ out = chatBuf[idx]; }
+static inline ChatMsg& chatAt(int i){ return chatRing[(chatFirst + i) % MAX_MSGS]; }
+void protocolGetChat(int idx, ChatMsg& out){ out = chatAt(idx); }
 int  protocolScrollOffset(){ return scrollOffset; }
 void protocolScroll(int delta){ if (delta>0) scrollOffset += 1; else if (scrollOffset>0) scrollOffset -= 1; }
 
-static void pushChat(uint8_t from, const String& text, MsgStatus st, uint16_t seq=0){
-  if (chatCount < MAX_MSGS) chatBuf[chatCount++] = {from,text,st,seq};
-  else {
-    for (int i=1;i<MAX_MSGS;i++) chatBuf[i-1]=chatBuf[i];
-    chatBuf[MAX_MSGS-1]={from,text,st,seq};
+static void chatDropOldest(){ chatFirst = (chatFirst + 1) % MAX_MSGS; chatCount--; }
+
+// Room for `cap` bytes (NUL included) of the next message's text.
+static char* chatReserve(uint16_t cap){
+  if (chatCount == MAX_MSGS) chatDropOldest();          // its header slot goes to the new one
+  for (;;){
+    if (chatCount == 0){ textHead = 0; break; }
+    uint16_t tail = (uint16_t)(chatAt(0).text - chatText);
+    if (tail < textHead){                                // live text in [tail, head)
+      if (textHead + cap <= CHAT_ARENA) break;
+      if (cap <= tail){ textHead = 0; break; }           // wrap; the end stays dead until evicted
+    } else if (tail > textHead && textHead + cap <= tail) break;   // wrapped: live in [tail, end) + [0, head)
+    chatDropOldest();
+  }
+  textPending = chatText + textHead;
+  return textPending;
+}
+
+// Files the text written at the last chatReserve() as the newest message.
+static void chatCommit(uint8_t from, MsgStatus st, uint16_t seq, uint8_t peer){
+  size_t n = strlen(textPending);
+  ChatMsg& m = chatRing[(chatFirst + chatCount) % MAX_MSGS];
+  m = {from, textPending, st, seq, peer};
+  chatCount++;
+  textHead = (uint16_t)(textPending - chatText + n + 1);
+  textPending = nullptr;
+}
+
+static void pushChat(uint8_t from, const char* text, MsgStatus st, uint16_t seq, uint8_t peer){
+  size_t n = strnlen(text, CHAT_MSG_MAX_LEN);
+  char* d = chatReserve((uint16_t)(n + 1));
+  memcpy(d, text, n); d[n] = 0;
+  chatCommit(from, st, seq, peer);
+}
+
+static int chatFind(uint8_t from, uint16_t seq, uint8_t peer){
+  for (int i=chatCount-1;i>=0;--i)
+    if (chatAt(i).seq==seq && chatAt(i).from==from && chatAt(i).peer==peer) return i;
+  return -1;
+}
+
+// Message ids must stay unique across reboots (history sync, duplicate checks):
+// the next block is reserved in flash before any seq from it is used.
+static uint16_t takeSeq(){
+  if (nextSeq == seqBlockEnd){
+    nextSeq = storageReserveSeq(SEQ_BLOCK);
+    seqBlockEnd = nextSeq + SEQ_BLOCK;
   }
+  uint16_t s = nextSeq++;
+  return s ? s : takeSeq();          // 0 is "no seq" for sync/control frames
+}
+
+static void setChatStatus(uint16_t seq, MsgStatus st){
+  for (int i=chatCount-1;i>=0;--i) if (chatAt(i).seq==seq && chatAt(i).from==addrSelf()){ chatAt(i).status=st; break; }
+}
+static void setChatSeq(uint16_t seq, uint16_t newSeq){
+  for (int i=chatCount-1;i>=0;--i) if (chatAt(i).seq==seq && chatAt(i).from==addrSelf()){ chatAt(i).seq=newSeq; break; }
 }
 
 // ----- Nearby cache -----
@@ -93,7 +219,7 @@ static int nearbyCount = 0;
 static int nearbySel = 0;
 int  protocolNearbyCount(){ return nearbyCount; }
 NearbyItem protocolNearbyAt(int i){ return nearby[i]; }
-void protocolNearbyClear(){ nearbyCount=0; nearbySel=0; g_discCount = 0; }
+void protocolNearbyClear(){ nearbyCount=0; nearbySel=0; g_discCount = 0; memset(discHeard, 0, sizeof(discHeard)); }
 void protocolNearbyMoveSel(int delta){
   if (nearbyCount==0){ nearbySel=0; return; }
   nearbySel += delta;
@@ -101,7 +227,7 @@ void protocolNearbyMoveSel(int delta){
 }
 int  protocolNearbySel(){ return nearbySel; }
 static void addNearby(uint8_t id, const char* nm){
-  if (id==DEVICE_ID) return;
+  if (id==addrSelf()) return;
   if (storageFindContact(id)>=0) return;
   for (int i=0;i<nearbyCount;i++) if (nearby[i].id==id) return;
   if (nearbyCount<10){ nearby[nearbyCount].id=id; memset(nearby[nearbyCount].name,0,16); strncpy(nearby[nearbyCount].name,nm,15); nearbyCount++; }
@@ -118,51 +244,386 @@ uint8_t  protocolInviteeId(){ return inviteeId; }
 void protocolCancelInvite(){ awaitingAccept=false; }
 const char* protocolLastInviterName(){ return lastInviter; }
 
+// Invite bodies (after the 4-byte code and 20-byte name):
+//   INV_REQ  [24..27] requester's full ID  [28..31] invitee's full ID
+//            [32..63] shorts the requester already uses (addr.h bitmap)
+//            [64..71] requester's key nonce
+//   INV_ACK  [24..27] invitee's full ID    [28] the requester's pair address
+//            [29..36] invitee's key nonce
+// The invitee picks both pair addresses; its accept is sent from its own.
+// Both sides derive the link key from the two names, the code and the two
+// nonces XORed (pairKey).
+static const uint8_t INV_REQ_LEN = 32 + ADDR_SET_BYTES;
+static const uint8_t INV_ACK_LEN = 29;
+static const uint8_t INV_NONCE_LEN = 8;
+static const uint8_t INV_REQ_KEYED_LEN = INV_REQ_LEN + INV_NONCE_LEN;
+static const uint8_t INV_ACK_KEYED_LEN = INV_ACK_LEN + INV_NONCE_LEN;
+static uint8_t  invPeerNonce[INV_NONCE_LEN];   // invitee: the requester's
+static uint32_t inviteeNode = 0;     // requester: full ID of who we invited (0 = unknown)
+static uint8_t  invPeerAddr = 0;     // invitee: what we'll call the requester
+static uint8_t  invSelfAddr = 0;     // invitee: what the requester will call us
+static uint32_t invPeerNode = 0;
+
+// Missing nonces (older peers) count as zeros
+static void pairKey(const String& a, const String& b, uint32_t code6, const uint8_t* n1, const uint8_t* n2, uint8_t key[32]){
+  uint8_t nonce[INV_NONCE_LEN];
+  for (uint8_t i=0;i<INV_NONCE_LEN;i++) nonce[i] = (uint8_t)((n1 ? n1[i] : 0) ^ (n2 ? n2[i] : 0));
+  derivePairKey(a, b, code6, nonce, key);
+}
+
+static void invitePairAddrs(const Packet& r, uint32_t node){
+  invPeerNode = node;
+  if (r.len < INV_REQ_LEN){                 // peer predates pair addresses: keep the primaries
+    invPeerAddr = r.sender; invSelfAddr = addrSelf();
+    return;
+  }
+  uint8_t mine[ADDR_SET_BYTES], theirs[ADDR_SET_BYTES], others[ADDR_SET_BYTES];
+  addrUsed(mine);
+  memcpy(theirs, r.body + 32, ADDR_SET_BYTES);
+  // a side may keep its own primary; it only has to avoid what the other must tell apart
+  memcpy(others, theirs, ADDR_SET_BYTES);
+  others[r.sender >> 3] &= (uint8_t)~(1 << (r.sender & 7));
+  invPeerAddr = addrPick(node, mine, others, r.sender);
+  addrAddSet(theirs, invPeerAddr);
+  mine[addrSelf() >> 3] &= (uint8_t)~(1 << (addrSelf() & 7));
+  addrAddSet(mine, invPeerAddr);
+  invSelfAddr = addrPick(addrNodeId(), mine, theirs, addrSelf());
+}
+
 // ----- Current chat peer -----
 static uint8_t currentPeerId = 0;
 void protocolEnterChat(uint8_t peerId){ currentPeerId = peerId; scrollOffset=0; }
 
 // ----- Radio helpers -----
-static bool sendRaw(const Packet& p){
-  Packet q=p; q.crc=0; q.crc=crc8((const uint8_t*)&q, sizeof(q)-1);
-  LoRa.beginPacket();
-  LoRa.write((const uint8_t*)&q, sizeof(q));
-  bool ok = (LoRa.endPacket(true)==1);
-  LoRa.receive();
-  return ok;
+static uint32_t frameAirMs(uint8_t len, bool implicitHeader){
+  return (loraAirtimeUs(len, LORA_SF, LORA_BW, LORA_CR4, LORA_PREAMBLE, implicitHeader, true) + 999) / 1000;
 }
 
-void protocolSendDiscReq(){
-  Packet p{}; 
-  p.sender = DEVICE_ID;
-  p.receiver = BROADCAST_ID;
-  p.type = TYPE_DISC_REQ;
-  p.seq = 0;
-  // include our name so peers can show us immediately if they want
-  String nm = storageDeviceName(); // your getter for saved name
-  p.len = (uint8_t)min((size_t)20, nm.length());
-  memset(p.body, 0, sizeof(p.body));
-  nm.substring(0,p.len).toCharArray(p.body, p.len+1);
-  p.crc = 0; p.crc = crc8(reinterpret_cast<uint8_t*>(&p), sizeof(p)-1);
+// ----- Send-rate control (AIMD) -----
+// One pacing gap per node for every full frame it originates (beacons, data,
+// retries, fragments). Lost ACKs and a busy channel halve the rate, delivered
+// frames and clear-channel sends grow it back linearly. Control frames answer
+// inside someone else's reply slot and are never paced.
+static const uint16_t CC_RATE_MAX_Q8   = 4 * 256;   // frames/s, Q8
+static const uint16_t CC_RATE_MIN_Q8   = 64;        // 0.25 frames/s
+static const uint16_t CC_AI_Q8         = 32;        // +1/8 frame/s per delivered frame
+static const uint16_t CC_AI_CLEAR_Q8   = 8;         // +1/32 frame/s per clear-channel send
+static const uint16_t CC_MD_HOLD_MS    = 1000;      // at most one halving per second
+static const int      CC_BUSY_RSSI_DBM = -95;       // carrier sense threshold
+static const uint16_t CC_LBT_MAX_MS    = 400;       // longest listen-before-talk deferral
+
+static uint16_t ccRateQ8    = CC_RATE_MAX_Q8;
+static uint32_t ccNextTxMs  = 0;
+static uint32_t ccLastCutMs = 0;
+
+static void ccDecrease(){
+  uint32_t now = millis();
+  if (now - ccLastCutMs < CC_MD_HOLD_MS) return;     // one loss burst = one cut
+  ccLastCutMs = now;
+  ccRateQ8 = max(CC_RATE_MIN_Q8, (uint16_t)(ccRateQ8 / 2));
+}
 
-  sendRaw(p);
+static void ccIncrease(uint16_t step){
+  ccRateQ8 = min(CC_RATE_MAX_Q8, (uint16_t)(ccRateQ8 + step));
 }
 
-static void sendDiscRsp(uint8_t to){
-  Packet p{}; 
-  p.sender = DEVICE_ID;
+static void ccOnSend(){
+  ccNextTxMs = millis() + (256000UL + ccRateQ8 - 1) / ccRateQ8;
+}
+
+static uint32_t ccDeferMs(){
+  int32_t d = (int32_t)(ccNextTxMs - millis());
+  return d > 0 ? (uint32_t)d : 0;
+}
+
+// A data frame plus its ACK, which must both end inside our TDMA slot.
+static uint32_t tdmaNeedMs(){
+  return frameAirMs(sizeof(Packet), false) + frameAirMs(sizeof(CtrlFrame), true) + CTRL_TURNAROUND_MS;
+}
+
+uint32_t protocolTxDeferMs(){
+  uint32_t d = ccDeferMs();
+  if (storageTdmaEnabled()) d = max(d, tdmaDeferMs(millis(), addrSelf(), tdmaNeedMs()));
+  return d;
+}
+
+void protocolTxFeedback(bool delivered){
+  if (delivered) ccIncrease(CC_AI_Q8);
+  else ccDecrease();
+}
+
+// Blocking senders (chat, broadcast) wait out the pacing gap and for their TDMA slot.
+static void ccWaitTurn(){
+  uint32_t d = protocolTxDeferMs();
+  if (d) delay(d);
+}
+
+// Fewer retries while the channel is loaded: RETRIES at full rate, 1 below half.
+static uint8_t ccRetryBudget(){
+  return 1 + (uint8_t)(((uint32_t)(RETRIES - 1) * ccRateQ8) / CC_RATE_MAX_Q8);
+}
+
+// Carrier sense on the instantaneous RSSI; a busy reading counts as congestion.
+static bool channelBusy(){ return radioRssi() > CC_BUSY_RSSI_DBM; }
+
+static void listenBeforeTalk(){
+  TRACE_SPAN(TR_LBT, 0);
+  if (!channelBusy()){ ccIncrease(CC_AI_CLEAR_Q8); return; }
+  ccDecrease();
+  uint32_t t0 = millis();
+  while (channelBusy() && millis() - t0 < CC_LBT_MAX_MS) delay(5);
+}
+
+// ----- Mesh relay (opt-in, storageRelayEnabled) -----
+// Controlled flooding of unicast traffic: relays rebroadcast frames not meant
+// for them once per (sender, fid), after a random delay that is longer the
+// stronger the frame was heard, so distant neighbours usually go first. A
+// pending relay is dropped once enough other relays of it are overheard.
+// Replies to relayed frames are full frames flooded back the same way.
+static const uint8_t  MESH_HOP_LIMIT     = 3;
+static const uint8_t  MESH_SEEN_SLOTS    = 32;     // (sender, fid) ring
+static const uint8_t  MESH_QUEUE         = 4;      // pending rebroadcasts
+static const uint16_t MESH_DELAY_SPAN_MS = 400;    // RSSI-weighted part of the delay
+static const uint8_t  MESH_JITTER_SLOTS  = 8;      // random part, in frame airtimes (see meshJitterMs)
+static const uint8_t  MESH_CANCEL_COPIES = 2;      // overheard relays that cancel ours
+static const uint16_t MESH_ACK_MAX_MS    = 8000;   // longest wait for a relayed ACK
+
+static inline uint8_t hopsTaken(uint8_t h){ return h >> 4; }
+static inline uint8_t hopsLeft(uint8_t h){ return h & 0x0F; }
+
+static uint8_t  nextFid = 0;
+static uint16_t meshSeen[MESH_SEEN_SLOTS];
+static uint8_t  meshSeenHead = 0;
+
+// hops the last frame from a sender took; unknown peers count as direct
+static inline uint8_t hopsTo(uint8_t id){ const PeerState* p = peerFind(id); return p ? p->hops : 0; }
+
+static bool meshRelayable(uint8_t type){
+  return type==TYPE_DATA || type==TYPE_ACK || type==TYPE_NACK || type==TYPE_FRAG ||
+         type==TYPE_FRAG_ACK || type==TYPE_PING || type==TYPE_PONG ||
+         type==TYPE_SYNC_REQ || type==TYPE_SYNC_RSP || type==TYPE_SYNC_PULL;
+}
+
+// true if this transmission was already seen; remembers it otherwise
+static bool meshSeenBefore(const Packet& r){
+  uint16_t key = ((uint16_t)r.sender << 8) | r.fid;
+  for (uint8_t i=0;i<MESH_SEEN_SLOTS;i++) if (meshSeen[i]==key) return true;
+  meshSeen[meshSeenHead] = key;
+  meshSeenHead = (meshSeenHead + 1) % MESH_SEEN_SLOTS;
+  return false;
+}
+
+// ----- Channel selection (see chan.h) -----
+static uint8_t  tunedChan = CHAN_RENDEZVOUS;
+static uint32_t txEndMs = 0;                   // our last frame leaves the air about then
+static bool     sending = false;               // a blocking send owns the radio; no retuning
+
+static uint8_t pairChannel(uint8_t peer){
+  int idx = storageFindContact(peer);
+  if (idx < 0) return CHAN_RENDEZVOUS;
+  return chanForPair(storageContactAt(idx).key, addrSelfFor(peer), peer);
+}
+
+// Strangers, relayed peers and broadcasts use the rendezvous channel. For a
+// contact, try where it last said it listens; odd attempts try the other place
+// (its pair channel vs the rendezvous) in case it moved since.
+static uint8_t txChannel(uint8_t to, uint8_t attempt){
+  if (to == BROADCAST_ID || storageFindContact(to) < 0 || hopsTo(to) > 0) return CHAN_RENDEZVOUS;
+  const PeerState* ps = peerFind(to);
+  uint8_t hint = ps ? ps->chan : PEER_CHAN_UNKNOWN;
+  if (hint == PEER_CHAN_UNKNOWN) hint = CHAN_RENDEZVOUS;
+  if (attempt & 1) return hint == CHAN_RENDEZVOUS ? pairChannel(to) : CHAN_RENDEZVOUS;
+  return hint;
+}
+
+// Chatting with a contact parks us on the pair's channel, unless it's reached
+// through relays: they flood its frames on the rendezvous. A running fragment
+// transfer keeps us where its SACKs will come back.
+static uint8_t listenChannel(){
+  if (fragTxBusy()) return txChannel(fragTxPeer(), 0);
+  if (page == PAGE_CHAT) return hopsTo(currentPeerId) > 0 ? CHAN_RENDEZVOUS : pairChannel(currentPeerId);
+  return CHAN_RENDEZVOUS;
+}
+
+// Under our own frame the driver keeps the new frequency until TX_DONE.
+static void radioTune(uint8_t ch){
+  if (ch == tunedChan) return;
+  radioSetFrequency(ch == CHAN_RENDEZVOUS ? LORA_BAND : chanFreqHz(ch));
+  tunedChan = ch;
+}
+
+// The driver never blocks: a new frame waits here for the previous one to leave
+// the air, then goes out without waiting for its own TX_DONE.
+static const uint16_t TX_DONE_SLACK_MS = 50;
+static void txWaitIdle(){
+  if (!radioTxBusy()) return;
+  TRACE_SPAN(TR_TX_WAIT, 0);
+  while (radioTxBusy()){
+    if ((int32_t)(millis() - txEndMs) > (int32_t)TX_DONE_SLACK_MS){ radioAbortTx(); return; }   // TX_DONE never came
+    delay(1);
+  }
+}
+
+static bool txFrame(const uint8_t* buf, uint8_t len, bool implicitHeader){
+  txWaitIdle();
+  bool sent = radioSend(buf, len, implicitHeader);
+  captureTx(buf, len, implicitHeader, tunedChan, sent);
+  if (!sent){ metricInc(MC_TX_FAIL); return false; }
+  uint32_t air = frameAirMs(len, implicitHeader);
+  txEndMs = millis() + air;
+  TRACE_COMPLETE(TR_AIR, air);
+  metricInc(MC_TX_FRAMES);
+  metricObserve(MH_TX_AIR_MS, air);
+  return true;
+}
+
+// Stamps and sends the frame in place (callers build it on the stack or hold a pool buffer).
+// A direct reply goes out where its request came in (attempt TX_HERE).
+static const uint8_t TX_HERE = 0xFF;
+static bool sendRaw(Packet& q, uint8_t attempt = 0){
+  txWaitIdle();                                    // carrier sense needs RX on the new channel
+  if (q.sender == addrSelf()){                     // originated here (relays keep all four)
+    q.sender = addrSelfFor(q.receiver);
+    q.fid = nextFid++;
+    q.chan = listenChannel();
+    if (q.hops == 0) q.hops = MESH_HOP_LIMIT;
+    if (attempt != TX_HERE) radioTune(txChannel(q.receiver, attempt));
+  } else radioTune(CHAN_RENDEZVOUS);
+  listenBeforeTalk();
+  ccOnSend();
+  q.crc=0; q.crc=crc8((const uint8_t*)&q, sizeof(q)-1);
+  return txFrame((const uint8_t*)&q, sizeof(q), false);   // RX resumes at TX_DONE
+}
+
+// Reply slot: while open, the receiver runs in implicit-header mode sized for CtrlFrame.
+static uint32_t replySlotEnd = 0;
+static void openReplySlot(uint32_t windowMs){
+  replySlotEnd = millis() + windowMs;
+}
+// The answer came: back to full frames now, the peer may have more to say
+static void closeReplySlot(){ replySlotEnd = millis(); }
+
+// Relayed peers: their reply is a full frame, the receiver stays in normal mode.
+static uint32_t meshReplyEnd = 0;
+
+// Last ACK/NACK handled (either shape), matched by waitForAck
+static uint8_t  replyFrom = 0, replyType = 0;
+static uint16_t replySeq = 0;
+
+// Off: direct peers answer with full frames too, as before control frames
+// (host/bench compares the two; both ends must agree)
+static bool ctrlReplies = true;
+void protocolSetCtrlReplies(bool on){ ctrlReplies = on; }
+
+static void expectReply(uint8_t peer, uint32_t windowMs){
+  replyType = 0;
+  if (hopsTo(peer) == 0 && ctrlReplies) openReplySlot(windowMs);
+  else meshReplyEnd = millis() + windowMs;
+}
+
+// Reply window (= retransmission timeout) for a full frame sent to `peer`.
+// Peers last heard through relays answer with flooded full frames instead.
+static uint32_t meshReplyMs(uint8_t h){
+  uint32_t air = frameAirMs(sizeof(Packet), false);
+  return air + 2u*h*(air + MESH_DELAY_SPAN_MS + MESH_JITTER_SLOTS * air);
+}
+
+static uint32_t replyWindowMs(uint8_t peer, uint8_t attempt){
+  uint32_t air = frameAirMs(sizeof(Packet), false);
+  uint8_t  h   = hopsTo(peer);
+  if (h > 0) return rttTimeoutMs(peer, attempt, meshReplyMs(h), air + 2u*h*air, MESH_ACK_MAX_MS);
+  uint32_t reply = ctrlReplies ? frameAirMs(sizeof(CtrlFrame), true) : air;
+  uint32_t floorMs = air + reply + CTRL_TURNAROUND_MS;
+  return rttTimeoutMs(peer, attempt, air + (ctrlReplies ? 0 : air) + CTRL_SLOT_MS, floorMs, ACK_TIMEOUT_MS);
+}
+uint32_t protocolAckWaitMs(uint8_t peer){ return replyWindowMs(peer, 0); }
+static bool inReplySlot(){ return (int32_t)(replySlotEnd - millis()) > 0; }
+
+static int parseFrame(bool ctrl){
+  radioListen(ctrl ? sizeof(CtrlFrame) : 0);
+  return radioAvailable();
+}
+
+static bool readCtrl(CtrlFrame& c){
+  radioRead((uint8_t*)&c, sizeof(c));
+  uint8_t saved=c.crc; c.crc=0;
+  return crc8((const uint8_t*)&c, sizeof(c)-1) == saved && addrIsMine(c.receiver);
+}
+
+static bool sendCtrl(uint8_t to, uint8_t type, uint16_t seq){
+  CtrlFrame c{};
+  c.sender=addrSelfFor(to); c.receiver=to; c.type=type; c.seq=seq;
+  c.crc=crc8((const uint8_t*)&c, sizeof(c)-1);
+  return txFrame((const uint8_t*)&c, sizeof(c), true);   // implicit header: the length is implied by the slot
+}
+
+// Discovery body: [0..19] name (NUL padded)  [20..23] full node ID (BE)
+static const uint8_t DISC_BODY_LEN = 24;
+
+static void sendDisc(uint8_t type, uint8_t to){
+  Packet p{};
+  p.sender = addrSelf();
   p.receiver = to;
-  p.type = TYPE_DISC_RSP;
+  p.type = type;
   p.seq = 0;
-  String nm = storageDeviceName();
-  p.len = (uint8_t)min((size_t)20, nm.length());
   memset(p.body, 0, sizeof(p.body));
-  nm.substring(0,p.len).toCharArray(p.body, p.len+1);
-  p.crc = 0; p.crc = crc8(reinterpret_cast<uint8_t*>(&p), sizeof(p)-1);
-
+  strncpy(p.body, storageDeviceName().c_str(), 20);
+  putU32BE((uint8_t*)p.body + 20, addrNodeId());
+  p.len = DISC_BODY_LEN;
   sendRaw(p);
 }
 
+// include our name so peers can show us immediately if they want
+static uint32_t discReqMs = 0;                     // our last request: its answers are still coming
+void protocolSendDiscReq(){ sendDisc(TYPE_DISC_REQ, BROADCAST_ID); discReqMs = millis(); }
+static void sendDiscRsp(uint8_t to){ sendDisc(TYPE_DISC_RSP, to); }
+
+// Beacons share the channel with every searching neighbour: the period grows
+// with the number of shorts heard (half the channel for the crowd's beacons),
+// and a beacon that finds the channel busy goes out a little later rather than
+// on top of another. Entries live a few periods, so slow crowds stay listed.
+static const uint16_t DISC_BEACON_MS = 1000;
+static uint32_t discBeaconMs = DISC_BEACON_MS;
+static uint32_t discLastTx = 0, discWaitMs = 0;
+
+static uint32_t discPeriodMs(){
+  int n = 0;
+  for (int i=0;i<ADDR_SET_BYTES;i++) n += __builtin_popcount(discHeard[i]);
+  return max((uint32_t)DISC_BEACON_MS, 2 * n * frameAirMs(sizeof(Packet), false));
+}
+
+static void discBeaconSoon(){
+  discLastTx = millis();
+  discWaitMs = esp_random() % DISC_BEACON_MS;
+}
+
+// Every node that hears a request answers it: sent at once the answers start
+// together and collide. Each waits a random part of a frame airtime, plus up
+// to DISC_RSP_SLOTS - 1 more the weaker it heard the request (nodes far apart
+// can't hear each other, but the nearest, likeliest to be picked, answer
+// first), and a little longer while the channel is busy. One answer is
+// pending at a time; requests heard meanwhile go unanswered.
+static const uint8_t  DISC_RSP_SLOTS = 4;
+static bool     discRspPending = false;
+static uint8_t  discRspTo = 0;
+static uint32_t discRspDueMs = 0;
+
+static void discRspQueue(uint8_t to, int rssi){
+  if (discRspPending) return;
+  uint32_t air = frameAirMs(sizeof(Packet), false);
+  uint32_t far = (uint32_t)(-60 - constrain(rssi, -120, -60));   // 0 near .. 60 far
+  discRspPending = true;
+  discRspTo = to;
+  discRspDueMs = millis() + far * (DISC_RSP_SLOTS - 1) * air / 60 + esp_random() % air;
+}
+
+static void discRspTick(uint32_t now){
+  if (!discRspPending || (int32_t)(now - discRspDueMs) < 0 || ccDeferMs() > 0) return;
+  if (channelBusy()) { discRspDueMs = now + esp_random() % frameAirMs(sizeof(Packet), false); return; }
+  discRspPending = false;
+  sendDiscRsp(discRspTo);
+}
+
 void protocolStartInvite(){
   int sel = protocolNearbySel();
   if (sel<0 || sel>=nearbyCount) return;
@@ -174,9 +635,9 @@ void protocolStartInvite(){
   awaitingAccept=true;
 
   Packet p{};
-  p.sender=DEVICE_ID; p.receiver=inviteeId; p.type=TYPE_INV_REQ; p.seq=nextSeq++;
+  p.sender=addrSelf(); p.receiver=inviteeId; p.type=TYPE_INV_REQ; p.seq=takeSeq();
   p.len=1+16+8; memset(p.body,0,160);
-  p.body[0]=(char)DEVICE_ID;
+  p.body[0]=(char)addrSelf();
   strncpy(p.body+1, storageDeviceName().c_str(), 15);
   memcpy(p.body+17, inviteNonce, 8);
   sendRaw(p);
@@ -185,286 +646,980 @@ void protocolStartInvite(){
 void protocolSendAccept(uint32_t code6){
   // accept invites stored in lastInviter + inviteeId as inviter id
   Packet p{};
-  p.sender=DEVICE_ID; p.receiver=inviteeId; p.type=TYPE_INV_ACK; p.seq=nextSeq++;
+  p.sender=addrSelf(); p.receiver=inviteeId; p.type=TYPE_INV_ACK; p.seq=takeSeq();
   p.len=1+16+8+4; memset(p.body,0,160);
-  p.body[0]=(char)DEVICE_ID;
+  p.body[0]=(char)addrSelf();
   strncpy(p.body+1, storageDeviceName().c_str(), 15);
   memcpy(p.body+17, inviteNonce, 8);
   p.body[25]=(code6>>24)&0xFF; p.body[26]=(code6>>16)&0xFF; p.body[27]=(code6>>8)&0xFF; p.body[28]=code6&0xFF;
   sendRaw(p);
 }
 
-static bool sendAck(uint8_t to, uint16_t seq){
+// Answer a request: control frame in the requester's reply slot when it came
+// direct, otherwise a full frame flooded back over as many hops as it took.
+static bool sendReply(uint8_t to, uint8_t type, uint16_t seq, uint8_t reqHops){
+  uint8_t taken = hopsTaken(reqHops);
+  if (taken == 0 && ctrlReplies) return sendCtrl(to, type, seq);
   Packet p{};
-  p.sender=DEVICE_ID; p.receiver=to; p.type=TYPE_ACK; p.seq=seq; p.len=0;
-  return sendRaw(p);
+  p.sender=addrSelf(); p.receiver=to; p.type=type; p.seq=seq; p.len=0;
+  p.hops=min((uint8_t)(taken + 1), MESH_HOP_LIMIT);
+  return sendRaw(p, taken ? 0 : TX_HERE);
+}
+
+// ----- Frame pool -----
+// Received frames are read into these buffers and handled where they lie (DATA
+// bodies are decrypted in place); a relay keeps the buffer instead of a copy.
+// One for the frame being handled, one for a poll nested in waitForAck, the
+// rest back the relay queue.
+static const uint8_t FRAME_POOL = MESH_QUEUE + 2;
+static Packet  framePool[FRAME_POOL];
+static uint8_t frameBusy = 0;                        // bit per buffer
+
+static Packet* frameAlloc(){
+  for (uint8_t i=0;i<FRAME_POOL;i++)
+    if (!(frameBusy & (1u << i))){
+      frameBusy |= (uint8_t)(1u << i);
+      metricSet(MG_FRAME_POOL, __builtin_popcount(frameBusy));
+      return &framePool[i];
+    }
+  return nullptr;
+}
+static void frameFree(Packet* f){ if (f) frameBusy &= (uint8_t)~(1u << (f - framePool)); }
+
+// Owns the frame protocolPoll is handling; hands it back on return unless a relay took it.
+struct FrameHold {
+  Packet* f;
+  ~FrameHold(){ frameFree(f); }
+};
+
+struct MeshPending {
+  bool     used;
+  uint8_t  copies;     // other relays of this frame overheard meanwhile
+  uint32_t dueMs;
+  Packet*  p;          // pool buffer
+};
+static MeshPending meshQ[MESH_QUEUE];
+
+// Spread over several airtimes rather than a fixed span: neighbours that heard
+// the frame equally well would otherwise pick overlapping instants at SF12.
+static uint32_t meshJitterMs(){ return esp_random() % (MESH_JITTER_SLOTS * frameAirMs(sizeof(Packet), false)); }
+
+static void meshConsider(FrameHold& h, int rssi){
+  Packet& r = *h.f;
+  if (!storageRelayEnabled() || !meshRelayable(r.type) || hopsLeft(r.hops) == 0) return;
+  MeshPending* slot = nullptr;
+  for (uint8_t i=0;i<MESH_QUEUE;i++) if (!meshQ[i].used){ slot = &meshQ[i]; break; }
+  if (!slot) return;                                 // busy relaying; others will cover it
+  uint32_t near = (uint32_t)(constrain(rssi, -120, -60) + 120);   // 0 far .. 60 near
+  slot->used = true;
+  slot->copies = 0;
+  slot->dueMs = millis() + near * MESH_DELAY_SPAN_MS / 60 + meshJitterMs();
+  r.hops = (uint8_t)(((hopsTaken(r.hops) + 1) << 4) | (hopsLeft(r.hops) - 1));
+  slot->p = h.f;
+  h.f = nullptr;
+}
+
+// A copy of an already-seen frame: if we're holding it, someone else relayed it.
+static void meshOnCopy(const Packet& r){
+  for (uint8_t i=0;i<MESH_QUEUE;i++){
+    MeshPending& m = meshQ[i];
+    if (!m.used || m.p->sender != r.sender || m.p->fid != r.fid) continue;
+    if (++m.copies >= MESH_CANCEL_COPIES){ m.used = false; frameFree(m.p); metricInc(MC_MESH_CANCELLED); }
+  }
+}
+
+static void meshTick(uint32_t now){
+  for (uint8_t i=0;i<MESH_QUEUE;i++){
+    MeshPending& m = meshQ[i];
+    if (!m.used || (int32_t)(now - m.dueMs) < 0) continue;
+    if (protocolTxDeferMs() > 0) return;             // relays are paced like everything else
+    m.used = false;
+    if (sendRaw(*m.p)) metricInc(MC_MESH_RELAYED);
+    frameFree(m.p);
+    return;                                          // one frame per poll
+  }
+}
+
+static bool sendAck(uint8_t to, uint16_t seq, uint8_t reqHops){ return sendReply(to, TYPE_ACK, seq, reqHops); }
+
+// ----- Link probe -----
+static uint8_t  pingTo = 0;
+static uint16_t pingSeq = 0;
+static uint32_t pingSentMs = 0;
+static uint8_t  pongFrom = 0;
+static uint16_t pongRttMs = 0;
+
+void protocolSendPing(uint8_t to){
+  Packet p{};
+  p.sender=addrSelf(); p.receiver=to; p.type=TYPE_PING; p.seq=takeSeq(); p.len=0;
+  pingTo=to; pingSeq=p.seq; pingSentMs=millis();
+  if (sendRaw(p)) expectReply(to, replyWindowMs(to, 0));
 }
 
+uint16_t protocolPingRttMs(uint8_t peer){ return (peer==pongFrom) ? pongRttMs : 0; }
+
 // ----- Encrypted data -----
-static bool sendEncrypted(uint8_t toId, const String& plaintext){
+// Text is packed (compress.h) before encryption; the compose limit bounds what we send.
+static uint8_t packBuf[CHAT_MSG_MAX_LEN + 1];
+
+static size_t packText(const String& text){
+  return compressText(text.c_str(), text.length(), packBuf, sizeof(packBuf));
+}
+
+// ----- Link authentication -----
+// Everything sealed with a contact key (DATA bodies, long messages, history
+// batches) ends in a MAC_LEN-byte tag over (sender, receiver, type, seq) and the
+// sealed bytes. The tag is checked before any decryption or state change.
+// Long messages use TYPE_FRAG, with the top bit set for history batches.
+uint32_t protocolMacRejects(){ return metricCounters[MC_RX_BAD_MAC]; }
+
+static void linkAd(uint8_t ad[5], uint8_t from, uint8_t to, uint8_t type, uint16_t seq){
+  ad[0]=from; ad[1]=to; ad[2]=type; ad[3]=(uint8_t)(seq>>8); ad[4]=(uint8_t)seq;
+}
+
+// Appends the tag for a frame we send to `peer`; returns the new length.
+static size_t sealTag(const uint8_t key[32], uint8_t peer, uint8_t type, uint16_t seq, uint8_t* sealed, size_t len){
+  uint8_t ad[5]; linkAd(ad, addrSelfFor(peer), peer, type, seq);
+  macTag(key, ad, sizeof(ad), sealed, len, sealed + len);
+  return len + MAC_LEN;
+}
+
+// What became of the frame being handled: counted, and noted in its capture record
+static void rxVerdict(MetricCounter c){
+  metricInc(c);
+  captureVerdict(c);
+}
+
+// Checks the tag ending `sealed` (len includes it) on a frame from `peer`.
+static bool tagOk(const uint8_t key[32], uint8_t peer, uint8_t type, uint16_t seq, const uint8_t* sealed, size_t len){
+  if (len < 4 + MAC_LEN) return false;
+  uint8_t ad[5]; linkAd(ad, peer, addrSelfFor(peer), type, seq);
+  if (macCheck(key, ad, sizeof(ad), sealed, len - MAC_LEN, sealed + len - MAC_LEN)) return true;
+  rxVerdict(MC_RX_BAD_MAC);
+  return false;
+}
+
+static inline uint8_t fragMacType(uint8_t kind){ return TYPE_FRAG | (kind == FRAG_KIND_SYNC ? 0x80 : 0); }
+
+// Decrypts nonce4|ciphertext where it lies and decodes the text straight into a new chat slot.
+static void openIntoChat(const uint8_t key[32], uint8_t* sealed, size_t len, uint8_t from, uint16_t seq){
+  TRACE_SPAN(TR_OPEN, seq);
+  keystreamXor(key, sealed, sealed+4, len-4);
+  decompressText(sealed+4, len-4, chatReserve(CHAT_MSG_MAX_LEN + 1), CHAT_MSG_MAX_LEN + 1);
+  chatCommit(from, ST_RECV, seq, from);
+}
+
+static bool sendEncrypted(uint8_t toId, uint16_t seq, const uint8_t* packed, size_t packedLen, uint32_t replyMs, uint8_t attempt){
   int idx = storageFindContact(toId);
   if (idx<0) return false;
   const Contact& c = storageContactAt(idx);
   uint8_t nonce4[4]; for (int i=0;i<4;i++) nonce4[i]=(uint8_t)esp_random();
 
-  uint8_t body[160]; size_t ptLen = min((size_t)155, plaintext.length());
+  uint8_t body[160]; size_t ptLen = min(DATA_TEXT_MAX, packedLen);
   memcpy(body, nonce4, 4);
-  memcpy(body+4, plaintext.c_str(), ptLen);
+  memcpy(body+4, packed, ptLen);
   keystreamXor(c.key, nonce4, body+4, ptLen);
 
   Packet p{};
-  p.sender=DEVICE_ID; p.receiver=toId; p.type=TYPE_DATA; p.seq=nextSeq++;
-  p.len = 4 + ptLen;
+  p.sender=addrSelf(); p.receiver=toId; p.type=TYPE_DATA; p.seq=seq;
+  p.len = sealTag(c.key, toId, TYPE_DATA, seq, body, 4 + ptLen);
   memset(p.body,0,160);
   memcpy(p.body, body, p.len);
-  return sendRaw(p);
+  if (!sendRaw(p, attempt)) return false;
+  expectReply(toId, replyMs);
+  return true;
 }
 
-static bool waitForAck(uint16_t seq, uint32_t timeoutMs){
-  uint32_t start = millis();
-  while (millis()-start < timeoutMs){
-    int p = LoRa.parsePacket();
-    if (p >= (int)sizeof(Packet)){
-      Packet r{}; LoRa.readBytes((uint8_t*)&r, sizeof(r));
-      uint8_t c=r.crc; r.crc=0; if (crc8((uint8_t*)&r,sizeof(r)-1)!=c) continue;
-
-      if (r.type==TYPE_DATA && r.receiver==DEVICE_ID){
-        int cidx = storageFindContact(r.sender);
-        if (cidx>=0 && r.len>=4){
-          uint8_t nonce4[4]={ (uint8_t)r.body[0], (uint8_t)r.body[1], (uint8_t)r.body[2], (uint8_t)r.body[3] };
-          int ctLen=r.len-4; uint8_t tmp[160]; memcpy(tmp,r.body+4,ctLen);
-          keystreamXor(storageContactAt(cidx).key, nonce4, tmp, ctLen);
-          String text = String((const char*)tmp).substring(0, ctLen);
-          pushChat(r.sender, text, ST_RECV, r.seq);
-          sendAck(r.sender, r.seq);
-          buzzIncoming(); vibIncoming();
-          if (protocolScrollOffset()==0) uiDrawChat();
-        }
-      }
-      if (r.receiver==DEVICE_ID && r.type==TYPE_ACK && r.seq==seq) return true;
+enum AckResult : uint8_t { ACK_NONE, ACK_OK, ACK_NACK };
+
+static bool rxFrame();
+
+// ACKs only arrive inside the reply slot, so the wait ends when the slot closes.
+// The radio is in implicit-header mode the whole time: regular frames sent to us
+// meanwhile are lost and get retried by their sender. Relayed ACKs are full
+// frames, so that wait keeps polling (and relaying) until the window closes.
+// A peer not known to be relayed gets that wait too once its slot passed empty,
+// if the frame went out on the rendezvous where relays could pick it up: the
+// flooded ACK is how we learn the route (rxFrame sets its hops). With control
+// replies off every ACK is a full frame, so every wait is the polling one.
+static AckResult waitForAck(uint8_t peer, uint16_t seq){
+  TRACE_SPAN(TR_ACK_WAIT, seq);
+  bool relayed = hopsTo(peer) > 0 || !ctrlReplies;
+  for (;;){
+    while (relayed ? (int32_t)(meshReplyEnd - millis()) > 0 : inReplySlot()){
+      if (relayed) protocolPoll(); else rxFrame();
+      if (replyType && replyFrom==peer && replySeq==seq)
+        return replyType==TYPE_ACK ? ACK_OK : ACK_NACK;
+      delay(3);
     }
-    delay(3);
+    if (relayed || !storageRelayEnabled() || tunedChan != CHAN_RENDEZVOUS) return ACK_NONE;
+    relayed = true;
+    meshReplyEnd = millis() + meshReplyMs(1);
   }
-  return false;
 }
 
-// Public chat send (called by input)
-void protocolSendChat(const String& text){
-  uint16_t seq = nextSeq++;
-  pushChat(DEVICE_ID, text, ST_QUEUED, seq);
-  scrollOffset=0; uiDrawChat();
+// Long text: encrypt once, hand the ciphertext to the fragment sender (non-blocking)
+static bool sendFragmented(uint8_t toId, uint16_t msgId, const uint8_t* packed, size_t packedLen){
+  int idx = storageFindContact(toId);
+  if (idx<0) return false;
+  uint8_t* buf = fragTxBegin(toId, msgId);
+  if (!buf) return false;                       // another long message still in flight
+
+  const uint8_t* key = storageContactAt(idx).key;
+  size_t ptLen = min((size_t)(FRAG_MSG_MAX - 4 - MAC_LEN), packedLen);
+  for (int i=0;i<4;i++) buf[i]=(uint8_t)esp_random();
+  memcpy(buf+4, packed, ptLen);
+  keystreamXor(key, buf, buf+4, ptLen);
+  return fragTxStart(sealTag(key, toId, fragMacType(FRAG_KIND_CHAT), msgId, buf, 4 + ptLen));
+}
+
+static void redrawChat(){ if (page == PAGE_CHAT) uiDrawChat(); }
 
-  bool ok=false;
-  for (uint8_t a=0; a<RETRIES && !ok; ++a){
-    if (sendEncrypted(currentPeerId, text)){
-      for (int i=chatCount-1;i>=0;--i) if (chatBuf[i].seq==seq && chatBuf[i].from==DEVICE_ID){ chatBuf[i].status=ST_SENT; break; }
-      uiDrawChat();
-      if (waitForAck(seq, ACK_TIMEOUT_MS)){
-        for (int i=chatCount-1;i>=0;--i) if (chatBuf[i].seq==seq && chatBuf[i].from==DEVICE_ID){ chatBuf[i].status=ST_DELIVERED; break; }
-        ok=true; uiDrawChat(); break;
+// Outcome of one delivery attempt (with retries) of a chat message
+enum SendResult : uint8_t { SEND_DELIVERED, SEND_ASYNC, SEND_UNREACHED, SEND_REFUSED };
+
+static SendResult deliver(uint8_t to, uint16_t seq, const char* text){
+  size_t packedLen;
+  {
+    TRACE_SPAN(TR_COMPRESS, strlen(text));
+    packedLen = compressText(text, strlen(text), packBuf, sizeof(packBuf));
+  }
+  if (packedLen > DATA_TEXT_MAX){
+    // status moves to DELIVERED/FAILED later via protocolOnFragSent()
+    if (!sendFragmented(to, seq, packBuf, packedLen)) return SEND_UNREACHED;
+    setChatStatus(seq, ST_SENT);
+    return SEND_ASYNC;
+  }
+
+  sending = true;
+  SendResult out = SEND_UNREACHED;
+  uint8_t tries = ccRetryBudget();
+  ccWaitTurn();
+  uint8_t a = 0;
+  for (; a<tries; ++a){
+    uint32_t t0 = millis();
+    if (sendEncrypted(to, seq, packBuf, packedLen, replyWindowMs(to, a), a)){
+      setChatStatus(seq, ST_SENT);       // redraw after the slot, not inside it
+      AckResult res = waitForAck(to, seq);
+      protocolTxFeedback(res == ACK_OK);
+      if (res == ACK_OK){
+        if (a == 0){                     // Karn: retried frames are ambiguous
+          rttSample(to, millis() - t0);
+          metricObserve(MH_ACK_RTT_MS, millis() - t0);
+        }
+        out = SEND_DELIVERED; break;
       }
+      if (res == ACK_NACK){ out = SEND_REFUSED; break; }   // peer can't open it; retrying won't help
+      redrawChat();
     }
-    delay(60);
+    TRACE_SPAN(TR_BACKOFF, a);
+    delay(max(rttBackoffMs(a), protocolTxDeferMs()));   // jittered so colliding senders drift apart
   }
-  if (!ok){
-    for (int i=chatCount-1;i>=0;--i) if (chatBuf[i].seq==seq && chatBuf[i].from==DEVICE_ID){ chatBuf[i].status=ST_FAILED; break; }
-    uiDrawChat();
+  sending = false;
+  metricObserve(MH_RETRIES, a < tries ? a : tries - 1);
+  metricInc(out == SEND_DELIVERED ? MC_MSG_DELIVERED : out == SEND_REFUSED ? MC_MSG_REFUSED : MC_MSG_UNREACHED);
+  return out;
+}
+
+// ----- Outbox flush (see outbox.h) -----
+// Started when a contact with queued messages is heard; one message per
+// OUTBOX_GAP_MS so a returning peer isn't hit with a burst.
+static const uint16_t OUTBOX_GAP_MS = 2000;
+static uint8_t  flushPeer   = 0;
+static uint32_t flushNextMs = 0;
+
+static void outboxPeerSeen(uint8_t id){
+  if (flushPeer == 0 && outboxFind(id) >= 0){ flushPeer = id; flushNextMs = millis(); }
+}
+
+// Undelivered message: park it for later, FAILED only if the outbox is full.
+static void queueForLater(uint8_t to, uint16_t seq, const char* text){
+  setChatStatus(seq, outboxAdd(to, seq, text) ? ST_OUTBOX : ST_FAILED);
+}
+
+static void settle(uint8_t to, uint16_t seq, const char* text, SendResult r){
+  if (r == SEND_ASYNC) return;
+  int i = outboxFindSeq(to, seq);
+  if (r == SEND_DELIVERED){
+    setChatStatus(seq, ST_DELIVERED);
+    if (i >= 0) outboxRemoveAt(i);
+    outboxPeerSeen(to);                  // it's reachable: older queued messages can follow
+  } else if (r == SEND_REFUSED){
+    setChatStatus(seq, ST_FAILED);
+    if (i >= 0) outboxRemoveAt(i);
+  } else {
+    if (i < 0) queueForLater(to, seq, text);
+    else setChatStatus(seq, ST_OUTBOX);
+    if (to == flushPeer) flushPeer = 0;  // gone again; wait until it's heard
   }
 }
 
-// Broadcast (encrypt per contact)
-void protocolBroadcast(const String& text){
-  int cc = storageContactCount();
-  for (int i=0;i<cc;i++){
-    sendEncrypted(storageContactAt(i).id, text);
+static void outboxFlushTick(uint32_t now){
+  outboxTick(now);
+  int x = outboxExpired(now);
+  if (x >= 0){ setChatStatus(outboxAt(x).seq, ST_FAILED); outboxRemoveAt(x); redrawChat(); }
+
+  if (flushPeer == 0 || sending || fragTxBusy()) return;
+  if ((int32_t)(now - flushNextMs) < 0 || protocolTxDeferMs() > 0) return;
+  int i = outboxFind(flushPeer);
+  if (i < 0){ flushPeer = 0; return; }
+  OutboxEntry e = outboxAt(i);
+  flushNextMs = now + OUTBOX_GAP_MS;
+  uint16_t top = nextSeq == seqBlockEnd ? storageReserveSeq(0) : nextSeq;   // no seq taken yet this boot
+  if ((uint16_t)(top - e.seq) >= REPLAY_WINDOW){
+    // the peer's replay window has passed it: it would be dropped as stale
+    uint16_t s = takeSeq();
+    setChatSeq(e.seq, s);
+    outboxSetSeq(i, s);
+    e.seq = s;
   }
+  settle(e.peer, e.seq, e.text, deliver(e.peer, e.seq, e.text));
+  redrawChat();
 }
 
-// ----- Receive / Dispatch -----
-void protocolPoll(){
-  // keep the periodic discovery ping while on Search page
-  static uint32_t lastDisc = 0;
-  if (page == PAGE_SEARCH && millis() - lastDisc > 1000) {
-    lastDisc = millis();
-    protocolSendDiscReq();
+// ----- History sync (see sync.h) -----
+// When a contact is heard for the first time since boot, or after SYNC_AWAY_MS
+// of silence, the node with the lower ID sends a digest of their conversation.
+//   SYNC_REQ  : digest (SYNC_DIGEST_LEN bytes)
+//   SYNC_RSP  : [0..1] mismatching buckets (BE)  [2] 1 = id list truncated
+//               [3..] ids the responder holds in those buckets
+//   SYNC_PULL : ids the initiator is missing
+// Ids are 3 bytes on air: origin, seq (BE). Whatever one side lacks goes over as
+// a single encrypted fragment transfer (FRAG_KIND_SYNC), plaintext per message:
+//   origin, seq (BE), packed length (BE), packed text (compress.h)
+static const uint32_t SYNC_AWAY_MS = 5UL * 60 * 1000;
+static const uint16_t SYNC_RSP_MS  = 4000;
+static const uint8_t  SYNC_ID_LEN  = 3;
+static const uint8_t  SYNC_IDS_MAX = (160 - 3) / SYNC_ID_LEN;
+
+static uint8_t  syncPeer = 0;
+static bool     syncAwaitRsp = false;
+static uint32_t syncDeadline = 0;
+
+// On air our own messages are filed under the pair address the peer knows us by;
+// in the log, under our primary.
+static inline uint8_t wireOrigin(uint8_t from, uint8_t peer){ return from == addrSelf() ? addrSelfFor(peer) : from; }
+static inline uint8_t logOrigin(uint8_t origin, uint8_t peer){ return origin == addrSelfFor(peer) ? addrSelf() : origin; }
+
+// Messages of the conversation with `peer` that both sides should hold:
+// everything received, and our own messages that reached (or may have reached) it.
+static int convIds(uint8_t peer, uint32_t* ids, int cap){
+  int n = 0;
+  for (int i=0;i<chatCount && n<cap;i++){
+    const ChatMsg& m = chatAt(i);
+    if (m.peer != peer || m.seq == 0) continue;
+    if (m.from == addrSelf() && m.status != ST_DELIVERED && m.status != ST_SENT) continue;
+    ids[n++] = syncId(wireOrigin(m.from, peer), m.seq);
   }
+  return n;
+}
 
-  int p = LoRa.parsePacket();
-  if (p <= 0) return;
+static void putId(uint8_t* b, uint32_t id){ b[0]=(uint8_t)(id>>16); b[1]=(uint8_t)(id>>8); b[2]=(uint8_t)id; }
+static uint32_t getId(const uint8_t* b){ return (uint32_t)b[0]<<16 | (uint32_t)b[1]<<8 | b[2]; }
 
-  dbg_lastRssi = (int8_t)LoRa.packetRssi();
+static bool hasId(const uint32_t* ids, int n, uint32_t id){
+  for (int i=0;i<n;i++) if (ids[i]==id) return true;
+  return false;
+}
 
-  if (p < (int)sizeof(Packet)) {
-    // too short to be a Packet
-    dbg_lastWhy = 1;  // short
-    while (LoRa.available()) LoRa.read();
-    dbg_rxCount++;
-    return;
+static bool sendSyncFrame(uint8_t to, uint8_t type, const uint8_t* body, uint8_t len){
+  Packet p{};
+  p.sender=addrSelf(); p.receiver=to; p.type=type; p.seq=0; p.len=len;
+  memcpy(p.body, body, len);
+  return sendRaw(p);
+}
+
+// Sends the listed messages from our log as one encrypted batch.
+static void syncSendBatch(uint8_t to, const uint32_t* ids, int n){
+  int cidx = storageFindContact(to);
+  if (n == 0 || cidx < 0) return;
+  uint16_t msgId = takeSeq();
+  uint8_t* buf = fragTxBegin(to, msgId, FRAG_KIND_SYNC);
+  if (!buf) return;                               // busy; the next sync catches up
+  const uint16_t room = FRAG_MSG_MAX - MAC_LEN;
+  for (int i=0;i<4;i++) buf[i]=(uint8_t)esp_random();
+  size_t off = 4;
+  for (int k=0;k<n;k++){
+    int i = chatFind(logOrigin((uint8_t)(ids[k] >> 16), to), (uint16_t)ids[k], to);
+    if (i < 0) continue;
+    const ChatMsg& m = chatAt(i);
+    size_t tl = strlen(m.text);
+    if (off + 5 + tl + 1 > room) break;           // room for raw text even if it doesn't shrink
+    size_t packed = compressText(m.text, tl, buf + off + 5, room - off - 5);
+    buf[off] = wireOrigin(m.from, to);
+    buf[off+1] = (uint8_t)(m.seq >> 8); buf[off+2] = (uint8_t)m.seq;
+    buf[off+3] = (uint8_t)(packed >> 8);         buf[off+4] = (uint8_t)packed;
+    off += 5 + packed;
   }
+  if (off == 4) return;
+  const uint8_t* key = storageContactAt(cidx).key;
+  keystreamXor(key, buf, buf+4, off-4);
+  fragTxStart(sealTag(key, to, fragMacType(FRAG_KIND_SYNC), msgId, buf, off));
+}
 
-  // ---- read ONCE ----
-  Packet r{};
-  LoRa.readBytes((uint8_t*)&r, sizeof(r));
+static void syncOnBatch(uint8_t from, const uint8_t key[32], uint8_t* data, uint16_t len){
+  keystreamXor(key, data, data+4, len-4);
+  bool added = false;
+  for (uint16_t off = 4; off + 5 <= len;){
+    uint8_t  origin = logOrigin(data[off], from);
+    uint16_t seq    = (uint16_t)(data[off+1] << 8 | data[off+2]);
+    uint16_t n      = (uint16_t)(data[off+3] << 8 | data[off+4]);
+    off += 5;
+    if (off + n > len) break;
+    if ((origin == from || origin == addrSelf()) && chatFind(origin, seq, from) < 0){
+      decompressText(data + off, n, chatReserve(CHAT_MSG_MAX_LEN + 1), CHAT_MSG_MAX_LEN + 1);
+      chatCommit(origin, origin == addrSelf() ? ST_DELIVERED : ST_RECV, seq, from);
+      added = true;
+    }
+    off += n;
+  }
+  if (added && page == PAGE_CHAT) uiDrawChat();
+}
 
-  // helpers (inline)
-  auto crc8_calc = [](uint8_t* buf, size_t len)->uint8_t {
-    return crc8(buf, len);
-  };
-  auto getU32BE = [](const uint8_t* b)->uint32_t {
-    return (uint32_t)b[0]<<24 | (uint32_t)b[1]<<16 | (uint32_t)b[2]<<8 | (uint32_t)b[3];
-  };
+static void syncOnReq(uint8_t from, const uint8_t* body, uint8_t len){
+  if (len < SYNC_DIGEST_LEN) return;
+  static uint32_t ids[MAX_MSGS];
+  int n = convIds(from, ids, MAX_MSGS);
+  uint8_t mine[SYNC_DIGEST_LEN]; syncDigest(ids, n, mine);
+  uint16_t mask = syncMismatch(mine, body);
+
+  uint8_t rsp[160]; uint8_t k = 0;
+  rsp[0] = (uint8_t)(mask >> 8); rsp[1] = (uint8_t)mask; rsp[2] = 0;
+  for (int i=0;i<n;i++){
+    if (!(mask & (1u << syncBucket(ids[i])))) continue;
+    if (k == SYNC_IDS_MAX){ rsp[2] = 1; break; }
+    putId(rsp + 3 + k*SYNC_ID_LEN, ids[i]); k++;
+  }
+  sendSyncFrame(from, TYPE_SYNC_RSP, rsp, 3 + k*SYNC_ID_LEN);
+}
 
-  // CRC check
-  uint8_t saved = r.crc; r.crc = 0;
-  uint8_t calc  = crc8_calc((uint8_t*)&r, sizeof(r)-1);
+static void syncOnRsp(uint8_t from, const uint8_t* body, uint8_t len){
+  if (!syncAwaitRsp || from != syncPeer || len < 3) return;
+  syncPeer = 0; syncAwaitRsp = false;
+  uint16_t mask = (uint16_t)(body[0] << 8 | body[1]);
+  if (!mask) return;                              // already in step
+
+  static uint32_t ids[MAX_MSGS];
+  int n = convIds(from, ids, MAX_MSGS);
+  int tn = min((len - 3) / SYNC_ID_LEN, (int)SYNC_IDS_MAX);
+  uint32_t theirs[SYNC_IDS_MAX];
+  for (int i=0;i<tn;i++) theirs[i] = getId(body + 3 + i*SYNC_ID_LEN);
+
+  // what they hold that we don't: ask for it
+  uint8_t pull[160]; uint8_t k = 0;
+  for (int i=0;i<tn && k<SYNC_IDS_MAX;i++)
+    if (!hasId(ids, n, theirs[i])) putId(pull + (k++)*SYNC_ID_LEN, theirs[i]);
+  if (k) sendSyncFrame(from, TYPE_SYNC_PULL, pull, k*SYNC_ID_LEN);
+
+  // what we hold in the differing buckets that they didn't list: send it
+  static uint32_t push[MAX_MSGS]; int pn = 0;
+  for (int i=0;i<n;i++)
+    if ((mask & (1u << syncBucket(ids[i]))) && !hasId(theirs, tn, ids[i])) push[pn++] = ids[i];
+  syncSendBatch(from, push, pn);
+}
 
-  // update debug fields
-  dbg_lastType = r.type;
-  dbg_lastFrom = r.sender;
-  dbg_lastTo   = r.receiver;
+static void syncOnPull(uint8_t from, const uint8_t* body, uint8_t len){
+  static uint32_t want[SYNC_IDS_MAX];
+  int n = min(len / SYNC_ID_LEN, (int)SYNC_IDS_MAX);
+  for (int i=0;i<n;i++) want[i] = getId(body + i*SYNC_ID_LEN);
+  syncSendBatch(from, want, n);
+}
 
-  if (calc != saved) {
-    dbg_lastWhy = 2;  // bad CRC
-    dbg_rxCount++;
+static void syncTick(uint32_t now){
+  if (!syncPeer) return;
+  if (syncAwaitRsp){
+    if ((int32_t)(now - syncDeadline) >= 0){ syncPeer = 0; syncAwaitRsp = false; }
     return;
   }
+  if (sending || protocolTxDeferMs() > 0) return;
+  static uint32_t ids[MAX_MSGS];
+  uint8_t digest[SYNC_DIGEST_LEN];
+  syncDigest(ids, convIds(syncPeer, ids, MAX_MSGS), digest);
+  if (!sendSyncFrame(syncPeer, TYPE_SYNC_REQ, digest, sizeof(digest))){ syncPeer = 0; return; }
+  syncAwaitRsp = true;
+  syncDeadline = now + SYNC_RSP_MS + 2 * replyWindowMs(syncPeer, 0);
+}
 
-  // address filter (allow broadcast for discovery)
-  bool forMe = (r.receiver == DEVICE_ID);
-  bool isBc  = (r.receiver == BROADCAST_ID);
+// ----- TDMA beacons (see tdma.h) -----
+// Broadcast on the rendezvous channel, body: [0..3] sender's network time at TX start (BE), [4] clock root ID
+static void tdmaTick(uint32_t now){
+  static uint32_t lastBeacon = 0;
+  if (!storageTdmaEnabled() || sending || now - lastBeacon < TDMA_BEACON_MS) return;
+  if (protocolTxDeferMs() > 0 || channelBusy()) return;   // stamp must not wait behind LBT
+  lastBeacon = now;
+  Packet p{};
+  p.sender=addrSelf(); p.receiver=BROADCAST_ID; p.type=TYPE_TDMA_BEACON; p.seq=0; p.len=5;
+  uint32_t t = tdmaNow(millis());
+  p.body[0]=(char)(t>>24); p.body[1]=(char)(t>>16); p.body[2]=(char)(t>>8); p.body[3]=(char)t;
+  p.body[4]=(char)tdmaRefId();
+  sendRaw(p);
+}
 
-  if (!forMe && !isBc) {
-    dbg_lastWhy = 3;  // wrong dst
-    dbg_rxCount++;
-    return;
-  }
+// Another node announced our primary short. If we're the one that moves, our
+// messages in the log follow us; contacts keep their pair addresses. The new
+// short avoids every node in the peer table and every short heard searching.
+// If the other one moves, it hasn't heard us yet: we beacon again soon.
+static void onAddrClash(uint32_t node){
+  uint8_t heard[ADDR_SET_BYTES];
+  memcpy(heard, discHeard, sizeof(heard));           // the peer table can't hold a crowd
+  for (int i=0;i<PEER_SLOTS;i++) if (const PeerState* p = peerAt(i)) addrAddSet(heard, p->id);
+  uint8_t old = addrOnClash(node, heard);
+  if (!old) { if (node < addrNodeId()) discBeaconSoon(); return; }
+  for (int i=0;i<chatCount;i++) if (chatAt(i).from == old) chatAt(i).from = addrSelf();
+  tdmaReset(addrSelf());
+}
 
-  dbg_lastWhy = 0; // OK
-  dbg_rxCount++;
+// Any frame from `id`: flush its outbox, and resync history after time apart.
+static void peerHeard(uint8_t id){
+  outboxPeerSeen(id);
+  uint32_t now = millis();
+  PeerState* ps = peerTouch(id);
+  bool away = ps->lastHeardMs == 0 || now - ps->lastHeardMs > SYNC_AWAY_MS;
+  ps->lastHeardMs = now | 1;                      // 0 means never heard
+  if (away && addrSelfFor(id) < id && syncPeer == 0 && storageFindContact(id) >= 0) syncPeer = id;
+}
 
-  // ===================== Handlers =====================
+// Public chat send (called by input)
+void protocolSendChat(const String& text){
+  uint16_t seq = takeSeq();
+  TRACE_SPAN(TR_SEND, seq);
+  pushChat(addrSelf(), text.c_str(), ST_QUEUED, seq, currentPeerId);
+  scrollOffset=0; uiDrawChat();
+  settle(currentPeerId, seq, text.c_str(), deliver(currentPeerId, seq, text.c_str()));
+  uiDrawChat();
+}
+
+// ----- Fragment transport hooks (see frag.h) -----
+bool protocolSendFrame(uint8_t to, uint8_t type, uint16_t seq, const uint8_t* body, uint8_t len){
+  Packet p{};
+  p.sender=addrSelf(); p.receiver=to; p.type=type; p.seq=seq;
+  p.len=min(len, (uint8_t)sizeof(p.body));
+  memcpy(p.body, body, p.len);
+  return sendRaw(p);
+}
 
-  // ---- Discovery (single, consistent implementation) ----
-  if (r.type == TYPE_DISC_REQ && (isBc || forMe)) {
-    // Always respond with our name
-    sendDiscRsp(r.sender);
+void protocolOnFragSent(uint8_t to, uint16_t msgId, uint8_t kind, bool ok){
+  if (kind == FRAG_KIND_SYNC) return;        // history batches aren't tracked
+  // the text is still in the outbox (flush) or the chat log (fresh send)
+  const char* text = nullptr;
+  int i = outboxFindSeq(to, msgId);
+  if (i >= 0) text = outboxAt(i).text;
+  else for (int k=chatCount-1;k>=0;--k) if (chatAt(k).seq==msgId && chatAt(k).from==addrSelf()){ text = chatAt(k).text; break; }
+  if (text) settle(to, msgId, text, ok ? SEND_DELIVERED : SEND_UNREACHED);
+  else setChatStatus(msgId, ok ? ST_DELIVERED : ST_FAILED);
+  if (page == PAGE_CHAT && to == currentPeerId) uiDrawChat();
+}
 
-    // Upsert sender into discovered list (their name is in body if len>0)
-    char nm[21] = {0};
-    if (r.len > 0) { memcpy(nm, r.body, min((int)r.len, 20)); nm[20] = 0; }
-    else           { snprintf(nm, sizeof(nm), "ID-%u", r.sender); }
-    discUpsert(r.sender, nm, (int8_t)LoRa.packetRssi());
+bool protocolOnFragMessage(uint8_t from, uint16_t msgId, uint8_t kind, uint8_t* data, uint16_t len){
+  int cidx = storageFindContact(from);
+  if (cidx<0) return false;
+  const uint8_t* key = storageContactAt(cidx).key;
+  if (!tagOk(key, from, fragMacType(kind), msgId, data, len)) return false;
+  len -= MAC_LEN;
+  if (kind == FRAG_KIND_SYNC){ syncOnBatch(from, key, data, len); return true; }
+  ReplayVerdict v;
+  if (replayReject(from, msgId, v)) return v == RP_DUP;   // resent after a lost SACK: SACK it again
+  replayAccept(from, msgId);
+  if (chatFind(from, msgId, from) >= 0) return true;
+  openIntoChat(key, data, len, from, msgId);
+  buzzIncoming(); vibIncoming();
+  if (protocolScrollOffset() == 0 && page == PAGE_CHAT) uiDrawChat();
+  return true;
+}
 
-    if (page == PAGE_SEARCH) uiDrawSearch();
-    return;
+// Broadcast (encrypt per contact, one attempt each)
+void protocolBroadcast(const String& text){
+  size_t packedLen = packText(text);
+  int cc = storageContactCount();
+  for (int i=0;i<cc;i++){
+    uint8_t to = storageContactAt(i).id;
+    uint16_t seq = takeSeq();
+    ccWaitTurn();
+    sending = true;
+    if (!sendEncrypted(to, seq, packBuf, packedLen, replyWindowMs(to, 0), 0)){ sending = false; continue; }
+    AckResult res = waitForAck(to, seq);   // the slot also keeps the next frame off the peer's ACK
+    sending = false;
+    if (res != ACK_NACK) protocolTxFeedback(res == ACK_OK);
   }
+}
 
-  if (r.type == TYPE_DISC_RSP && forMe) {
-    char nm[21] = {0};
-    if (r.len > 0) { memcpy(nm, r.body, min((int)r.len, 20)); nm[20] = 0; }
-    else           { snprintf(nm, sizeof(nm), "ID-%u", r.sender); }
-    discUpsert(r.sender, nm, (int8_t)LoRa.packetRssi());
-    if (page == PAGE_SEARCH) uiDrawSearch();
-    return;
+// ----- Receive / Dispatch -----
+// Every frame, full or control, goes through rxFrame(): CRC, relay and address
+// checks, peer bookkeeping, then one handler looked up by type in RX_ROUTES.
+// A route names the addressing it accepts; anything else counts as dropped.
+struct RxInfo {
+  bool forMe;     // one of our addresses
+  bool isBc;
+  bool ctrl;      // arrived as a CtrlFrame in a reply slot (len 0, no hops)
+  int  rssi;
+};
+typedef void (*RxHandler)(Packet& r, const RxInfo& in);
+
+enum RxScope : uint8_t { RX_TO_ME = 1, RX_BCAST = 2, RX_ANY = 3,
+                         RX_CTRL = 4 };   // may also come as a control frame
+struct RxRoute    { RxHandler fn; uint8_t scope; };
+struct RxRouteDef { uint8_t type; RxRoute route; };
+
+static const uint8_t RX_TYPE_SLOTS = 32;   // slot 0 (unused type) also collects types >= 32
+static RxTypeStats rxStats[RX_TYPE_SLOTS];
+RxTypeStats protocolRxStats(uint8_t type){ return rxStats[type < RX_TYPE_SLOTS ? type : 0]; }
+
+// rx.type <type> <frames> <dropped> <total us> <max us>, types seen only
+void protocolRxStatsDump(){
+  for (uint8_t t=0;t<RX_TYPE_SLOTS;t++){
+    const RxTypeStats& s = rxStats[t];
+    if (!s.frames && !s.dropped) continue;
+    Serial.printf("rx.type %u %lu %lu %lu %lu\n", t, (unsigned long)s.frames, (unsigned long)s.dropped,
+                  (unsigned long)s.totalUs, (unsigned long)s.maxUs);
   }
+}
 
-  // ---- INVITE REQUEST: receiver sees prompt, types code ----
-  if (r.type == TYPE_INV_REQ && forMe) {
-    inviteReset();
-    if (r.len >= 4) {
-      uint32_t code6 = getU32BE((const uint8_t*)r.body);
+// ---- Discovery (request and response share one handler) ----
+static void onDisc(Packet& r, const RxInfo& in){
+  // Upsert sender into discovered list (name, then full ID if the peer sends one)
+  char nm[21] = {0};
+  if (r.len > 0) { memcpy(nm, r.body, min((int)r.len, 20)); nm[20] = 0; }
+  else           { snprintf(nm, sizeof(nm), "ID-%u", r.sender); }
+  uint32_t node = (r.len >= DISC_BODY_LEN) ? getU32BE((const uint8_t*)r.body + 20) : 0;
 
-      // If we already saw this same code from same sender, ignore (but you could re-show UI if you prefer)
-      if (lastInviteReqCode[r.sender] == code6) {
-        return;
-      }
-      lastInviteReqCode[r.sender] = code6;
+  if (r.sender == addrSelf()) { if (node) onAddrClash(node); }
+  else {
+    addrAddSet(discHeard, r.sender);
+    // Respond with our name after a random delay; the beacon already carried
+    // theirs, and while searching our own beacons answer it
+    if (r.type == TYPE_DISC_REQ && page != PAGE_SEARCH) discRspQueue(r.sender, in.rssi);
+  }
+  discUpsert(r.sender, node, nm, (int8_t)in.rssi);
 
-      char fromNm[21] = {0};
-      if (r.len >= 24) memcpy(fromNm, r.body + 4, 20);
-      else snprintf(fromNm, sizeof(fromNm), "ID-%u", r.sender);
+  if (page == PAGE_SEARCH) uiDrawSearch();
+}
 
-      discUpsert(r.sender, fromNm, (int8_t)LoRa.packetRssi());
+// ---- INVITE REQUEST: receiver sees prompt, types code ----
+static void onInviteReq(Packet& r, const RxInfo& in){
+  inviteReset();
+  if (r.len < 4) return;
+  uint32_t code6 = getU32BE((const uint8_t*)r.body);
+  uint32_t node  = (r.len >= INV_REQ_LEN) ? getU32BE((const uint8_t*)r.body + 24) : 0;
+  uint32_t dest  = (r.len >= INV_REQ_LEN) ? getU32BE((const uint8_t*)r.body + 28) : 0;
+  if (dest && dest != addrNodeId()) return;   // for another node sharing our short
+
+  // If we already saw this same code from same sender, ignore (but you could re-show UI if you prefer)
+  PeerState* ps = peerTouch(r.sender);
+  if (ps->inviteReqCode == code6) return;
+  ps->inviteReqCode = code6;
+
+  char fromNm[21] = {0};
+  if (r.len >= 24) memcpy(fromNm, r.body + 4, 20);
+  else snprintf(fromNm, sizeof(fromNm), "ID-%u", r.sender);
+
+  discUpsert(r.sender, node, fromNm, (int8_t)in.rssi);
+  invitePairAddrs(r, node);
+  if (r.len >= INV_REQ_KEYED_LEN) memcpy(invPeerNonce, r.body + INV_REQ_LEN, INV_NONCE_LEN);
+  else memset(invPeerNonce, 0, INV_NONCE_LEN);
+
+  uiShowInvitePrompt(r.sender, fromNm, code6);
+  page = PAGE_INVITE_PROMPT;
+  uiForceBlinkRestart();
+  uiDrawInvitePrompt();
+}
 
-      uiShowInvitePrompt(r.sender, fromNm, code6);
-      page = PAGE_INVITE_PROMPT;
-      uiForceBlinkRestart();
-      uiDrawInvitePrompt();
-    }
+// ---- INVITE ACCEPT: requester verifies code, adds contact ----
+static void onInviteAck(Packet& r, const RxInfo&){
+  if (r.len < 4) return;
+  uint32_t code6 = getU32BE((const uint8_t*)r.body);
+
+  // ignore repeats of the same ack
+  PeerState* ps = peerTouch(r.sender);
+  if (ps->inviteAckCode == code6) return;
+  ps->inviteAckCode = code6;
+
+  char peerNm[21] = {0};
+  if (r.len >= 24) memcpy(peerNm, r.body + 4, 20);
+  else snprintf(peerNm, sizeof(peerNm), "ID-%u", r.sender);
+
+  // the accept comes from the pair address the invitee picked for itself
+  uint32_t node = (r.len >= INV_ACK_LEN) ? getU32BE((const uint8_t*)r.body + 24) : 0;
+  bool same = inviteeNode ? node == inviteeNode : r.sender == inviteeId;
+  if (inviteeId && same && code6 == inviteCode) {
+    Contact c{};
+    c.id   = r.sender;
+    c.self = (r.len >= INV_ACK_LEN && r.body[28] && (uint8_t)r.body[28] != BROADCAST_ID) ? (uint8_t)r.body[28] : addrSelf();
+    c.node = node;
+    strlcpy(c.name, peerNm, sizeof(c.name));
+    pairKey(storageDeviceName(), String(peerNm), code6, inviteNonce,
+            r.len >= INV_ACK_KEYED_LEN ? (const uint8_t*)r.body + INV_ACK_LEN : nullptr, c.key);
+    storageAddContact(c);
+
+    inviteReset();
+    page = PAGE_CONTACTS;
+    uiDrawContacts();
+  }
+}
+
+// ---- DATA: encrypted chat message to me ----
+static void onData(Packet& r, const RxInfo&){
+  int cidx = storageFindContact(r.sender);
+  if (cidx < 0) { sendReply(r.sender, TYPE_NACK, r.seq, r.hops); return; }   // no key: tell the sender to stop
+
+  // Tag first: foreign or forged frames get no ACK and don't move the replay window
+  const uint8_t* key = storageContactAt(cidx).key;
+  size_t len = min((size_t)r.len, sizeof(r.body));
+  if (!tagOk(key, r.sender, TYPE_DATA, r.seq, (const uint8_t*)r.body, len)) return;   // bad tag
+  len -= MAC_LEN;
+
+  // Then the replay window: a retry we already took is only re-ACKed, a stale one dropped
+  ReplayVerdict v;
+  if (replayReject(r.sender, r.seq, v)) {
+    if (v == RP_DUP) sendAck(r.sender, r.seq, r.hops);   // so the sender stops retrying
     return;
   }
 
-  // ---- INVITE ACCEPT: requester verifies code, adds contact ----
-  if (r.type == TYPE_INV_ACK && forMe) {
-    if (r.len >= 4) {
-      uint32_t code6 = getU32BE((const uint8_t*)r.body);
+  sendAck(r.sender, r.seq, r.hops);  // ACK first: the peer's reply slot is short
+  replayAccept(r.sender, r.seq);
+  if (chatFind(r.sender, r.seq, r.sender) >= 0) return;   // outbox resend after a lost ACK
+  openIntoChat(key, (uint8_t*)r.body, len, r.sender, r.seq);
+  buzzIncoming(); vibIncoming();
 
-      // ignore repeats of the same ack
-      if (lastInviteAckCode[r.sender] == code6) return;
-      lastInviteAckCode[r.sender] = code6;
+  if (protocolScrollOffset() == 0 && page == PAGE_CHAT) uiDrawChat();
+}
 
-      char peerNm[17] = {0};
-      if (r.len >= 24) memcpy(peerNm, r.body + 4, 16);
-      else snprintf(peerNm, sizeof(peerNm), "ID-%u", r.sender);
+// ---- Fragmented message pieces / selective ACKs ----
+static void onFrag(Packet& r, const RxInfo&){
+  if (storageFindContact(r.sender) >= 0) fragOnFrame(r.sender, r.seq, (const uint8_t*)r.body, r.len, millis());
+}
+static void onFragAck(Packet& r, const RxInfo&){
+  fragOnSack(r.sender, r.seq, (const uint8_t*)r.body, r.len, millis());
+}
 
-      if (r.sender == inviteeId && code6 == inviteCode) {
-        Contact c{};
-        c.id = r.sender;
-        strlcpy(c.name, peerNm, sizeof(c.name));
-        memset(c.key, 0, sizeof(c.key));
-        storageAddContact(c);
+// ---- Link probe: answer in the prober's reply slot ----
+static void onPing(Packet& r, const RxInfo&){
+  sendReply(r.sender, TYPE_PONG, r.seq, r.hops);
+}
+static void onPong(Packet& r, const RxInfo& in){
+  if (r.sender != pingTo || r.seq != pingSeq) return;
+  if (in.ctrl) closeReplySlot();
+  pongFrom = r.sender;
+  pongRttMs = (uint16_t)min((uint32_t)0xFFFF, millis() - pingSentMs);
+  rttSample(r.sender, pongRttMs);   // PING is a full frame, same shape as DATA
+}
 
-        inviteReset();
-        page = PAGE_CONTACTS;
-        uiDrawContacts();
-      }
-    }
+// ---- TDMA clock beacon ----
+static void onTdmaBeacon(Packet& r, const RxInfo&){
+  if (!storageTdmaEnabled() || r.len < 5) return;
+  uint32_t t = getU32BE((const uint8_t*)r.body) + frameAirMs(sizeof(Packet), false);
+  tdmaOnBeacon((uint8_t)r.body[4], t, millis());
+}
+
+// ---- History sync between contacts ----
+static uint8_t syncBodyLen(const Packet& r){
+  return storageFindContact(r.sender) < 0 ? 0 : min(r.len, (uint8_t)sizeof(r.body));
+}
+static void onSyncReq(Packet& r, const RxInfo&){
+  if (uint8_t len = syncBodyLen(r)) syncOnReq(r.sender, (const uint8_t*)r.body, len);
+}
+static void onSyncRsp(Packet& r, const RxInfo&){
+  if (uint8_t len = syncBodyLen(r)) syncOnRsp(r.sender, (const uint8_t*)r.body, len);
+}
+static void onSyncPull(Packet& r, const RxInfo&){
+  if (uint8_t len = syncBodyLen(r)) syncOnPull(r.sender, (const uint8_t*)r.body, len);
+}
+
+// ---- ACK / NACK: direct ones in the reply slot, relayed ones as full frames ----
+static void onReply(Packet& r, const RxInfo& in){
+  replyFrom = r.sender; replySeq = r.seq; replyType = r.type;
+  if (in.ctrl){
+    closeReplySlot();
+    peerTouch(r.sender)->chan = tunedChan;    // it answered here, so that's where it listens
+  }
+  if (in.ctrl || r.type != TYPE_ACK) return;  // direct: settled by deliver() after the slot
+  setChatStatus(r.seq, ST_DELIVERED);         // also settles messages that already timed out
+  if (page == PAGE_CHAT && r.sender == currentPeerId) uiDrawChat();
+}
+
+// ---- Handler table ----
+static constexpr RxRouteDef RX_ROUTE_DEFS[] = {
+  { TYPE_DATA,        { onData,       RX_TO_ME } },
+  { TYPE_ACK,         { onReply,      RX_TO_ME | RX_CTRL } },
+  { TYPE_NACK,        { onReply,      RX_TO_ME | RX_CTRL } },
+  { TYPE_FRAG,        { onFrag,       RX_TO_ME } },
+  { TYPE_FRAG_ACK,    { onFragAck,    RX_TO_ME } },
+  { TYPE_PING,        { onPing,       RX_TO_ME } },
+  { TYPE_PONG,        { onPong,       RX_TO_ME | RX_CTRL } },
+  { TYPE_SYNC_REQ,    { onSyncReq,    RX_TO_ME } },
+  { TYPE_SYNC_RSP,    { onSyncRsp,    RX_TO_ME } },
+  { TYPE_SYNC_PULL,   { onSyncPull,   RX_TO_ME } },
+  { TYPE_TDMA_BEACON, { onTdmaBeacon, RX_BCAST } },
+  { TYPE_DISC_REQ,    { onDisc,       RX_ANY } },
+  { TYPE_DISC_RSP,    { onDisc,       RX_TO_ME } },
+  { TYPE_INV_REQ,     { onInviteReq,  RX_TO_ME } },
+  { TYPE_INV_ACK,     { onInviteAck,  RX_TO_ME } },
+};
+static constexpr uint8_t RX_ROUTE_COUNT = sizeof(RX_ROUTE_DEFS) / sizeof(RX_ROUTE_DEFS[0]);
+
+// Compile-time lookups (single-return constexpr, so they also build as C++11)
+static constexpr uint8_t rxRouteIndex(uint8_t type, uint8_t i = 0){
+  return i == RX_ROUTE_COUNT || RX_ROUTE_DEFS[i].type == type ? i : rxRouteIndex(type, i + 1);
+}
+static constexpr RxRoute rxRouteFor(uint8_t type){
+  return rxRouteIndex(type) == RX_ROUTE_COUNT ? RxRoute{nullptr, 0} : RX_ROUTE_DEFS[rxRouteIndex(type)].route;
+}
+static constexpr bool rxRoutesValid(uint8_t i = 0){
+  return i == RX_ROUTE_COUNT ||
+         (RX_ROUTE_DEFS[i].type != 0 && RX_ROUTE_DEFS[i].type < RX_TYPE_SLOTS &&
+          rxRouteIndex(RX_ROUTE_DEFS[i].type) == i && rxRoutesValid(i + 1));
+}
+static_assert(rxRoutesValid(), "RX_ROUTE_DEFS: type 0, type >= RX_TYPE_SLOTS or listed twice");
+
+#define RX_ROUTES4(t) rxRouteFor(t), rxRouteFor(t + 1), rxRouteFor(t + 2), rxRouteFor(t + 3)
+static constexpr RxRoute RX_ROUTES[RX_TYPE_SLOTS] = {
+  RX_ROUTES4(0),  RX_ROUTES4(4),  RX_ROUTES4(8),  RX_ROUTES4(12),
+  RX_ROUTES4(16), RX_ROUTES4(20), RX_ROUTES4(24), RX_ROUTES4(28)
+};
+#undef RX_ROUTES4
+
+static void rxDispatch(Packet& r, const RxInfo& in){
+  uint8_t t = r.type < RX_TYPE_SLOTS ? r.type : 0;
+  TRACE_SPAN(TR_RX, r.type);
+  const RxRoute& route = RX_ROUTES[t];
+  RxTypeStats& st = rxStats[t];
+  uint8_t scope = (in.forMe ? RX_TO_ME : 0) | (in.isBc ? RX_BCAST : 0) | (in.ctrl ? RX_CTRL : 0);
+  if (!route.fn || !(route.scope & scope & RX_ANY) || (in.ctrl && !(route.scope & RX_CTRL))) {
+    st.dropped++;
+    rxVerdict(MC_RX_NO_ROUTE);
     return;
   }
+  rxVerdict(MC_RX_OK);
+  uint32_t t0 = micros();
+  route.fn(r, in);
+  uint32_t us = micros() - t0;
+  st.frames++;
+  st.totalUs += us;
+  if (us > st.maxUs) st.maxUs = us;
+}
 
-  // ---- DATA: encrypted chat message to me ----
-  if (r.type == TYPE_DATA && forMe) {
-    // Duplicate suppress (per sender, seq)
-    if (r.seq == lastSeqSeen[r.sender]) {
-      // We’ve already processed this DATA. Just ACK again so the sender stops retrying.
-      sendAck(r.sender, r.seq);
-      return;
-    }
+// A frame dropped without reading it: read it anyway while capturing
+static void captureUnread(uint8_t len, bool implicitHeader, const RadioRxInfo& rx){
+  if (!captureOn) { radioDiscard(); return; }
+  uint8_t buf[CAPTURE_MAX_LEN];
+  len = min(len, CAPTURE_MAX_LEN);                 // longer ones keep their first bytes
+  radioRead(buf, len);
+  captureRx(buf, len, implicitHeader, tunedChan, rx);
+}
+
+// Reads at most one frame (a CtrlFrame while a reply slot is open) and dispatches it.
+static bool rxFrame(){
+  bool ctrl = inReplySlot();
+  int p = parseFrame(ctrl);
+  if (p <= 0) return false;
+
+  RadioRxInfo rx = radioLastRx();
+  RxInfo in{};
+  in.rssi = rx.rssi;
+  metricSet(MG_RX_RSSI, in.rssi);
+
+  if (ctrl && p == (int)sizeof(CtrlFrame)) {
+    CtrlFrame c{};
+    bool ok = readCtrl(c);
+    captureRx((const uint8_t*)&c, sizeof(c), true, tunedChan, rx);
+    if (!ok) { rxVerdict(MC_RX_CTRL_BAD); return true; }
+    Packet r{};
+    r.sender = c.sender; r.receiver = c.receiver; r.type = c.type; r.seq = c.seq;
+    in.forMe = true; in.ctrl = true;
+    rxDispatch(r, in);
+    return true;
+  }
+
+  if (p < (int)sizeof(Packet)) {
+    // too short to be a Packet
+    captureUnread((uint8_t)p, ctrl, rx);
+    rxVerdict(MC_RX_MALFORMED);
+    return true;
+  }
+
+  // ---- read ONCE, into a pool buffer ----
+  FrameHold hold{frameAlloc()};
+  if (!hold.f) {                                    // every buffer queued for relay
+    captureUnread((uint8_t)p, ctrl, rx);
+    rxVerdict(MC_RX_NO_BUFFER);
+    return true;
+  }
+  Packet& r = *hold.f;
+  radioRead((uint8_t*)&r, sizeof(r));
+  captureRx((const uint8_t*)&r, (uint8_t)p, false, tunedChan, rx);
 
-    // New sequence: remember it and process
-    lastSeqSeen[r.sender] = r.seq;
+  // CRC check (the PHY CRC has passed: a mismatch is a malformed sender)
+  uint8_t saved = r.crc; r.crc = 0;
+  uint8_t calc  = crc8((const uint8_t*)&r, sizeof(r)-1);
+  if (calc != saved) {
+    rxVerdict(MC_RX_MALFORMED);
+    return true;
+  }
 
-    int cidx = storageFindContact(r.sender);
-    if (cidx >= 0 && r.len >= 4) {
-      uint8_t nonce4[4] = { (uint8_t)r.body[0], (uint8_t)r.body[1], (uint8_t)r.body[2], (uint8_t)r.body[3] };
-      int ctLen = r.len - 4;
-      uint8_t tmp[160]; memcpy(tmp, r.body + 4, ctLen);
-      keystreamXor(storageContactAt(cidx).key, nonce4, tmp, ctLen);
+  // relayed copies: our own frames coming back, or a transmission seen already.
+  // A frame heard first hand is never a copy: a sender that rebooted starts its
+  // fids over, and those must not match what the ring holds from before.
+  if (meshRelayable(r.type)) {
+    if (addrIsMine(r.sender)) { rxVerdict(MC_RX_ECHO); return true; }
+    if (meshSeenBefore(r) && hopsTaken(r.hops) > 0) { rxVerdict(MC_RX_COPY); meshOnCopy(r); return true; }
+  }
 
-      String text = String((const char*)tmp).substring(0, ctLen);
-      pushChat(r.sender, text, ST_RECV, r.seq);
-      sendAck(r.sender, r.seq);
-      buzzIncoming(); vibIncoming();
+  // address filter (allow broadcast for discovery)
+  in.forMe = addrIsMine(r.receiver);
+  in.isBc  = (r.receiver == BROADCAST_ID);
 
-      if (protocolScrollOffset() == 0 && page == PAGE_CHAT) uiDrawChat();
+  if (!in.forMe && !in.isBc) {
+    rxVerdict(MC_RX_NOT_FOR_ME);
+    meshConsider(hold, in.rssi);
+    return true;
+  }
+  {
+    PeerState* ps = peerTouch(r.sender);
+    ps->rssi = (int8_t)constrain(in.rssi, -128, 0);
+    ps->frames++;
+    if (in.forMe && meshRelayable(r.type)) {
+      ps->hops = hopsTaken(r.hops);
+      if (ps->hops == 0) ps->chan = r.chan;
     }
-    return;
   }
+  peerHeard(r.sender);
+  rxDispatch(r, in);
+  return true;
+}
 
-  // (Optional: handle TYPE_ACK for your sent messages here)
+void protocolPoll(){
+  // discovery beacons are sent by protocolSearchTick()
+  if (!sending && !inReplySlot()) radioTune(listenChannel());
+  fragTick(millis());
+  meshTick(millis());
+  outboxFlushTick(millis());
+  syncTick(millis());
+  tdmaTick(millis());
+  if (!sending) discRspTick(millis());
+  rxFrame();
+
+  uint8_t relays = 0;
+  for (uint8_t i=0;i<MESH_QUEUE;i++) relays += meshQ[i].used;
+  metricSet(MG_RELAY_QUEUE, relays);
+  metricSet(MG_OUTBOX, outboxCount());
+  metricSet(MG_CHAT_LOG, chatCount);
 }
 
 void protocolSearchTick(){
-  static uint32_t lastTx=0;
   if (page != PAGE_SEARCH) return;
   uint32_t now = millis();
-  if (now - lastTx >= 1000) {  // 1 Hz broadcast
-    protocolSendDiscReq();
-    lastTx = now;
+  if (now - discLastTx >= discWaitMs && ccDeferMs() == 0) {  // never slotted
+    uint32_t air = frameAirMs(sizeof(Packet), false);
+    discLastTx = now;
+    if (channelBusy()) discWaitMs = air + esp_random() % (4 * air);
+    else {
+      protocolSendDiscReq();
+      discBeaconMs = discPeriodMs();
+      discWaitMs = discBeaconMs / 2 + esp_random() % discBeaconMs;
+    }
   }
-  // Optionally expire stale entries (e.g., older than 8s)
+  uint32_t ttl = max(8000u, 4 * discBeaconMs);
   for (int i=0;i<g_discCount;){
-    if (now - g_disc[i].lastSeen > 8000) {
+    if (now - g_disc[i].lastSeen > ttl) {
       // remove by swapping last
       g_disc[i] = g_disc[g_discCount-1];
       g_discCount--;
@@ -474,90 +1629,100 @@ void protocolSearchTick(){
 
 // ----- Init radio -----
 void protocolInit(){
-  SPI.begin(LORA_SCK, LORA_MISO, LORA_MOSI, LORA_SS);
-  LoRa.setPins(LORA_SS, LORA_RST, LORA_DIO0);
-  if (!LoRa.begin(LORA_BAND, true)) {
+  addrInit();                           // node ID + short address (contacts already loaded)
+  const RadioPins pins = { LORA_SCK, LORA_MISO, LORA_MOSI, LORA_SS, LORA_RST, LORA_DIO0 };
+  RadioConfig cfg;
+  cfg.freqHz   = LORA_BAND;
+  cfg.sf       = LORA_SF;
+  cfg.bw       = LORA_BW;
+  cfg.cr4      = LORA_CR4;
+  cfg.preamble = LORA_PREAMBLE;
+  cfg.syncWord = 0x12;
+  cfg.powerDbm = LORA_POWER_DBM;        // PA_BOOST
+  cfg.crc      = true;                  // PHY drops damaged frames (explicit and implicit header)
+  if (!radioBegin(pins, cfg)) {
     oled.clear(); oled.drawString(0,0,"LoRa init fail"); oled.display();
     while(true) delay(1000);
   }
-  #if defined(PA_OUTPUT_PA_BOOST_PIN)
-    LoRa.setTxPower(LORA_POWER_DBM, PA_OUTPUT_PA_BOOST_PIN);
-  #else
-    LoRa.setTxPower(LORA_POWER_DBM, 1);
-  #endif
-  LoRa.setSpreadingFactor(7);
-  LoRa.setSignalBandwidth(125E3);
-  LoRa.setCodingRate4(5);
-  LoRa.setSyncWord(0x12);
-  LoRa.receive();
-}
-
-void discUpsert(uint8_t id, const char* nm, int8_t rssi){
-  // update if exists
-  for (int i=0;i<g_discCount;i++){
-    if (g_disc[i].id == id){
-      strlcpy(g_disc[i].name, nm, sizeof(g_disc[i].name));
-      g_disc[i].rssi = rssi;
-      g_disc[i].lastSeen = millis();
-      return;
-    }
-  }
-  // append if space
-  if (g_discCount < MAX_DISC){
-    g_disc[g_discCount].id = id;
-    strlcpy(g_disc[g_discCount].name, nm, sizeof(g_disc[g_discCount].name));
-    g_disc[g_discCount].rssi = rssi;
-    g_disc[g_discCount].lastSeen = millis();
-    g_discCount++;
-  } else {
-    // replace oldest
-    int oldest = 0;
-    for (int i=1;i<MAX_DISC;i++){
-      if (g_disc[i].lastSeen < g_disc[oldest].lastSeen) oldest = i;
-    }
-    g_disc[oldest].id = id;
-    strlcpy(g_disc[oldest].name, nm, sizeof(g_disc[oldest].name));
-    g_disc[oldest].rssi = rssi;
-    g_disc[oldest].lastSeen = millis();
+  chanScan();                           // pick data channels around busy ones
+  radioSetFrequency(LORA_BAND);
+  tdmaReset(addrSelf());
+
+  // messages still waiting from before the reboot
+  outboxInit();
+  for (int i=0;i<OUTBOX_MAX;i++){
+    const OutboxEntry& e = outboxAt(i);
+    if (!e.used) continue;
+    pushChat(addrSelf(), e.text, ST_OUTBOX, e.seq, e.peer);
   }
 }
 
-static inline void putU32BE(uint8_t* b, uint32_t v){
-  b[0]=uint8_t(v>>24); b[1]=uint8_t(v>>16); b[2]=uint8_t(v>>8); b[3]=uint8_t(v);
-}
-
-static inline uint32_t getU32BE(const uint8_t* b){
-  return (uint32_t)b[0]<<24 | (uint32_t)b[1]<<16 | (uint32_t)b[2]<<8 | (uint32_t)b[3];
+void discUpsert(uint8_t id, uint32_t node, const char* nm, int8_t rssi){
+  peerHeard(id);
+  // same node: by full ID when both sides have one (its short may have moved), else by short
+  int at = -1;
+  for (int i=0;i<g_discCount && at<0;i++)
+    if (node && g_disc[i].node ? g_disc[i].node == node : g_disc[i].id == id) at = i;
+  if (at < 0){
+    if (g_discCount < MAX_DISC) at = g_discCount++;
+    else {
+      // replace oldest
+      at = 0;
+      for (int i=1;i<MAX_DISC;i++) if (g_disc[i].lastSeen < g_disc[at].lastSeen) at = i;
+    }
+    g_disc[at].node = 0;
+  }
+  g_disc[at].id = id;
+  if (node) g_disc[at].node = node;
+  strlcpy(g_disc[at].name, nm, sizeof(g_disc[at].name));
+  g_disc[at].rssi = rssi;
+  g_disc[at].lastSeen = millis();
 }
 
-bool protocolSendInviteRequest(uint8_t to, uint32_t code6){
+bool protocolSendInviteRequest(uint8_t to, uint32_t toNode, uint32_t code6){
+  inviteeNode = toNode;
   Packet p{}; 
-  p.sender=DEVICE_ID; p.receiver=to; p.type=TYPE_INV_REQ; p.seq=0;
+  p.sender=addrSelf(); p.receiver=to; p.type=TYPE_INV_REQ; p.seq=0;
   memset(p.body,0,sizeof(p.body));
   putU32BE((uint8_t*)p.body, code6);
-  String nm = storageDeviceName();
-  nm.substring(0,20).toCharArray(p.body+4, 21); // up to 20 chars + NUL
-  p.len = 24; // 4 (code) + 20 (name)
-  p.crc=0; p.crc=crc8((uint8_t*)&p, sizeof(p)-1);
-
-  LoRa.beginPacket(); LoRa.write((uint8_t*)&p, sizeof(p));
-  bool ok=(LoRa.endPacket(true)==1);
-  LoRa.receive();
-  return ok;
+  strncpy(p.body+4, storageDeviceName().c_str(), 20);   // up to 20 chars, NUL padded
+  putU32BE((uint8_t*)p.body+24, addrNodeId());
+  putU32BE((uint8_t*)p.body+28, toNode);
+  addrUsed((uint8_t*)p.body+32);
+  for (uint8_t i=0;i<INV_NONCE_LEN;i++) inviteNonce[i] = (uint8_t)esp_random();
+  memcpy(p.body + INV_REQ_LEN, inviteNonce, INV_NONCE_LEN);
+  p.len = INV_REQ_KEYED_LEN;
+
+  // Sent once, unacknowledged: don't step on a discovery reply. Those to our
+  // last request come at random for a few airtimes, some from nodes we can't hear.
+  uint32_t air = frameAirMs(sizeof(Packet), false);
+  int32_t quiet = (int32_t)(discReqMs + (DISC_RSP_SLOTS + 2) * air - millis());
+  if (quiet > 0) delay(quiet);
+  ccWaitTurn();                        // paced and carrier-sensed like every other frame
+  return sendRaw(p);
 }
 
 bool protocolSendInviteAccept(uint8_t to, uint32_t code6){
+  Contact c{};
+  c.id   = invPeerAddr ? invPeerAddr : to;
+  c.self = invSelfAddr ? invSelfAddr : addrSelf();
+  c.node = invPeerNode;
+  strlcpy(c.name, inviterName, sizeof(c.name));
+  uint8_t nonce[INV_NONCE_LEN];
+  for (uint8_t i=0;i<INV_NONCE_LEN;i++) nonce[i] = (uint8_t)esp_random();
+  pairKey(String(inviterName), storageDeviceName(), code6, invPeerNonce, nonce, c.key);
+  storageAddContact(c);
+
   Packet p{}; 
-  p.sender=DEVICE_ID; p.receiver=to; p.type=TYPE_INV_ACK; p.seq=0;
+  p.sender=c.self; p.receiver=to; p.type=TYPE_INV_ACK; p.seq=0;
   memset(p.body,0,sizeof(p.body));
   putU32BE((uint8_t*)p.body, code6);
-  String nm = storageDeviceName();
-  nm.substring(0,20).toCharArray(p.body+4, 21);
-  p.len = 24;
-  p.crc=0; p.crc=crc8((uint8_t*)&p, sizeof(p)-1);
-
-  LoRa.beginPacket(); LoRa.write((uint8_t*)&p, sizeof(p));
-  bool ok=(LoRa.endPacket(true)==1);
-  LoRa.receive();
-  return ok;
+  strncpy(p.body+4, storageDeviceName().c_str(), 20);
+  putU32BE((uint8_t*)p.body+24, addrNodeId());
+  p.body[28] = (char)c.id;
+  memcpy(p.body + INV_ACK_LEN, nonce, INV_NONCE_LEN);
+  p.len = INV_ACK_KEYED_LEN;
+
+  ccWaitTurn();
+  return sendRaw(p);
 }
@@ -9,19 +9,30 @@
 enum MsgType : uint8_t {
   TYPE_DATA = 1,
   TYPE_ACK  = 2,
+  TYPE_FRAG     = 3,    // one fragment of a long encrypted message (see frag.h)
+  TYPE_FRAG_ACK = 4,    // selective ACK bitmap for a fragmented message
+  TYPE_NACK = 5,        // control: DATA received but can't be opened (not a contact)
+  TYPE_PING = 6,        // link probe, answered with TYPE_PONG
+  TYPE_PONG = 7,        // control
+  TYPE_SYNC_REQ  = 8,   // history digest (see sync.h)
+  TYPE_SYNC_RSP  = 9,   // mismatching buckets + the responder's ids in them
+  TYPE_SYNC_PULL = 12,  // ids the initiator is missing
+  TYPE_TDMA_BEACON = 13,  // broadcast: network time for slotted mode (see tdma.h)
   TYPE_DISC_REQ = 10,
   TYPE_DISC_RSP = 11,
   TYPE_INV_REQ  = 20,   // inviter -> invitee (contains 6-digit code + name)
   TYPE_INV_ACK  = 21    // invitee -> inviter (echoes code + name)
 };
 
-enum MsgStatus : uint8_t { ST_QUEUED, ST_SENT, ST_DELIVERED, ST_FAILED, ST_RECV };
+enum MsgStatus : uint8_t { ST_QUEUED, ST_SENT, ST_DELIVERED, ST_FAILED, ST_RECV,
+                           ST_OUTBOX };   // peer unreachable, waiting in the outbox
 
 struct ChatMsg {
   uint8_t   from;
-  String    text;
+  const char* text;   // in the chat text ring; valid until the next message is added
   MsgStatus status;
   uint16_t  seq;
+  uint8_t   peer;     // contact the conversation is with
 };
 
 // Nearby cache item
@@ -31,7 +42,8 @@ struct NearbyItem {
 };
 
 struct DiscEntry {
-  uint8_t id;
+  uint8_t id;         // short address (addr.h)
+  uint32_t node;      // full node ID, 0 if the peer didn't send one
   char    name[21];   // 20 + null
   int8_t  rssi;
   uint32_t lastSeen;
@@ -61,8 +73,30 @@ void protocolCancelInvite();
 const char* protocolLastInviterName();
 void protocolSendAccept(uint32_t code6);
 
-bool protocolSendInviteRequest(uint8_t to, uint32_t code6);
-bool protocolSendInviteAccept(uint8_t to, uint32_t code6);
+bool protocolSendInviteRequest(uint8_t to, uint32_t toNode, uint32_t code6);
+bool protocolSendInviteAccept(uint8_t to, uint32_t code6);   // also adds the inviter as a contact
+
+uint32_t protocolMacRejects();
+
+// Direct ACK/NACK/PONG as 6-byte control frames (default) or full frames
+void protocolSetCtrlReplies(bool on);    // sealed frames/messages dropped on a bad link tag
+
+// Per-type receive counters (frames that passed the CRC and address checks)
+struct RxTypeStats {
+  uint32_t frames;    // handled
+  uint32_t dropped;   // no handler, or addressed in a way the type doesn't accept
+  uint32_t totalUs;   // time spent in the handler
+  uint32_t maxUs;
+};
+RxTypeStats protocolRxStats(uint8_t type);   // types >= 32 are counted under 0
+void protocolRxStatsDump();                  // to Serial, with the "metrics" command (console.h)
+
+// Link probe: PONG round trip in ms (0 = no answer yet)
+void     protocolSendPing(uint8_t to);
+uint16_t protocolPingRttMs(uint8_t peer);
+
+// How long a first DATA try to `peer` waits for its ACK (rtt.h, bounded by airtime)
+uint32_t protocolAckWaitMs(uint8_t peer);
 
 // Chat
 uint8_t protocolDeviceId();
@@ -76,4 +110,14 @@ void protocolGetChat(int idx, ChatMsg& out);
 int  protocolScrollOffset();
 void protocolScroll(int delta);
 
-void discUpsert(uint8_t id, const char* nm, int8_t rssi);
+void discUpsert(uint8_t id, uint32_t node, const char* nm, int8_t rssi);
+
+// Send-rate control (AIMD): ms until this node may originate its next full frame,
+// and per-frame delivery feedback (false = ACK lost)
+uint32_t protocolTxDeferMs();
+void     protocolTxFeedback(bool delivered);
+
+// Transport hooks used by frag.cpp
+bool protocolSendFrame(uint8_t to, uint8_t type, uint16_t seq, const uint8_t* body, uint8_t len);
+void protocolOnFragSent(uint8_t to, uint16_t msgId, uint8_t kind, bool ok);
+bool protocolOnFragMessage(uint8_t from, uint16_t msgId, uint8_t kind, uint8_t* data, uint16_t len);   // false: not taken, don't SACK
@@ -0,0 +1,194 @@
+#include "radio.h"
+#include "metrics.h"
+
+enum RadioState : uint8_t { RADIO_OFF, RADIO_STANDBY, RADIO_TX, RADIO_RX };
+
+static volatile bool dio0Fired = false;
+static RadioState state = RADIO_OFF;
+static long     curFreq = 0, wantFreq = 0;    // wantFreq: applied at the next TX_DONE
+static uint8_t  rxImplicit = 0;               // header mode of the RX we're in
+static uint8_t  wantImplicit = 0;             // ... and of the next one
+static uint8_t  rxLen = 0, rxAddr = 0;        // frame waiting in the FIFO
+static RadioRxInfo lastRx = {0, 0, 0};
+static RadioStats  stats = {0, 0, 0, 0, 0};
+static uint32_t bwHz = 125000;
+
+static void IRAM_ATTR onDio0(){ dio0Fired = true; }
+
+// ----- Register helpers -----
+static void setMode(uint8_t m){ sxWrite(SX_REG_OP_MODE, SX_MODE_LORA | m); }
+
+static void writeFreq(long hz){
+  uint64_t frf = ((uint64_t)hz << 19) / SX_XTAL_HZ;
+  sxWrite(SX_REG_FRF_MSB,     (uint8_t)(frf >> 16));
+  sxWrite(SX_REG_FRF_MSB + 1, (uint8_t)(frf >> 8));
+  sxWrite(SX_REG_FRF_MSB + 2, (uint8_t)frf);
+  curFreq = wantFreq = hz;
+}
+
+static void setHeader(uint8_t implicitLen){
+  uint8_t m1 = sxRead(SX_REG_MODEM_CONFIG_1);
+  sxWrite(SX_REG_MODEM_CONFIG_1, implicitLen ? (m1 | 0x01) : (m1 & 0xFE));
+  if (implicitLen) sxWrite(SX_REG_PAYLOAD_LENGTH, implicitLen);
+}
+
+static uint8_t bwIndex(uint32_t bw){
+  static const uint32_t steps[] = { 7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000 };
+  for (uint8_t i=0;i<sizeof(steps)/sizeof(steps[0]);i++) if (bw <= steps[i]) return i;
+  return 9;   // 500 kHz
+}
+
+static void setTxPower(int8_t dbm){
+  // PA_BOOST: up to 17 dBm normally, 20 dBm with the high-power DAC
+  uint8_t ocpMa = 100;
+  if (dbm > 17){
+    if (dbm > 20) dbm = 20;
+    sxWrite(SX_REG_PA_DAC, 0x87);
+    ocpMa = 140;
+    dbm -= 3;
+  } else {
+    if (dbm < 2) dbm = 2;
+    sxWrite(SX_REG_PA_DAC, 0x84);
+  }
+  uint8_t trim = ocpMa <= 120 ? (ocpMa - 45) / 5 : (ocpMa + 30) / 10;
+  sxWrite(SX_REG_OCP, 0x20 | (trim & 0x1F));
+  sxWrite(SX_REG_PA_CONFIG, 0x80 | (uint8_t)(dbm - 2));
+}
+
+static void setModem(const RadioConfig& c){
+  uint8_t sf = constrain(c.sf, 6, 12);
+  uint8_t cr = constrain(c.cr4, 5, 8) - 4;
+  bwHz = c.bw;
+  sxWrite(SX_REG_DETECT_OPTIMIZE,  sf == 6 ? 0xC5 : 0xC3);
+  sxWrite(SX_REG_DETECT_THRESHOLD, sf == 6 ? 0x0C : 0x0A);
+  sxWrite(SX_REG_MODEM_CONFIG_1, (uint8_t)(bwIndex(c.bw) << 4) | (uint8_t)(cr << 1));
+  sxWrite(SX_REG_MODEM_CONFIG_2, (uint8_t)(sf << 4) | (c.crc ? 0x04 : 0));
+  bool ldo = (1000UL << sf) / c.bw > 16;          // symbols longer than 16 ms
+  sxWrite(SX_REG_MODEM_CONFIG_3, 0x04 | (ldo ? 0x08 : 0));   // AGC on
+  sxWrite(SX_REG_PREAMBLE_MSB,     (uint8_t)(c.preamble >> 8));
+  sxWrite(SX_REG_PREAMBLE_MSB + 1, (uint8_t)c.preamble);
+  sxWrite(SX_REG_SYNC_WORD, c.syncWord);
+}
+
+static int rssiOffset(){ return curFreq < 525000000 ? 164 : 157; }   // LF / HF port
+
+static void startRx(){
+  if (state == RADIO_RX) setMode(SX_MODE_STDBY);  // header mode only changes outside RX
+  if (wantFreq != curFreq) writeFreq(wantFreq);
+  setHeader(wantImplicit);
+  sxWrite(SX_REG_DIO_MAPPING_1, SX_DIO0_RX_DONE);
+  setMode(SX_MODE_RX_CONT);
+  rxImplicit = wantImplicit;
+  state = RADIO_RX;
+}
+
+// ----- Setup -----
+bool radioBegin(const RadioPins& pins, const RadioConfig& cfg){
+  sxBusBegin(pins, onDio0);
+  if (sxRead(SX_REG_VERSION) != SX_VERSION) return false;
+  setMode(SX_MODE_SLEEP);                         // LoRa bit only changes in sleep
+  writeFreq(cfg.freqHz);
+  sxWrite(SX_REG_FIFO_TX_BASE, 0);
+  sxWrite(SX_REG_FIFO_RX_BASE, 0);
+  sxWrite(SX_REG_LNA, sxRead(SX_REG_LNA) | 0x03); // LNA boost
+  setModem(cfg);
+  setTxPower(cfg.powerDbm);
+  setMode(SX_MODE_STDBY);
+  state = RADIO_STANDBY;
+  wantImplicit = 0;
+  startRx();
+  return true;
+}
+
+// ----- Events -----
+void radioService(){
+  if (state == RADIO_OFF) return;
+  if (!dio0Fired && state != RADIO_TX) return;    // TX also polls, in case the edge was missed
+  dio0Fired = false;
+  uint8_t irq = sxRead(SX_REG_IRQ_FLAGS);
+  if (!irq) return;
+  sxWrite(SX_REG_IRQ_FLAGS, irq);
+
+  if (state == RADIO_TX){
+    if (!(irq & SX_IRQ_TX_DONE)) return;
+    stats.txDone++;
+    startRx();
+    return;
+  }
+  if (state != RADIO_RX || !(irq & SX_IRQ_RX_DONE)) return;
+  if (irq & SX_IRQ_CRC_ERROR){ stats.crcErrors++; metricInc(MC_RX_PHY_CRC); return; }
+  if (rxLen) stats.rxDropped++;                   // the previous one was never read
+  rxLen  = sxRead(SX_REG_RX_NB_BYTES);
+  rxAddr = sxRead(SX_REG_FIFO_RX_CURRENT);
+  stats.rxDone++;
+
+  // link quality of this frame (the registers move on with the next one)
+  lastRx.snrQ4 = (int8_t)sxRead(SX_REG_PKT_SNR);
+  lastRx.rssi  = (int16_t)sxRead(SX_REG_PKT_RSSI) - rssiOffset();
+  uint8_t fei[3];
+  sxReadBurst(SX_REG_FEI_MSB, fei, 3);
+  int32_t raw = ((int32_t)(fei[0] & 0x0F) << 16) | ((int32_t)fei[1] << 8) | fei[2];
+  if (raw & 0x80000) raw -= 0x100000;             // 20-bit two's complement
+  lastRx.freqErrHz = (int32_t)((int64_t)raw * (1L << 24) * bwHz / ((int64_t)SX_XTAL_HZ * 500000));
+}
+
+// ----- Transmit -----
+bool radioSend(const uint8_t* buf, uint8_t len, bool implicitHeader){
+  radioService();
+  if (state == RADIO_TX || state == RADIO_OFF) return false;
+  if (rxLen){ stats.rxDropped++; rxLen = 0; }     // TX shares the FIFO
+  setMode(SX_MODE_STDBY);
+  if (wantFreq != curFreq) writeFreq(wantFreq);
+  setHeader(implicitHeader ? len : 0);
+  sxWrite(SX_REG_FIFO_ADDR_PTR, 0);
+  sxWriteBurst(SX_REG_FIFO, buf, len);
+  sxWrite(SX_REG_PAYLOAD_LENGTH, len);
+  sxWrite(SX_REG_DIO_MAPPING_1, SX_DIO0_TX_DONE);
+  dio0Fired = false;
+  setMode(SX_MODE_TX);
+  state = RADIO_TX;
+  return true;
+}
+
+bool radioTxBusy(){ radioService(); return state == RADIO_TX; }
+
+void radioAbortTx(){
+  if (state != RADIO_TX) return;
+  stats.txAborted++;
+  sxWrite(SX_REG_IRQ_FLAGS, 0xFF);
+  setMode(SX_MODE_STDBY);
+  state = RADIO_STANDBY;
+  startRx();
+}
+
+// ----- Receive -----
+void radioListen(uint8_t implicitLen){
+  wantImplicit = implicitLen;
+  if (state == RADIO_TX || state == RADIO_OFF) return;   // applied at TX_DONE
+  if (state == RADIO_RX && rxImplicit == implicitLen) return;
+  startRx();
+}
+
+void radioSetFrequency(long hz){
+  wantFreq = hz;
+  if (state == RADIO_TX || state == RADIO_OFF || hz == curFreq) return;
+  setMode(SX_MODE_STDBY);
+  writeFreq(hz);
+  state = RADIO_STANDBY;
+  startRx();
+}
+
+uint8_t radioAvailable(){ radioService(); return rxLen; }
+
+void radioRead(uint8_t* buf, uint8_t len){
+  if (!rxLen) return;
+  sxWrite(SX_REG_FIFO_ADDR_PTR, rxAddr);
+  sxReadBurst(SX_REG_FIFO, buf, min(len, rxLen));
+  rxLen = 0;
+}
+
+void radioDiscard(){ rxLen = 0; }
+
+RadioRxInfo radioLastRx(){ return lastRx; }
+int radioRssi(){ return (int)sxRead(SX_REG_RSSI) - rssiOffset(); }
+RadioStats radioStats(){ return stats; }
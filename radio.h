@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+#include "sx127x.h"
+
+// ----- SX127x radio driver -----
+// Nothing here blocks. radioSend() loads the FIFO and starts TX; DIO0 flags
+// TX_DONE and radioService() moves the chip straight to RX continuous.
+// Frequency and header-mode changes asked for while a frame is on air are
+// applied at that point instead of cutting it off. A received frame stays in
+// the FIFO until radioRead() copies it out in one burst.
+struct RadioConfig {
+  long     freqHz;
+  uint8_t  sf;
+  uint32_t bw;
+  uint8_t  cr4;          // coding-rate denominator, 5..8
+  uint16_t preamble;
+  uint8_t  syncWord;
+  int8_t   powerDbm;     // PA_BOOST output, 2..20
+  bool     crc;
+};
+
+bool radioBegin(const RadioPins& pins, const RadioConfig& cfg);   // false: no SX127x answered
+
+// Handles a pending DIO0 event; radioAvailable()/radioTxBusy() call it too.
+void radioService();
+
+bool radioSend(const uint8_t* buf, uint8_t len, bool implicitHeader);   // false while a frame is on air
+bool radioTxBusy();
+void radioAbortTx();                        // TX_DONE never came: back to RX
+
+void radioListen(uint8_t implicitLen = 0);  // RX continuous; implicit header when implicitLen > 0
+void radioSetFrequency(long hz);
+
+// Receive side
+struct RadioRxInfo {
+  int16_t rssi;          // dBm
+  int8_t  snrQ4;         // SNR in 0.25 dB steps
+  int32_t freqErrHz;     // carrier offset of the sender relative to us
+};
+uint8_t     radioAvailable();                   // length of the frame waiting (0 = none)
+void        radioRead(uint8_t* buf, uint8_t len);   // burst-copy it out; the rest is dropped
+void        radioDiscard();
+RadioRxInfo radioLastRx();
+int         radioRssi();                        // current channel, for carrier sense
+
+struct RadioStats {
+  uint32_t txDone;
+  uint32_t rxDone;
+  uint32_t crcErrors;    // dropped by the PHY CRC
+  uint32_t rxDropped;    // overwritten or cut by our own TX before being read
+  uint32_t txAborted;
+};
+RadioStats radioStats();
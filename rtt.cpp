@@ -0,0 +1,109 @@
+#include "rtt.h"
+
+struct RttEntry {
+  uint8_t  peer;
+  uint32_t srtt8;      // smoothed RTT, ms * 8
+  uint32_t rttvar4;    // mean deviation, ms * 4
+  uint16_t lastMs;
+  uint32_t samples;
+  uint32_t lastUse;
+  uint16_t hist[RTT_HIST_BUCKETS];
+};
+static RttEntry peers[RTT_MAX_PEERS];
+static int peerCount = 0;
+static uint32_t useClock = 0;
+
+static RttEntry* findPeer(uint8_t peer){
+  for (int i=0;i<peerCount;i++) if (peers[i].peer==peer) return &peers[i];
+  return nullptr;
+}
+
+static RttEntry* addPeer(uint8_t peer){
+  RttEntry* e;
+  if (peerCount < RTT_MAX_PEERS) e = &peers[peerCount++];
+  else {
+    e = &peers[0];                                     // evict least recently sampled
+    for (int i=1;i<RTT_MAX_PEERS;i++) if (peers[i].lastUse < e->lastUse) e = &peers[i];
+  }
+  memset(e, 0, sizeof(*e));
+  e->peer = peer;
+  return e;
+}
+
+static int bucketFor(uint32_t ms){
+  int b = 0; uint32_t edge = 50;
+  while (b < RTT_HIST_BUCKETS-1 && ms >= edge){ b++; edge <<= 1; }
+  return b;
+}
+
+void rttSample(uint8_t peer, uint32_t rttMs){
+  RttEntry* e = findPeer(peer);
+  if (!e) e = addPeer(peer);
+  if (e->samples == 0){
+    e->srtt8   = rttMs << 3;
+    e->rttvar4 = rttMs << 1;                           // rttvar = rtt/2
+  } else {
+    int32_t err = (int32_t)rttMs - (int32_t)(e->srtt8 >> 3);
+    e->srtt8 += err;                                   // srtt += err/8
+    if (err < 0) err = -err;
+    e->rttvar4 += err - (int32_t)(e->rttvar4 >> 2);    // rttvar += (|err| - rttvar)/4
+  }
+  e->lastMs = (uint16_t)min(rttMs, (uint32_t)0xFFFF);
+  e->samples++;
+  e->lastUse = ++useClock;
+  uint16_t& h = e->hist[bucketFor(rttMs)];
+  if (h < 0xFFFF) h++;
+}
+
+uint32_t rttTimeoutMs(uint8_t peer, uint8_t attempt, uint32_t initialMs, uint32_t floorMs, uint32_t ceilMs){
+  RttEntry* e = findPeer(peer);
+  uint32_t rto = (e && e->samples) ? (e->srtt8 >> 3) + e->rttvar4 : initialMs;   // srtt + 4*rttvar
+  rto <<= min(attempt, (uint8_t)4);
+  return constrain(rto, floorMs, ceilMs);
+}
+
+uint32_t rttBackoffMs(uint8_t attempt){
+  uint32_t window = min((uint32_t)RTT_BACKOFF_BASE_MS << min(attempt, (uint8_t)8), (uint32_t)RTT_BACKOFF_MAX_MS);
+  return window/2 + esp_random() % (window/2 + 1);
+}
+
+int rttPeerCount(){ return peerCount; }
+
+bool rttStatsAt(int i, RttStats& out){
+  if (i<0 || i>=peerCount) return false;
+  const RttEntry& e = peers[i];
+  out.peer     = e.peer;
+  out.srttMs   = (uint16_t)min(e.srtt8 >> 3, (uint32_t)0xFFFF);
+  out.rttvarMs = (uint16_t)min(e.rttvar4 >> 2, (uint32_t)0xFFFF);
+  out.lastMs   = e.lastMs;
+  out.samples  = e.samples;
+  memcpy(out.hist, e.hist, sizeof(out.hist));
+  return true;
+}
+
+int rttRowCount(){ return peerCount; }
+
+void rttRow(int i, const char*& name, char* value, size_t n){
+  static char label[12];
+  RttStats st;
+  if (!rttStatsAt(i, st)){ name = "rtt"; snprintf(value, n, "-"); return; }
+  snprintf(label, sizeof(label), "rtt.%u", st.peer);
+  name = label;
+  snprintf(value, n, "%u/%lu", st.srttMs, (unsigned long)rttTimeoutMs(st.peer, 0, 0, 0, UINT32_MAX));
+}
+
+// rtt <peer> srtt rttvar rto last samples, then "<edge:count" per bucket
+void rttDump(){
+  for (int i=0;i<peerCount;i++){
+    RttStats st;
+    rttStatsAt(i, st);
+    Serial.printf("rtt %u %u %u %lu %u %lu", st.peer, st.srttMs, st.rttvarMs,
+                  (unsigned long)rttTimeoutMs(st.peer, 0, 0, 0, UINT32_MAX), st.lastMs, (unsigned long)st.samples);
+    uint32_t edge = 50;
+    for (int b=0;b<RTT_HIST_BUCKETS;b++, edge <<= 1){
+      if (b < RTT_HIST_BUCKETS - 1) Serial.printf(" <%lu:%u", (unsigned long)edge, st.hist[b]);
+      else Serial.printf(" +:%u", st.hist[b]);
+    }
+    Serial.printf("\n");
+  }
+}
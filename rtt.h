@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+
+// Per-peer round-trip estimation (Jacobson/Karels) for ACKed DATA frames.
+// An RTT sample runs from the start of our transmission to the ACK, so it
+// includes both airtimes and the peer's turnaround.
+static const int     RTT_MAX_PEERS     = 10;     // matches the contact list
+static const int     RTT_HIST_BUCKETS  = 8;      // <50,<100,<200,<400,<800,<1600,<3200,>=3200 ms
+static const uint16_t RTT_BACKOFF_BASE_MS = 60;
+static const uint16_t RTT_BACKOFF_MAX_MS  = 2000;
+
+void     rttSample(uint8_t peer, uint32_t rttMs);
+
+// Retransmission timeout for attempt n (0 = first try): SRTT + 4*RTTVAR doubled per
+// retry, clamped to [floorMs, ceilMs]. Peers without samples get initialMs.
+uint32_t rttTimeoutMs(uint8_t peer, uint8_t attempt, uint32_t initialMs, uint32_t floorMs, uint32_t ceilMs);
+
+// Pause before retry n: exponential window with "equal jitter" (half fixed, half random).
+uint32_t rttBackoffMs(uint8_t attempt);
+
+// Diagnostics
+struct RttStats {
+  uint8_t  peer;
+  uint16_t srttMs;
+  uint16_t rttvarMs;
+  uint16_t lastMs;
+  uint32_t samples;
+  uint16_t hist[RTT_HIST_BUCKETS];
+};
+int  rttPeerCount();
+bool rttStatsAt(int i, RttStats& out);
+
+// Diagnostics page: one row per peer, "rtt.<id>" srtt/rto ms (first try)
+int  rttRowCount();
+void rttRow(int i, const char*& name, char* value, size_t n);
+void rttDump();                          // per peer, with the histogram, to Serial
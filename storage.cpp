@@ -5,20 +5,39 @@
 static Preferences prefs;
 static String deviceName;
 static Contact contacts[10];
+static uint8_t shortAddr = 0;
+
+// Contact record: [0] id  [1] self  [2..5] node (BE)  [6..21] name  [22..53] key
+// Records written before pair addresses were 49 bytes: id, name, key.
+static const size_t CONTACT_REC_LEN    = 1+1+4+16+32;
+static const size_t CONTACT_REC_LEN_V1 = 1+16+32;
 static int contactCount = 0;
+static bool relayOn = false;
+static bool tdmaOn = false;
 
 void storageInit(){
   prefs.begin("loraim", false);
   deviceName = prefs.getString("name", "");
+  relayOn = prefs.getBool("relay", false);
+  tdmaOn  = prefs.getBool("tdma", false);
+  shortAddr = prefs.getUChar("addr", 0);
   contactCount = prefs.getUChar("cc", 0);
   if (contactCount<0 || contactCount>10) contactCount=0;
   for (int i=0;i<contactCount;i++){
     char keyn[8]; snprintf(keyn,sizeof(keyn),"c%02d",i);
-    uint8_t buf[1+16+32]; size_t len=prefs.getBytes(keyn, buf, sizeof(buf));
-    if (len==sizeof(buf)){
-      contacts[i].id = buf[0];
-      memcpy(contacts[i].name, buf+1, 16);
-      memcpy(contacts[i].key,  buf+17, 32);
+    uint8_t buf[CONTACT_REC_LEN]; size_t len=prefs.getBytes(keyn, buf, sizeof(buf));
+    Contact& c = contacts[i];
+    memset(&c, 0, sizeof(c));
+    if (len==CONTACT_REC_LEN){
+      c.id   = buf[0];
+      c.self = buf[1];
+      c.node = (uint32_t)buf[2]<<24 | (uint32_t)buf[3]<<16 | (uint32_t)buf[4]<<8 | buf[5];
+      memcpy(c.name, buf+6, 16);
+      memcpy(c.key,  buf+22, 32);
+    } else if (len==CONTACT_REC_LEN_V1){
+      c.id = buf[0];                              // self filled in by addrInit()
+      memcpy(c.name, buf+1, 16);
+      memcpy(c.key,  buf+17, 32);
     }
   }
   prefs.end();
@@ -51,25 +70,75 @@ bool storageAddContact(const Contact& c){
   return true;
 }
 
+void storageSetContactSelf(int i, uint8_t self){
+  if (i<0 || i>=contactCount) return;
+  contacts[i].self = self;
+  storageSaveContacts();
+}
+
 void storageSaveContacts(){
   prefs.begin("loraim", false);
   prefs.putUChar("cc", contactCount);
   for (int i=0;i<contactCount;i++){
     char keyn[8]; snprintf(keyn,sizeof(keyn),"c%02d",i);
-    uint8_t buf[1+16+32];
-    buf[0]=contacts[i].id;
-    memcpy(buf+1, contacts[i].name, 16);
-    memcpy(buf+17, contacts[i].key, 32);
+    const Contact& c = contacts[i];
+    uint8_t buf[CONTACT_REC_LEN];
+    buf[0]=c.id; buf[1]=c.self;
+    buf[2]=(uint8_t)(c.node>>24); buf[3]=(uint8_t)(c.node>>16); buf[4]=(uint8_t)(c.node>>8); buf[5]=(uint8_t)c.node;
+    memcpy(buf+6, c.name, 16);
+    memcpy(buf+22, c.key, 32);
     prefs.putBytes(keyn, buf, sizeof(buf));
   }
   prefs.end();
 }
 
+uint8_t storageShortAddr(){ return shortAddr; }
+
+void storageSetShortAddr(uint8_t a){
+  shortAddr = a;
+  prefs.begin("loraim", false);
+  prefs.putUChar("addr", shortAddr);
+  prefs.end();
+}
+
+uint16_t storageReserveSeq(uint16_t count){
+  prefs.begin("loraim", false);
+  uint16_t base = prefs.getUShort("seq", 1);
+  prefs.putUShort("seq", (uint16_t)(base + count));
+  prefs.end();
+  return base;
+}
+
+bool storageRelayEnabled(){ return relayOn; }
+
+void storageSetRelayEnabled(bool on){
+  relayOn = on;
+  prefs.begin("loraim", false);
+  prefs.putBool("relay", relayOn);
+  prefs.end();
+}
+
+bool storageTdmaEnabled(){ return tdmaOn; }
+
+void storageSetTdmaEnabled(bool on){
+  tdmaOn = on;
+  prefs.begin("loraim", false);
+  prefs.putBool("tdma", tdmaOn);
+  prefs.end();
+}
+
+// Keeps "seq": peers' replay windows remember our old message ids, and a
+// counter restarted from 1 would be dropped as replays until it caught up.
 void storageFactoryReset(){
   Preferences p; p.begin("loraim", false);
-  p.clear(); p.end();
+  uint16_t seq = p.getUShort("seq", 1);
+  p.clear();
+  p.putUShort("seq", seq);
+  p.end();
   deviceName = "";
   contactCount = 0;
+  relayOn = false;
+  tdmaOn = false;
 }
 
 void storageClearContacts(){
@@ -3,8 +3,10 @@
 #include <Arduino.h>
 
 struct Contact {
-  uint8_t id;
-  char    name[16];
+  uint8_t  id;        // its short address on air (addr.h)
+  uint8_t  self;      // ours toward it, fixed at pairing
+  uint32_t node;      // its full node ID (0 if paired before full IDs)
+  char     name[16];
   uint8_t key[32];
 };
 
@@ -17,8 +19,18 @@ int  storageContactCount();
 const Contact& storageContactAt(int i);
 int  storageFindContact(uint8_t id);
 bool storageAddContact(const Contact& c);
+void storageSetContactSelf(int i, uint8_t self);
 void storageSaveContacts();
 
+uint8_t  storageShortAddr();                  // our primary short address, 0 = not chosen yet
+void     storageSetShortAddr(uint8_t a);
+uint16_t storageReserveSeq(uint16_t count);   // first of `count` never-used message seqs
+
+bool storageRelayEnabled();   // forward other nodes' traffic (mesh relay)
+void storageSetRelayEnabled(bool on);
+bool storageTdmaEnabled();    // slotted TX for contacts (tdma.h)
+void storageSetTdmaEnabled(bool on);
+
 void storageFactoryReset();   // wipe name + contacts
 void storageClearContacts();  // wipe contacts only
 void storageClearName();      // wipe name only
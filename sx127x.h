@@ -0,0 +1,59 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- SX1276/77/78 (LoRa mode) register map, the parts radio.cpp uses -----
+static const uint8_t SX_REG_FIFO             = 0x00;
+static const uint8_t SX_REG_OP_MODE          = 0x01;
+static const uint8_t SX_REG_FRF_MSB          = 0x06;   // MID 0x07, LSB 0x08
+static const uint8_t SX_REG_PA_CONFIG        = 0x09;
+static const uint8_t SX_REG_OCP              = 0x0B;
+static const uint8_t SX_REG_LNA              = 0x0C;
+static const uint8_t SX_REG_FIFO_ADDR_PTR    = 0x0D;
+static const uint8_t SX_REG_FIFO_TX_BASE     = 0x0E;
+static const uint8_t SX_REG_FIFO_RX_BASE     = 0x0F;
+static const uint8_t SX_REG_FIFO_RX_CURRENT  = 0x10;
+static const uint8_t SX_REG_IRQ_FLAGS        = 0x12;   // write 1 to clear
+static const uint8_t SX_REG_RX_NB_BYTES      = 0x13;
+static const uint8_t SX_REG_PKT_SNR          = 0x19;   // signed, 0.25 dB
+static const uint8_t SX_REG_PKT_RSSI         = 0x1A;
+static const uint8_t SX_REG_RSSI             = 0x1B;   // current channel
+static const uint8_t SX_REG_MODEM_CONFIG_1   = 0x1D;   // BW[7:4] CR[3:1] implicit[0]
+static const uint8_t SX_REG_MODEM_CONFIG_2   = 0x1E;   // SF[7:4] CRC[2]
+static const uint8_t SX_REG_PREAMBLE_MSB     = 0x20;   // LSB 0x21
+static const uint8_t SX_REG_PAYLOAD_LENGTH   = 0x22;
+static const uint8_t SX_REG_MODEM_CONFIG_3   = 0x26;   // LDO[3] AGC[2]
+static const uint8_t SX_REG_FEI_MSB          = 0x28;   // 20-bit signed, MID 0x29, LSB 0x2A
+static const uint8_t SX_REG_DETECT_OPTIMIZE  = 0x31;
+static const uint8_t SX_REG_DETECT_THRESHOLD = 0x37;
+static const uint8_t SX_REG_SYNC_WORD        = 0x39;
+static const uint8_t SX_REG_DIO_MAPPING_1    = 0x40;   // DIO0 in [7:6]
+static const uint8_t SX_REG_VERSION          = 0x42;
+static const uint8_t SX_REG_PA_DAC           = 0x4D;
+
+static const uint8_t SX_MODE_LORA      = 0x80;
+static const uint8_t SX_MODE_SLEEP     = 0x00;
+static const uint8_t SX_MODE_STDBY     = 0x01;
+static const uint8_t SX_MODE_TX        = 0x03;
+static const uint8_t SX_MODE_RX_CONT   = 0x05;
+static const uint8_t SX_MODE_MASK      = 0x07;
+
+static const uint8_t SX_IRQ_TX_DONE    = 0x08;
+static const uint8_t SX_IRQ_CRC_ERROR  = 0x20;
+static const uint8_t SX_IRQ_RX_DONE    = 0x40;
+
+static const uint8_t SX_DIO0_RX_DONE   = 0x00;
+static const uint8_t SX_DIO0_TX_DONE   = 0x40;
+
+static const uint8_t SX_VERSION        = 0x12;
+static const long    SX_XTAL_HZ        = 32000000;
+
+// ----- Bus -----
+// sx127x_spi.cpp on the board; a host build links a register-level fake
+// (host/sx127x_fake.cpp) instead.
+struct RadioPins { int8_t sck, miso, mosi, ss, rst, dio0; };   // rst < 0: not wired
+
+void    sxBusBegin(const RadioPins& pins, void (*dio0Isr)());   // SPI, reset pulse, DIO0 rising edge
+uint8_t sxRead(uint8_t reg);
+void    sxWrite(uint8_t reg, uint8_t v);
+void    sxReadBurst(uint8_t reg, uint8_t* buf, uint8_t n);          // one transaction, address held
+void    sxWriteBurst(uint8_t reg, const uint8_t* buf, uint8_t n);
@@ -0,0 +1,47 @@
+#include "sx127x.h"
+#include <SPI.h>
+
+// ----- SX127x over the ESP32's SPI bus -----
+static const SPISettings SX_SPI(8000000, MSBFIRST, SPI_MODE0);
+static int8_t ssPin = -1;
+
+void sxBusBegin(const RadioPins& pins, void (*dio0Isr)()){
+  ssPin = pins.ss;
+  pinMode(ssPin, OUTPUT);
+  digitalWrite(ssPin, HIGH);
+  if (pins.rst >= 0){
+    pinMode(pins.rst, OUTPUT);
+    digitalWrite(pins.rst, LOW);  delay(10);      // boot only
+    digitalWrite(pins.rst, HIGH); delay(10);
+  }
+  SPI.begin(pins.sck, pins.miso, pins.mosi, ssPin);
+  pinMode(pins.dio0, INPUT);
+  attachInterrupt(digitalPinToInterrupt(pins.dio0), dio0Isr, RISING);
+}
+
+uint8_t sxRead(uint8_t reg){
+  uint8_t v;
+  sxReadBurst(reg, &v, 1);
+  return v;
+}
+
+void sxWrite(uint8_t reg, uint8_t v){ sxWriteBurst(reg, &v, 1); }
+
+void sxReadBurst(uint8_t reg, uint8_t* buf, uint8_t n){
+  memset(buf, 0, n);
+  SPI.beginTransaction(SX_SPI);
+  digitalWrite(ssPin, LOW);
+  SPI.transfer(reg & 0x7F);
+  SPI.transfer(buf, n);                           // in place: clocks out zeros, reads the FIFO
+  digitalWrite(ssPin, HIGH);
+  SPI.endTransaction();
+}
+
+void sxWriteBurst(uint8_t reg, const uint8_t* buf, uint8_t n){
+  SPI.beginTransaction(SX_SPI);
+  digitalWrite(ssPin, LOW);
+  SPI.transfer(reg | 0x80);
+  SPI.writeBytes(buf, n);
+  digitalWrite(ssPin, HIGH);
+  SPI.endTransaction();
+}
@@ -0,0 +1,29 @@
+#include "sync.h"
+
+// murmur3 finalizer: spreads the few bits that differ between nearby ids
+static uint32_t mix(uint32_t x){
+  x ^= x >> 16; x *= 0x85EBCA6Bu;
+  x ^= x >> 13; x *= 0xC2B2AE35u;
+  x ^= x >> 16;
+  return x;
+}
+
+uint8_t syncBucket(uint32_t id){ return (uint8_t)(mix(id) % SYNC_BUCKETS); }
+
+void syncDigest(const uint32_t* ids, int n, uint8_t out[SYNC_DIGEST_LEN]){
+  memset(out, 0, SYNC_DIGEST_LEN);
+  for (int i=0;i<n;i++){
+    uint32_t h = mix(ids[i]);
+    uint8_t* b = out + (h % SYNC_BUCKETS) * 3;
+    b[0]++;
+    b[1] ^= (uint8_t)(h >> 24);
+    b[2] ^= (uint8_t)(h >> 16);
+  }
+}
+
+uint16_t syncMismatch(const uint8_t a[SYNC_DIGEST_LEN], const uint8_t b[SYNC_DIGEST_LEN]){
+  uint16_t mask = 0;
+  for (uint8_t i=0;i<SYNC_BUCKETS;i++)
+    if (memcmp(a + i*3, b + i*3, 3) != 0) mask |= (uint16_t)(1u << i);
+  return mask;
+}
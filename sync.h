@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+
+// Set reconciliation for the chat history shared with one contact.
+// A message is identified by (origin node, seq), packed as origin<<16 | seq.
+// Digest: SYNC_BUCKETS buckets chosen by a hash of the id, each holding the
+// number of ids in it and the XOR of a 16-bit mix of each id (3 bytes per
+// bucket). Two sides compare digests, then swap only the ids of the buckets
+// that differ, so the exchange grows with the divergence, not the history.
+static const uint8_t SYNC_BUCKETS    = 16;
+static const uint8_t SYNC_DIGEST_LEN = SYNC_BUCKETS * 3;
+
+static inline uint32_t syncId(uint8_t origin, uint16_t seq){ return (uint32_t)origin << 16 | seq; }
+
+uint8_t  syncBucket(uint32_t id);
+void     syncDigest(const uint32_t* ids, int n, uint8_t out[SYNC_DIGEST_LEN]);
+uint16_t syncMismatch(const uint8_t a[SYNC_DIGEST_LEN], const uint8_t b[SYNC_DIGEST_LEN]);   // bit i = bucket i differs
@@ -0,0 +1,32 @@
+#include "tdma.h"
+
+static uint8_t  selfId   = 0;
+static uint8_t  refId    = 0;
+static int32_t  offsetMs = 0;      // network time - millis()
+static uint32_t refSeenMs = 0;
+
+void tdmaReset(uint8_t self){
+  selfId = self; refId = self; offsetMs = 0;
+}
+
+uint32_t tdmaNow(uint32_t ms){
+  if (refId != selfId && ms - refSeenMs > TDMA_REF_TIMEOUT_MS) tdmaReset(selfId);   // root went quiet
+  return ms + (uint32_t)offsetMs;
+}
+
+uint8_t tdmaRefId(){ return refId; }
+
+void tdmaOnBeacon(uint8_t ref, uint32_t netTimeAtRx, uint32_t ms){
+  if (ref > refId || ref == selfId) return;         // we (or a lower root) already lead
+  refId = ref;
+  offsetMs = (int32_t)(netTimeAtRx - ms);
+  refSeenMs = ms;
+}
+
+uint32_t tdmaDeferMs(uint32_t ms, uint8_t self, uint32_t needMs){
+  uint32_t t     = tdmaNow(ms) % TDMA_FRAME_MS;
+  uint32_t start = (uint32_t)(self % TDMA_SLOTS) * TDMA_SLOT_MS;
+  uint32_t latest = start + (needMs < TDMA_SLOT_MS ? TDMA_SLOT_MS - needMs : 0);
+  if (t >= start && t <= latest) return 0;
+  return (start + TDMA_FRAME_MS - t) % TDMA_FRAME_MS;
+}
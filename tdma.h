@@ -0,0 +1,26 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Slotted TDMA for contacts (optional, Config > TDMA) -----
+// Nodes in TDMA mode share a superframe of TDMA_SLOTS slots; a node starts its
+// own frames (data, retries, fragments, relays, syncs) only inside slot
+// id % TDMA_SLOTS, early enough for the frame and its ACK to end in the slot.
+// The clock is the one of the lowest node ID reachable through beacons:
+// each TDMA node beacons its network time on the rendezvous channel, and
+// adopts any beacon whose reference ID is lower than (or equal to) its own.
+// Discovery, pairing and control replies stay unslotted.
+static const uint8_t  TDMA_SLOTS          = 8;
+static const uint16_t TDMA_SLOT_MS        = 500;
+static const uint32_t TDMA_FRAME_MS       = (uint32_t)TDMA_SLOTS * TDMA_SLOT_MS;
+static const uint32_t TDMA_BEACON_MS      = 10000;
+static const uint32_t TDMA_REF_TIMEOUT_MS = 35000;   // ~3 missed beacons: fall back to own clock
+
+void     tdmaReset(uint8_t self);
+uint32_t tdmaNow(uint32_t ms);                        // network time for local millis()
+uint8_t  tdmaRefId();
+
+// Beacon heard: refId is the sender's clock root, netTimeAtRx its time when the frame ended.
+void     tdmaOnBeacon(uint8_t refId, uint32_t netTimeAtRx, uint32_t ms);
+
+// 0 if a frame exchange of needMs fits in our slot now, else ms until our next slot starts.
+uint32_t tdmaDeferMs(uint32_t ms, uint8_t self, uint32_t needMs);
@@ -0,0 +1,33 @@
+#include "trace.h"
+
+#if TRACE
+TraceRec traceRing[TRACE_CAP];
+uint16_t traceHead = 0;
+uint32_t traceTotal = 0;
+bool     traceOn = true;
+
+static const char* const EVENT_NAMES[TR_COUNT] = {
+  "key", "t9", "send", "compress", "tx_wait", "lbt", "air", "ack_wait", "backoff",
+  "rx", "open", "kdf", "xor", "mac", "draw_chat", "flush"
+};
+static_assert(sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]) == TR_COUNT, "EVENT_NAMES");
+
+void traceSetEnabled(bool on){ traceOn = on; }
+
+void traceClear(){ traceHead = 0; traceTotal = 0; }
+
+// Paused while it prints, so the dump is one consistent snapshot
+void traceDump(){
+  bool was = traceOn;
+  traceOn = false;
+  uint16_t n = traceTotal < TRACE_CAP ? (uint16_t)traceTotal : TRACE_CAP;
+  Serial.printf("trace %u events, %lu overwritten, now %lu us\n",
+                n, (unsigned long)(traceTotal - n), (unsigned long)micros());
+  for (uint16_t i=0;i<n;i++){
+    const TraceRec& r = traceRing[(traceHead - n + i) & (TRACE_CAP - 1)];
+    Serial.printf("T %lu %c %s %u\n", (unsigned long)r.us, r.ph, r.ev < TR_COUNT ? EVENT_NAMES[r.ev] : "?", r.arg);
+  }
+  Serial.printf("trace end\n");
+  traceOn = was;
+}
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+#include <Arduino.h>
+
+// ----- Event trace -----
+// Timestamped begin/end marks at the points a message passes through (keypad,
+// T9, compress, crypto, carrier sense, airtime, ACK wait, RX dispatch, drawing,
+// display push), kept in a RAM ring of the last TRACE_CAP events. Recording is
+// a micros() read and an 8-byte store. The serial "trace" command dumps the
+// ring as text lines:
+//   T <us> <B|E|X> <event> <arg>
+// B/E bracket a span, X is a complete span of <arg> ms (airtime).
+// host/trace2json turns a dump (or a simulator log) into Chrome trace JSON for
+// chrome://tracing or ui.perfetto.dev.
+// Build with TRACE 0 and the macros are empty.
+#ifndef TRACE
+#define TRACE 1
+#endif
+
+enum TraceEvent : uint8_t {
+  TR_KEY,          // input: one keypad press handled (arg: key)
+  TR_T9,           // input: T9 digit (arg: digit)
+  TR_SEND,         // protocol: chat send, log to settled (arg: seq)
+  TR_COMPRESS,     // arg: text length
+  TR_TX_WAIT,      // previous TX still on air
+  TR_LBT,          // listen before talk
+  TR_AIR,          // X: time on air (arg: ms)
+  TR_ACK_WAIT,     // arg: seq
+  TR_BACKOFF,      // pause before a retry (arg: attempt)
+  TR_RX,           // protocol: one received frame handled (arg: type)
+  TR_OPEN,         // decrypt + decompress into the chat log (arg: seq)
+  TR_KDF,          // crypto: derivePairKey
+  TR_XOR,          // crypto: keystreamXor (arg: bytes)
+  TR_MAC,          // crypto: macTag (arg: bytes)
+  TR_DRAW_CHAT,    // ui: uiDrawChat
+  TR_FLUSH,        // ui: display push
+  TR_COUNT
+};
+
+static const uint16_t TRACE_CAP = 512;        // power of two; 4 KB
+
+struct TraceRec {
+  uint32_t us;
+  uint16_t arg;
+  uint8_t  ev;
+  char     ph;
+};
+
+#if TRACE
+extern TraceRec traceRing[TRACE_CAP];
+extern uint16_t traceHead;
+extern uint32_t traceTotal;
+extern bool     traceOn;
+
+static inline void traceRecord(uint8_t ev, char ph, uint32_t arg){
+  if (!traceOn) return;
+  TraceRec& r = traceRing[traceHead];
+  traceHead = (traceHead + 1) & (TRACE_CAP - 1);
+  traceTotal++;
+  r.us = micros(); r.arg = (uint16_t)min(arg, (uint32_t)0xFFFF); r.ev = ev; r.ph = ph;
+}
+
+// Begin here, end when the scope closes
+struct TraceSpan {
+  uint8_t ev;
+  TraceSpan(uint8_t e, uint32_t arg) : ev(e) { traceRecord(e, 'B', arg); }
+  ~TraceSpan(){ traceRecord(ev, 'E', 0); }
+};
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+#define TRACE_SPAN(ev, arg)     TraceSpan TRACE_CAT(traceSpan_, __LINE__)((ev), (arg))
+#define TRACE_COMPLETE(ev, ms)  traceRecord((ev), 'X', (ms))
+
+void traceSetEnabled(bool on);
+void traceClear();
+void traceDump();                        // oldest first, to Serial
+#else
+#define TRACE_SPAN(ev, arg)     ((void)0)
+#define TRACE_COMPLETE(ev, ms)  ((void)0)
+
+static inline void traceSetEnabled(bool){}
+static inline void traceClear(){}
+static inline void traceDump(){ Serial.printf("tracing compiled out (TRACE 0)\n"); }
+#endif
@@ -4,6 +4,10 @@
 #include "storage.h"
 #include "input.h"
 #include "protocol.h"
+#include "metrics.h"
+#include "loopprof.h"
+#include "rtt.h"
+#include "trace.h"
 
 #ifdef WIRELESS_STICK_V3
 SSD1306Wire oled(0x3c, 500000, SDA_OLED, SCL_OLED, GEOMETRY_64_32, RST_OLED);
@@ -31,10 +35,6 @@ uint8_t  inviterId = 0;
 char     inviterName[21] = {0};
 uint32_t inviterCodeExpected = 0;
 
-extern uint32_t dbg_rxCount;
-extern int8_t   dbg_lastRssi;
-extern uint8_t  dbg_lastType, dbg_lastFrom, dbg_lastTo, dbg_lastWhy;
-
 extern Page page;
 extern SSD1306Wire oled;
 extern bool blinkOn;     // use the same blinkOn you already have in ui.cpp
@@ -84,12 +84,19 @@ void uiTick(){
       uiDrawNameEntry();
     } else if (page == PAGE_INVITE_PROMPT) {
       uiDrawInvitePrompt();
+    } else if (page == PAGE_METRICS && blinkOn) {
+      uiDrawMetrics();               // live values, once a second
     }
   }
 }
 
 // ====== Small text helpers ======
-static void flush(){ oled.display(); }
+static void flush(){
+  TRACE_SPAN(TR_FLUSH, 0);
+  uint32_t t0 = micros();
+  oled.display();
+  metricObserve(MH_FLUSH_US, micros() - t0);
+}
 
 // Measure-fitted compose tail
 static String fitTail(const String& s, int maxPixels, int &w){
@@ -172,7 +179,7 @@ void uiDrawNameEntry(){
   }
 
   oled.drawString(0, 40, "Enter=Save    ESC=Delete");
-  oled.display();
+  flush();
 }
 
 
@@ -222,7 +229,7 @@ void uiDrawSearch(){
   }
 
   oled.drawString(0, 56, "U/D=Select  Enter=Invite  X=Back");
-  oled.display();
+  flush();
 }
 
 void uiDrawInviteCode(){
@@ -235,7 +242,7 @@ void uiDrawInviteCode(){
   oled.setFont(ArialMT_Plain_10);
   oled.drawString(0,40, String("To ID: ") + String(inviteeId));
   oled.drawString(0,56,"Waiting for accept...  X=Back");
-  oled.display();
+  flush();
 }
 
 void uiShowInviteCode(uint8_t toId, uint32_t code6){
@@ -260,7 +267,7 @@ void uiDrawInvitePrompt(){
   }
   oled.setFont(ArialMT_Plain_10);
   oled.drawString(0,56,"Enter=OK  X=Back");
-  oled.display();
+  flush();
 }
 
 void inviteReset(){
@@ -286,6 +293,7 @@ void uiShowInvitePrompt(uint8_t fromId, const char* fromNm, uint32_t code6){
 }
 
 void uiDrawChat(){
+  TRACE_SPAN(TR_DRAW_CHAT, 0);
   oled.clear();
   oled.setColor(WHITE);
   oled.setFont(ArialMT_Plain_10);
@@ -299,6 +307,7 @@ void uiDrawChat(){
     String tag="";
     if (mine){
       if (m.status==ST_FAILED) tag=" /x";
+      else if (m.status==ST_OUTBOX) tag=" /o";
       else if (m.status==ST_DELIVERED) tag=" //";
     }
     std::vector<String> lines;
@@ -427,7 +436,7 @@ void uiRedrawComposeBand(bool push = true) {
     oled.setTextAlignment(TEXT_ALIGN_LEFT);
   }
 
-  if (push) oled.display();
+  if (push) flush();
 }
 
 void uiDrawConfig(){
@@ -440,14 +449,51 @@ void uiDrawConfig(){
   extern int configSelGet();
   int sel = configSelGet();
 
-  const char* items[3] = {"Broadcast", "Contact List", "Factory reset"};
-  for (int i=0; i<3; ++i){
+  const int N = 6, ROWS = 4;
+  const char* items[N] = {"Broadcast", "Contact List",
+                          storageRelayEnabled() ? "Relay: on" : "Relay: off",
+                          storageTdmaEnabled()  ? "TDMA: on"  : "TDMA: off", "Diagnostics", "Factory reset"};
+  int first = constrain(sel - (ROWS-1), 0, N - ROWS);   // scroll to keep the selection visible
+  for (int i=first; i<first+ROWS; ++i){
     String line = String((i==sel)?"> ":"  ") + items[i];
-    oled.drawString(0, 14 + i*12, line);
+    oled.drawString(0, 12 + (i-first)*10, line);
   }
 
-  oled.drawString(0, 56, "U/D=Move  Enter=Select  ESC=Back");
-  oled.display();
+  oled.drawString(0, 54, "U/D=Move  Enter=Select  ESC=Back");
+  flush();
+}
+
+// Metrics registry, one per row: counters, gauges (now ^max), histograms (n/avg/max),
+// then per-peer RTT (srtt/rto ms) and loop() stage timing (avg/max us)
+int uiDiagRowCount(){ return metricsRowCount() + rttRowCount() + loopProfRowCount(); }
+
+static void diagRow(int i, const char*& name, char* value, size_t n){
+  if (i < metricsRowCount()){ metricsRow(i, name, value, n); return; }
+  i -= metricsRowCount();
+  if (i < rttRowCount()) rttRow(i, name, value, n);
+  else loopProfRow(i - rttRowCount(), name, value, n);
+}
+
+void uiDrawMetrics(){
+  oled.clear();
+  oled.setFont(ArialMT_Plain_10);
+  oled.setTextAlignment(TEXT_ALIGN_LEFT);
+  oled.drawString(0, 0, "Diagnostics");
+
+  const int ROWS = 4;
+  int first = metricsScrollGet();
+  for (int i=first; i<first+ROWS && i<uiDiagRowCount(); ++i){
+    const char* name; char value[24];
+    diagRow(i, name, value, sizeof(value));
+    int y = 12 + (i-first)*10;
+    oled.setTextAlignment(TEXT_ALIGN_LEFT);
+    oled.drawString(0, y, name);
+    oled.setTextAlignment(TEXT_ALIGN_RIGHT);
+    oled.drawString(128, y, value);
+  }
+  oled.setTextAlignment(TEXT_ALIGN_LEFT);
+  oled.drawString(0, 54, "U/D=Scroll  ESC=Back");
+  flush();
 }
 
 void uiDrawConfirmReset(){
@@ -469,7 +515,7 @@ void uiDrawConfirmReset(){
     oled.drawString(0, 46 + i*10, line);
   }
 
-  oled.display();
+  flush();
 }
 
 void uiForceBlinkRestart(){
@@ -490,17 +536,6 @@ void uiToast(const String& m){
   flush();
 }
 
-void uiDrawRadioDebugOverlay(){
-  // draw a tiny single-line status at the very bottom row
-  oled.setTextAlignment(TEXT_ALIGN_LEFT);
-  oled.setFont(ArialMT_Plain_10);
-  char line[40];
-  // why: 0 ok, 1 short, 2 crc, 3 dst
-  snprintf(line, sizeof(line), "RX:%lu T:%u F:%u->%u L? RSSI:%d W:%u",
-           (unsigned long)dbg_rxCount, dbg_lastType, dbg_lastFrom, dbg_lastTo, dbg_lastRssi, dbg_lastWhy);
-  oled.drawString(0, 54, line); // adjust Y if your footer uses 56
-}
-
 void uiDebugBlinkOverlay() {
   // Draw a 4x4 dot in the top-left that flips state with blinkOn.
   // Does not clear the screen; very cheap.
@@ -513,5 +548,5 @@ void uiDebugBlinkOverlay() {
     oled.fillRect(x, y, sz, sz);
     oled.setColor(WHITE);     // restore for normal drawing
   }
-  oled.display();
+  flush();
 }
@@ -4,14 +4,16 @@
 #include "HT_SSD1306Wire.h"
 
 #define DEVICE_NAME_MAX_LEN 20
-#define CHAT_MSG_MAX_LEN 60
+#define CHAT_MSG_MAX_LEN 480        // packed over one DATA frame goes out fragmented (frag.h)
+#define BROADCAST_MSG_MAX_LEN 151   // broadcast stays single-frame even sent raw (+1 prefix byte)
 
 // Expose display so other modules can render simple toasts if needed
 extern SSD1306Wire oled;
 
 // Application pages
 enum Page : uint8_t { PAGE_NAME, PAGE_CONTACTS, PAGE_SEARCH, PAGE_INVITE_CODE,
-                      PAGE_INVITE_PROMPT, PAGE_CHAT, PAGE_BROADCAST, PAGE_CONFIG, PAGE_CONFIRM_RESET };
+                      PAGE_INVITE_PROMPT, PAGE_CHAT, PAGE_BROADCAST, PAGE_CONFIG, PAGE_CONFIRM_RESET,
+                      PAGE_METRICS };
 extern Page page;
 
 // === Invite state (symbol names matching your project) ===
@@ -40,6 +42,8 @@ void uiDrawSearch();
 void uiDrawChat();
 void uiDrawConfig();
 void uiDrawConfirmReset();
+void uiDrawMetrics();
+int  uiDiagRowCount();        // rows on the Diagnostics page
 void uiRedrawComposeBand(bool push);
 
 void uiDrawInviteCode();